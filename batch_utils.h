@@ -0,0 +1,143 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "rpc_utils.h"
+#include "trace_utils.h"
+
+namespace microservice {
+namespace rpc {
+
+// Opt-in batching of downstream calls, per frontend route:
+//
+//   RPC_BATCH=user,reservation  routes whose calls are batched (default none)
+//   RPC_BATCH_WINDOW_US=N       how long a batch collects calls (default 50)
+//   RPC_BATCH_MAX=N             calls that close a batch early (default 16)
+struct BatchConfig {
+    uint64_t window_ns = 50000;
+    size_t max_items = 16;
+    std::string routes;
+
+    static BatchConfig from_env() {
+        BatchConfig config;
+        const char* routes = getenv("RPC_BATCH");
+        const char* window = getenv("RPC_BATCH_WINDOW_US");
+        const char* max_items = getenv("RPC_BATCH_MAX");
+        if (routes) config.routes = routes;
+        if (window) config.window_ns = strtoull(window, nullptr, 10) * 1000;
+        if (max_items) config.max_items = strtoull(max_items, nullptr, 10);
+        if (config.max_items < 1) config.max_items = 1;
+        return config;
+    }
+
+    bool enabled(const char* route) const {
+        if (max_items < 2) return false;
+        size_t len = strlen(route);
+        for (size_t pos = 0; pos < routes.size();) {
+            size_t end = routes.find(',', pos);
+            if (end == std::string::npos) end = routes.size();
+            if (end - pos == len && routes.compare(pos, len, route) == 0) return true;
+            pos = end + 1;
+        }
+        return false;
+    }
+};
+
+// Collects concurrent calls to one downstream method from many threads into
+// kFlagBatch frames. The first caller to find no open batch opens one and
+// leads it: it waits out the window, or until max_items calls have joined,
+// sends the batch and hands every caller its own response. A batch of one
+// goes out as a plain call.
+//
+// A batch carries the merged trace context of its calls (merge_batch_trace),
+// so a caller whose deadline passes before the batch is answered gets
+// kDeadlineExceeded while the rest still get theirs.
+class MicroBatcher {
+public:
+    MicroBatcher(std::string path, uint64_t window_ns, size_t max_items)
+        : path_(std::move(path)), window_ns_(window_ns), max_items_(max_items) {}
+
+    MicroBatcher(const MicroBatcher&) = delete;
+    MicroBatcher& operator=(const MicroBatcher&) = delete;
+
+    // Same contract as rpc::call() under the current trace context.
+    CallStatus call(const std::string& request, std::string& response) {
+        const utils::TraceContext& trace = utils::current_trace();
+        if (utils::deadline_passed(trace)) return CallStatus::kDeadlineExceeded;
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        std::shared_ptr<Batch> batch = open_;
+        const bool leader = !batch;
+        if (leader) {
+            batch = std::make_shared<Batch>();
+            batch->trace = trace;
+            open_ = batch;
+        } else {
+            merge_batch_trace(batch->trace, trace);
+        }
+        const size_t index = batch->requests.size();
+        batch->requests.push_back(&request);
+        if (batch->requests.size() >= max_items_) {
+            open_.reset();
+            cv_.notify_all();
+        }
+
+        if (leader) {
+            const auto close_at = std::chrono::steady_clock::now() + std::chrono::nanoseconds(window_ns_);
+            cv_.wait_until(lock, close_at, [&] { return open_ != batch; });
+            if (open_ == batch) open_.reset();
+            lock.unlock();
+            send(*batch);
+            lock.lock();
+            batch->done = true;
+            cv_.notify_all();
+        } else {
+            cv_.wait(lock, [&] { return batch->done; });
+        }
+
+        if (batch->status != CallStatus::kOk) return batch->status;
+        if (utils::deadline_passed(trace)) return CallStatus::kDeadlineExceeded;
+        if (batch->failed[index]) return CallStatus::kReadError;
+        response = std::move(batch->responses[index]);
+        return CallStatus::kOk;
+    }
+
+private:
+    struct Batch {
+        utils::TraceContext trace;
+        std::vector<const std::string*> requests; // owned by the waiting callers
+        std::vector<std::string> responses;
+        std::vector<bool> failed;
+        CallStatus status = CallStatus::kOk;
+        bool done = false;
+    };
+
+    std::string path_;
+    uint64_t window_ns_;
+    size_t max_items_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::shared_ptr<Batch> open_; // collecting calls; null between batches
+
+    // Runs in the leader without the lock; the batch is closed by then.
+    void send(Batch& batch) {
+        utils::ScopedTrace scope(batch.trace);
+        if (batch.requests.size() == 1) {
+            batch.responses.resize(1);
+            batch.failed.assign(1, false);
+            batch.status = rpc::call(path_, *batch.requests[0], batch.responses[0]);
+        } else {
+            batch.status = call_batch(path_, batch.requests, batch.responses, batch.failed);
+        }
+    }
+};
+
+} // namespace rpc
+} // namespace microservice
@@ -0,0 +1,142 @@
+// Memory and lookup cost of the profile service's flat store
+// (profile_store.h on flat_store_utils.h) against the map of full
+// HotelProfile messages it replaced, from the 80 sample hotels up to a
+// 1M-hotel catalog.
+//
+// Profiles are generated like the service's hotels 7-80: unique id, name
+// and phone, shared description and city. Memory is the heap growth while
+// building each store (mallinfo2), plus the flat store's sealed mappings. Lookups use random ids, 10% of them
+// unknown; "find" only locates the record, "fill" also writes it into a
+// response the way the service does. The stores' responses are checked to
+// serialize identically.
+//
+// Usage: flat_store_bench [max_hotels] [lookups]    (defaults 1000000, 1000000)
+
+#include <malloc.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "hotel_reservation.pb.h"
+#include "profile_store.h"
+
+using microservice::profile::ProfileStore;
+
+namespace {
+
+using ProfileMap = std::unordered_map<std::string, hotelreservation::HotelProfile>;
+
+hotelreservation::HotelProfile make_profile(size_t i) {
+    hotelreservation::HotelProfile profile;
+    profile.set_id(std::to_string(i));
+    profile.set_name("Hotel " + std::to_string(i));
+    profile.set_phone_number("(415) 555-" + std::to_string(1000 + i));
+    profile.set_description("A comfortable hotel in San Francisco with modern amenities and excellent service.");
+    auto* address = profile.mutable_address();
+    address->set_street_number(std::to_string(100 + i % 9900));
+    address->set_street_name("Main St");
+    address->set_city("San Francisco");
+    address->set_state("CA");
+    address->set_country("United States");
+    address->set_postal_code("94102");
+    address->set_lat(37.7835 + static_cast<double>(i % 1000) / 500.0 * 3);
+    address->set_lon(-122.41 + static_cast<double>(i % 1000) / 500.0 * 4);
+    *address->mutable_padding() = microservice::utils::generate_person_padding();
+    *profile.mutable_padding() = microservice::utils::generate_person_padding();
+    profile.set_version(i * 2654435761u + 1);
+    return profile;
+}
+
+size_t heap_bytes() {
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd; // large vectors are mmapped
+}
+
+double ns_per(std::chrono::steady_clock::time_point start, size_t n) {
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / n;
+}
+
+void run(size_t hotels, const std::vector<std::string>& ids) {
+    size_t before = heap_bytes();
+    ProfileMap map;
+    for (size_t i = 1; i <= hotels; ++i) {
+        hotelreservation::HotelProfile profile = make_profile(i);
+        map[profile.id()] = profile;
+    }
+    const size_t map_bytes = heap_bytes() - before;
+
+    before = heap_bytes();
+    ProfileStore store;
+    {
+        ProfileStore::Builder builder;
+        for (size_t i = 1; i <= hotels; ++i) microservice::profile::add_profile(builder, make_profile(i));
+        store = builder.build();
+    }
+    const size_t store_bytes = heap_bytes() - before + store.bytes(); // its arrays are mapped, not malloc'd
+
+    size_t found = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (const std::string& id : ids) found += map.find(id) != map.end();
+    const double map_find = ns_per(start, ids.size());
+
+    start = std::chrono::steady_clock::now();
+    for (const std::string& id : ids) found -= store.find(id) != nullptr;
+    const double store_find = ns_per(start, ids.size());
+
+    hotelreservation::GetProfilesResponse response;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < ids.size(); ++i) {
+        if (i % 5 == 0) response.Clear();
+        auto it = map.find(ids[i]);
+        if (it != map.end()) *response.add_profiles() = it->second;
+    }
+    const double map_fill = ns_per(start, ids.size());
+
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < ids.size(); ++i) {
+        if (i % 5 == 0) response.Clear();
+        if (const auto* r = store.find(ids[i])) microservice::profile::fill_profile(store, *r, response.add_profiles());
+    }
+    const double store_fill = ns_per(start, ids.size());
+
+    size_t mismatches = found;
+    for (size_t i = 0; i < ids.size() && i < 10000; ++i) {
+        auto it = map.find(ids[i]);
+        const auto* r = store.find(ids[i]);
+        if ((it == map.end()) != (r == nullptr)) {
+            ++mismatches;
+        } else if (r) {
+            hotelreservation::HotelProfile flat;
+            microservice::profile::fill_profile(store, *r, &flat);
+            mismatches += flat.SerializeAsString() != it->second.SerializeAsString();
+        }
+    }
+
+    printf("%9zu %12.1f %12.1f %8.1fx %9.1f %9.1f %9.1f %9.1f %6zu\n", hotels,
+           static_cast<double>(map_bytes) / hotels, static_cast<double>(store_bytes) / hotels,
+           static_cast<double>(map_bytes) / store_bytes, map_find, store_find, map_fill, store_fill, mismatches);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const size_t max_hotels = argc > 1 ? strtoull(argv[1], nullptr, 10) : 1000000;
+    const size_t lookups = argc > 2 ? strtoull(argv[2], nullptr, 10) : 1000000;
+
+    printf("%9s %12s %12s %9s %9s %9s %9s %9s %6s\n", "hotels", "map B/hotel", "flat B/hotel", "smaller",
+           "map find", "flat find", "map fill", "flat fill", "bad");
+    for (size_t hotels = 80; hotels <= max_hotels; hotels *= hotels < 100 ? 125 : 10) {
+        std::mt19937_64 rng(hotels);
+        std::vector<std::string> ids(lookups);
+        for (std::string& id : ids) {
+            const size_t i = 1 + rng() % hotels;
+            id = rng() % 10 == 0 ? "x" + std::to_string(i) : std::to_string(i);
+        }
+        run(hotels, ids);
+    }
+    printf("(bytes per hotel; ns per lookup)\n");
+    return 0;
+}
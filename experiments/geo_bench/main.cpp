@@ -0,0 +1,154 @@
+// Build and query cost of the geo service's spatial indexes (geo_index.h)
+// from the 80 sample hotels up to a 10M-point catalog.
+//
+// Catalog points are uniform over a continental box (lat 25..50, lon
+// -125..-65); queries are uniform over the same box and use the service's
+// parameters (10km radius, 5 results). Each index's answers are checked on
+// a sample of the queries against the service's original algorithm (the
+// haversine to every point, sorted); at large sizes the scan is timed, and
+// the answers checked, on fewer queries. Each index is also timed on the
+// queries as one batch in Z-order (geo_index.h spatial_order).
+//
+// Usage: geo_bench [max_points] [queries]    (defaults 10000000, 100000)
+// GEO_SIMD=scalar|avx2 caps the distance prefilter kernel (geo_kernels.h).
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include "geo_index.h"
+
+using microservice::geo::GeoIndex;
+using microservice::geo::Location;
+using microservice::geo::Neighbor;
+
+namespace {
+
+constexpr double kRadiusKm = 10.0;
+constexpr size_t kResults = 5;
+constexpr size_t kVerifyQueries = 1000;
+constexpr size_t kScanBudget = 50000000; // point visits the scan may spend per size
+
+struct Query {
+    double lat;
+    double lon;
+};
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// The service's sample data: 6 fixed hotels and 74 along a diagonal.
+std::vector<Location> sample_hotels() {
+    std::vector<Location> hotels = {
+        {"1", 37.7867, -122.4112}, {"2", 37.7854, -122.4005}, {"3", 37.7854, -122.4071},
+        {"4", 37.7936, -122.3930}, {"5", 37.7831, -122.4181}, {"6", 37.7863, -122.4015},
+    };
+    for (int i = 7; i <= 80; i++) {
+        hotels.push_back({std::to_string(i), 37.7835 + static_cast<double>(i) / 500.0 * 3,
+                          -122.41 + static_cast<double>(i) / 500.0 * 4});
+    }
+    return hotels;
+}
+
+std::vector<Location> catalog(size_t n, std::mt19937_64& rng) {
+    std::uniform_real_distribution<double> lat(25, 50);
+    std::uniform_real_distribution<double> lon(-125, -65);
+    std::vector<Location> points;
+    points.reserve(n);
+    for (size_t i = 0; i < n; ++i) points.push_back({std::to_string(i + 1), lat(rng), lon(rng)});
+    return points;
+}
+
+std::vector<Query> queries_near(const std::vector<Location>& points, size_t n, std::mt19937_64& rng) {
+    // the sample hotels sit around San Francisco; the catalog covers the box
+    const bool sample = points.size() <= 80;
+    std::uniform_real_distribution<double> lat(sample ? 37.70 : 25, sample ? 37.95 : 50);
+    std::uniform_real_distribution<double> lon(sample ? -122.50 : -125, sample ? -122.30 : -65);
+    std::vector<Query> queries(n);
+    for (Query& q : queries) q = {lat(rng), lon(rng)};
+    return queries;
+}
+
+// The service's nearest-hotels search before the indexes, ties by id.
+void reference_nearest(const std::vector<Location>& points, const Query& q, std::vector<Neighbor>& out) {
+    out.clear();
+    for (size_t i = 0; i < points.size(); ++i) {
+        double d = microservice::geo::haversine_km(q.lat, q.lon, points[i].lat, points[i].lon);
+        if (d <= kRadiusKm) out.push_back({d, static_cast<uint32_t>(i), &points[i].id});
+    }
+    std::sort(out.begin(), out.end(), [](const Neighbor& a, const Neighbor& b) {
+        if (a.distance_km != b.distance_km) return a.distance_km < b.distance_km;
+        return *a.id < *b.id;
+    });
+    if (out.size() > kResults) out.resize(kResults);
+}
+
+bool same(const std::vector<Neighbor>& a, const std::vector<Neighbor>& b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a[i].index != b[i].index || a[i].distance_km != b[i].distance_km) return false;
+    }
+    return true;
+}
+
+void run(const std::vector<Location>& points, size_t num_queries, std::mt19937_64& rng) {
+    const std::vector<Query> queries = queries_near(points, num_queries, rng);
+    const char* kinds[] = {"scan", "grid", "kdtree"};
+    std::vector<Neighbor> out;
+    std::vector<Neighbor> expected;
+    const size_t scan_queries = std::max<size_t>(1, std::min(queries.size(), kScanBudget / points.size()));
+    for (const char* kind : kinds) {
+        auto start = std::chrono::steady_clock::now();
+        std::unique_ptr<GeoIndex> index = microservice::geo::make_geo_index(kind, points);
+        const double build_s = seconds_since(start);
+
+        const size_t timed = std::string(kind) == "scan" ? scan_queries : queries.size();
+        size_t hits = 0;
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < timed; ++i) {
+            index->nearest(queries[i].lat, queries[i].lon, kRadiusKm, kResults, out);
+            hits += out.size();
+        }
+        const double query_s = seconds_since(start);
+
+        size_t mismatches = 0;
+        const size_t verify = std::min(kVerifyQueries, scan_queries);
+        for (size_t i = 0; i < verify; ++i) {
+            index->nearest(queries[i].lat, queries[i].lon, kRadiusKm, kResults, out);
+            reference_nearest(points, queries[i], expected);
+            if (!same(out, expected)) ++mismatches;
+        }
+        printf("%10zu  %-7s  build %9.3f ms  query %10.1f ns  avg hits %4.2f  queries %7zu  mismatches %zu\n",
+               points.size(), index->name(), build_s * 1e3, query_s * 1e9 / timed,
+               static_cast<double>(hits) / timed, timed, mismatches);
+
+        // the same queries as one batch in Z-order, as GeoService answers them
+        if (timed < queries.size()) continue;
+        start = std::chrono::steady_clock::now();
+        std::vector<uint32_t> order;
+        microservice::geo::spatial_order(queries.size(), [&queries](size_t i, double& lat, double& lon) {
+            lat = queries[i].lat;
+            lon = queries[i].lon;
+        }, order);
+        for (uint32_t i : order) index->nearest(queries[i].lat, queries[i].lon, kRadiusKm, kResults, out);
+        printf("%10zu  %-7s  z-order batch  query %10.1f ns (sort included)\n", points.size(), index->name(),
+               seconds_since(start) * 1e9 / queries.size());
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const size_t max_points = argc > 1 ? strtoull(argv[1], nullptr, 10) : 10000000;
+    const size_t num_queries = argc > 2 ? strtoull(argv[2], nullptr, 10) : 100000;
+    std::mt19937_64 rng(42);
+    printf("distance prefilter: %s\n", microservice::geo::dot_filter_name());
+    run(sample_hotels(), num_queries, rng);
+    for (size_t n = 1000; n <= max_points; n *= 10) run(catalog(n, rng), num_queries, rng);
+    return 0;
+}
@@ -0,0 +1,356 @@
+// Reads the binary timing logs (timing_log.h) written by the services and
+// prints, in a single pass over the records:
+//   - per-type latency percentiles,
+//   - the request and service breakdowns that breakdown.py used to produce
+//     (same text layout, so make_breakdown_stacked_plot.py still reads it),
+//   - with --compare, the protobuf vs ser1de table of compare_timestamps.py.
+//
+// Request breakdowns follow the trace id of each sampled request, so the
+// serialization sum of a /search request is the time actually spent on that
+// request's messages in every service, not a sum of per-type averages.
+//
+// Usage: latency_report [--percentiles] [--breakdown] [--service-breakdown]
+//                       [--compare <ser1de_logs_dir>] [logs_dir]
+// With no section flags all sections are printed. logs_dir defaults to
+// ../logs; with --compare it holds the protobuf run.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fstream>
+#include <map>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+#include "timing_log.h"
+
+using microservice::timing::FileHeader;
+using microservice::timing::Record;
+namespace timing = microservice::timing;
+
+namespace {
+
+struct Sum {
+    double total = 0;
+    uint64_t count = 0;
+    void add(double v) { total += v; ++count; }
+    double mean() const { return count ? total / count : 0; }
+};
+
+struct TraceSums {
+    double ser = 0;
+    double de = 0;
+};
+
+struct FrontendRequest {
+    uint64_t request_id;
+    uint32_t type_id;
+    uint64_t duration_ns;
+};
+
+// Everything the report needs, filled by one pass over all records.
+struct Dataset {
+    std::unordered_map<uint32_t, std::string> names;
+    // (phase << 32 | type id) -> durations
+    std::map<uint64_t, std::vector<uint64_t>> durations;
+    // source -> (phase << 32 | type id) -> mean of Se/De records
+    std::map<std::string, std::map<uint64_t, Sum>> by_source;
+    // source -> service request durations
+    std::map<std::string, Sum> service_requests;
+    std::unordered_map<uint64_t, TraceSums> traces;
+    std::vector<FrontendRequest> frontend_requests;
+    uint64_t records = 0;
+    int files = 0;
+
+    std::string name_of(uint32_t id) const {
+        auto it = names.find(id);
+        if (it != names.end()) return it->second;
+        char buf[16];
+        snprintf(buf, sizeof(buf), "%08x", id);
+        return buf;
+    }
+};
+
+uint64_t key(uint16_t phase, uint32_t type_id) {
+    return (static_cast<uint64_t>(phase) << 32) | type_id;
+}
+
+bool ends_with(const std::string& s, const std::string& suffix) {
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+void read_types(const std::string& path, Dataset& data) {
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t space = line.find(' ');
+        if (space == std::string::npos) continue;
+        uint32_t id = static_cast<uint32_t>(strtoul(line.substr(0, space).c_str(), nullptr, 16));
+        data.names[id] = line.substr(space + 1);
+    }
+}
+
+void add_record(const Record& r, const std::string& source, Dataset& data) {
+    data.durations[key(r.phase, r.type_id)].push_back(r.duration_ns);
+    switch (r.phase) {
+        case timing::kSerialize:
+        case timing::kDeserialize:
+            data.by_source[source][key(r.phase, r.type_id)].add(static_cast<double>(r.duration_ns));
+            if (r.request_id) {
+                TraceSums& t = data.traces[r.request_id];
+                (r.phase == timing::kSerialize ? t.ser : t.de) += static_cast<double>(r.duration_ns);
+            }
+            break;
+        case timing::kServiceRequest:
+            data.service_requests[source].add(static_cast<double>(r.duration_ns));
+            break;
+        case timing::kFrontendRequest:
+            data.frontend_requests.push_back(FrontendRequest{r.request_id, r.type_id, r.duration_ns});
+            break;
+    }
+}
+
+bool read_log(const std::string& path, Dataset& data) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        perror(path.c_str());
+        return false;
+    }
+    struct stat st = {};
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(FileHeader)) {
+        close(fd);
+        return false;
+    }
+    void* mem = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED) {
+        perror(path.c_str());
+        return false;
+    }
+    const FileHeader* header = static_cast<const FileHeader*>(mem);
+    if (memcmp(header->magic, timing::kMagic, sizeof(header->magic)) != 0 ||
+        header->version != timing::kVersion || header->record_size != sizeof(Record)) {
+        fprintf(stderr, "%s: not a version %u timing log\n", path.c_str(), timing::kVersion);
+        munmap(mem, st.st_size);
+        return false;
+    }
+    uint64_t capacity = (st.st_size - sizeof(FileHeader)) / sizeof(Record);
+    uint64_t count = std::min<uint64_t>(header->record_count, capacity);
+    std::string source(header->source, strnlen(header->source, sizeof(header->source)));
+    if (source.empty()) source = "unknown";
+    madvise(mem, st.st_size, MADV_SEQUENTIAL);
+    const Record* records = reinterpret_cast<const Record*>(header + 1);
+    for (uint64_t i = 0; i < count; ++i) {
+        add_record(records[i], source, data);
+    }
+    data.records += count;
+    data.files++;
+    munmap(mem, st.st_size);
+    return true;
+}
+
+bool load(const std::string& dir, Dataset& data) {
+    DIR* d = opendir(dir.c_str());
+    if (!d) {
+        perror(dir.c_str());
+        return false;
+    }
+    std::vector<std::string> logs;
+    while (dirent* e = readdir(d)) {
+        std::string name = e->d_name;
+        if (name.compare(0, 7, "timing_") != 0) continue;
+        if (ends_with(name, ".types")) read_types(dir + "/" + name, data);
+        if (ends_with(name, ".bin")) logs.push_back(dir + "/" + name);
+    }
+    closedir(d);
+    std::sort(logs.begin(), logs.end());
+    for (const auto& path : logs) {
+        read_log(path, data);
+    }
+    if (!data.files) {
+        fprintf(stderr, "%s: no timing_*.bin files\n", dir.c_str());
+        return false;
+    }
+    return true;
+}
+
+uint64_t percentile(const std::vector<uint64_t>& sorted, double p) {
+    size_t i = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(i, sorted.size() - 1)];
+}
+
+void print_percentiles(Dataset& data) {
+    printf("Per-type latency (ns), %llu records from %d processes:\n\n",
+           (unsigned long long)data.records, data.files);
+    printf("%-44s %-8s %10s %10s %10s %10s %10s %10s %10s\n",
+           "Type", "Phase", "Count", "Mean", "p50", "p90", "p99", "p99.9", "Max");
+    for (auto& entry : data.durations) {
+        std::vector<uint64_t>& v = entry.second;
+        std::sort(v.begin(), v.end());
+        double total = 0;
+        for (uint64_t d : v) total += static_cast<double>(d);
+        printf("%-44s %-8s %10zu %10.0f %10llu %10llu %10llu %10llu %10llu\n",
+               data.name_of(static_cast<uint32_t>(entry.first)).c_str(),
+               timing::phase_name(static_cast<uint16_t>(entry.first >> 32)),
+               v.size(), total / v.size(),
+               (unsigned long long)percentile(v, 0.50), (unsigned long long)percentile(v, 0.90),
+               (unsigned long long)percentile(v, 0.99), (unsigned long long)percentile(v, 0.999),
+               (unsigned long long)v.back());
+    }
+    printf("\n");
+}
+
+std::string upper(std::string s) {
+    for (char& c : s) c = static_cast<char>(toupper(static_cast<unsigned char>(c)));
+    return s;
+}
+
+// Known names first, in the order the plots use, then anything else.
+std::vector<std::string> ordered(const std::vector<std::string>& known, std::vector<std::string> present) {
+    std::sort(present.begin(), present.end());
+    std::vector<std::string> out;
+    for (const auto& k : known) {
+        if (std::find(present.begin(), present.end(), k) != present.end()) out.push_back(k);
+    }
+    for (const auto& p : present) {
+        if (std::find(out.begin(), out.end(), p) == out.end()) out.push_back(p);
+    }
+    return out;
+}
+
+void print_triple(const char* label, double avg, double ser, double de) {
+    printf("  %s avg: %.2f ns (%.2f ms)\n", label, avg, avg / 1000000);
+    printf("  Serialization sum: %.2f ns (%.2f ms)\n", ser, ser / 1000000);
+    printf("  Deserialization sum: %.2f ns (%.2f ms)\n", de, de / 1000000);
+}
+
+void print_request_breakdown(const Dataset& data) {
+    struct Acc { Sum request, ser, de; };
+    std::map<std::string, Acc> endpoints;
+    for (const auto& r : data.frontend_requests) {
+        Acc& acc = endpoints[data.name_of(r.type_id)];
+        acc.request.add(static_cast<double>(r.duration_ns));
+        auto it = data.traces.find(r.request_id);
+        acc.ser.add(it == data.traces.end() ? 0 : it->second.ser);
+        acc.de.add(it == data.traces.end() ? 0 : it->second.de);
+    }
+    std::vector<std::string> names;
+    for (const auto& e : endpoints) names.push_back(e.first);
+    printf("Request breakdown analysis:\n");
+    for (const auto& name : ordered({"search", "recommend", "user", "reservation"}, names)) {
+        const Acc& acc = endpoints[name];
+        printf("\n%s request:\n", upper(name).c_str());
+        print_triple("Request", acc.request.mean(), acc.ser.mean(), acc.de.mean());
+    }
+    printf("\n");
+}
+
+void print_service_breakdown(const Dataset& data) {
+    std::vector<std::string> names;
+    for (const auto& s : data.service_requests) names.push_back(s.first);
+    printf("Service breakdown analysis:\n");
+    for (const auto& name : ordered({"search", "recommendation", "user", "reservation",
+                                     "profile", "rate", "geo"}, names)) {
+        double ser = 0, de = 0;
+        auto it = data.by_source.find(name);
+        if (it != data.by_source.end()) {
+            for (const auto& t : it->second) {
+                (t.first >> 32 == timing::kSerialize ? ser : de) += t.second.mean();
+            }
+        }
+        printf("\n%s service:\n", upper(name).c_str());
+        print_triple("Service", data.service_requests.at(name).mean(), ser, de);
+    }
+    printf("\n");
+}
+
+std::map<std::string, double> type_means(const Dataset& data, uint16_t phase) {
+    std::map<std::string, double> means;
+    for (const auto& entry : data.durations) {
+        if (entry.first >> 32 != phase) continue;
+        double total = 0;
+        for (uint64_t d : entry.second) total += static_cast<double>(d);
+        means[data.name_of(static_cast<uint32_t>(entry.first))] = total / entry.second.size();
+    }
+    return means;
+}
+
+void print_comparison(const Dataset& proto, const Dataset& ser1de) {
+    const uint16_t phases[] = {timing::kSerialize, timing::kDeserialize};
+    for (uint16_t phase : phases) {
+        printf("%s:\n", phase == timing::kSerialize ? "Serialization" : "Deserialization");
+        std::map<std::string, double> p = type_means(proto, phase);
+        std::map<std::string, double> s = type_means(ser1de, phase);
+        printf("%-44s %12s %12s %10s\n", "Type", "Proto(ns)", "Ser1de(ns)", "Speedup");
+        printf("%s\n", std::string(80, '-').c_str());
+        std::map<std::string, int> all;
+        for (const auto& e : p) all[e.first] = 0;
+        for (const auto& e : s) all[e.first] = 0;
+        for (const auto& e : all) {
+            auto pi = p.find(e.first);
+            auto si = s.find(e.first);
+            if (pi != p.end() && si != s.end()) {
+                printf("%-44s %12.2f %12.2f %10.2f\n", e.first.c_str(), pi->second, si->second,
+                       si->second / pi->second);
+            } else {
+                printf("%-44s %12s %12s %10s\n", e.first.c_str(),
+                       pi != p.end() ? std::to_string(pi->second).c_str() : "None",
+                       si != s.end() ? std::to_string(si->second).c_str() : "None", "N/A");
+            }
+        }
+        printf("\n");
+    }
+}
+
+void usage(const char* argv0) {
+    fprintf(stderr,
+            "usage: %s [--percentiles] [--breakdown] [--service-breakdown]\n"
+            "          [--compare <ser1de_logs_dir>] [logs_dir]\n", argv0);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    bool percentiles = false, breakdown = false, service_breakdown = false;
+    std::string compare_dir;
+    std::string logs_dir = "../logs";
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--percentiles") {
+            percentiles = true;
+        } else if (arg == "--breakdown") {
+            breakdown = true;
+        } else if (arg == "--service-breakdown") {
+            service_breakdown = true;
+        } else if (arg == "--compare" && i + 1 < argc) {
+            compare_dir = argv[++i];
+        } else if (arg[0] == '-') {
+            usage(argv[0]);
+            return 1;
+        } else {
+            logs_dir = arg;
+        }
+    }
+    if (!percentiles && !breakdown && !service_breakdown && compare_dir.empty()) {
+        percentiles = breakdown = service_breakdown = true;
+    }
+
+    Dataset data;
+    if (!load(logs_dir, data)) return 1;
+
+    if (!compare_dir.empty()) {
+        Dataset ser1de;
+        if (!load(compare_dir, ser1de)) return 1;
+        print_comparison(data, ser1de);
+    }
+    if (breakdown) print_request_breakdown(data);
+    if (service_breakdown) print_service_breakdown(data);
+    if (percentiles) print_percentiles(data);
+    return 0;
+}
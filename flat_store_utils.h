@@ -0,0 +1,208 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "sealed_utils.h"
+
+namespace microservice {
+namespace utils {
+
+// Immutable, pointer-free stores for read-mostly catalogs (rates,
+// profiles): built once, typically in the master before fork, then sealed
+// read-only (SealedArray) and shared by every worker. Records are
+// fixed-size structs in one contiguous array; their text lives in one
+// arena and is referenced by offset; ids map to dense record indexes
+// through an open-addressed table of 8-byte slots.
+
+// A string in a StringArena.
+struct TextRef {
+    uint32_t offset;
+    uint32_t size;
+};
+
+// Append-only character buffer, sealed by finish().
+class StringArena {
+public:
+    TextRef add(const char* s, size_t size) {
+        TextRef ref{static_cast<uint32_t>(building_.size()), static_cast<uint32_t>(size)};
+        building_.insert(building_.end(), s, s + size);
+        base_ = building_.data();
+        return ref;
+    }
+    TextRef add(const std::string& s) { return add(s.data(), s.size()); }
+
+    // Like add(), but an earlier copy of s is reused, for the text many
+    // records share (cities, boilerplate descriptions).
+    TextRef intern(const std::string& s) {
+        auto it = interned_.find(s);
+        if (it != interned_.end()) return it->second;
+        TextRef ref = add(s);
+        interned_.emplace(s, ref);
+        return ref;
+    }
+
+    // Drops the build-time state and seals the text; the arena is
+    // read-only afterwards.
+    void finish() {
+        std::unordered_map<std::string, TextRef>().swap(interned_);
+        bytes_ = SealedArray<char>(building_);
+        bytes_.seal();
+        std::vector<char>().swap(building_);
+        base_ = bytes_.data();
+    }
+
+    const char* data(TextRef ref) const { return base_ + ref.offset; }
+    std::string str(TextRef ref) const { return std::string(data(ref), ref.size); }
+    bool equals(TextRef ref, const char* s, size_t size) const {
+        return ref.size == size && memcmp(data(ref), s, size) == 0;
+    }
+    size_t bytes() const { return building_.capacity() + bytes_.bytes(); }
+
+private:
+    std::vector<char> building_;
+    SealedArray<char> bytes_;
+    const char* base_ = nullptr;
+    std::unordered_map<std::string, TextRef> interned_;
+};
+
+// Hash of the id tables: FNV-1a, then mixed so the low bits (slot) and
+// the high bits (tag) are both usable. Id tables written to files use it
+// too (profile catalogs), so changing it changes their format.
+inline uint64_t flat_hash(const char* s, size_t size) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < size; ++i) h = (h ^ static_cast<unsigned char>(s[i])) * 0x100000001b3ull;
+    h ^= h >> 31;
+    h *= 0xbf58476d1ce4e5b9ull;
+    return h ^ (h >> 29);
+}
+
+// Immutable map from string ids to their positions 0..n-1 in the list it
+// was built from. Linear probing at load factor <= 1/2 over slots holding
+// the upper hash bits, so a miss rarely touches the ids themselves.
+class FlatIndex {
+public:
+    FlatIndex() : mask_(0) {}
+
+    // Ids must be unique.
+    explicit FlatIndex(const std::vector<std::string>& ids) {
+        size_t capacity = 16;
+        while (capacity < ids.size() * 2) capacity <<= 1;
+        std::vector<Slot> slots(capacity, Slot{0, kEmpty});
+        std::vector<TextRef> id_refs;
+        mask_ = capacity - 1;
+        id_refs.reserve(ids.size());
+        for (uint32_t i = 0; i < ids.size(); ++i) {
+            id_refs.push_back(ids_.add(ids[i]));
+            const uint64_t h = hash(ids[i].data(), ids[i].size());
+            size_t s = h & mask_;
+            while (slots[s].index != kEmpty) s = (s + 1) & mask_;
+            slots[s] = Slot{static_cast<uint32_t>(h >> 32), i};
+        }
+        slots_ = SealedArray<Slot>(slots);
+        slots_.seal();
+        id_refs_ = SealedArray<TextRef>(id_refs);
+        id_refs_.seal();
+        ids_.finish();
+    }
+
+    // Position of id, or -1.
+    int64_t find(const char* id, size_t size) const {
+        if (slots_.size() == 0) return -1;
+        const uint64_t h = hash(id, size);
+        const uint32_t tag = static_cast<uint32_t>(h >> 32);
+        for (size_t s = h & mask_;; s = (s + 1) & mask_) {
+            const Slot& slot = slots_[s];
+            if (slot.index == kEmpty) return -1;
+            if (slot.tag == tag && ids_.equals(id_refs_[slot.index], id, size)) return slot.index;
+        }
+    }
+    int64_t find(const std::string& id) const { return find(id.data(), id.size()); }
+
+    size_t size() const { return id_refs_.size(); }
+    const char* id_data(size_t i) const { return ids_.data(id_refs_[i]); }
+    size_t id_size(size_t i) const { return id_refs_[i].size; }
+    size_t bytes() const {
+        return slots_.bytes() + id_refs_.bytes() + ids_.bytes();
+    }
+
+private:
+    struct Slot {
+        uint32_t tag;   // upper half of the id's hash
+        uint32_t index; // kEmpty if the slot is free
+    };
+    static constexpr uint32_t kEmpty = 0xffffffffu;
+
+    SealedArray<Slot> slots_;
+    size_t mask_;
+    SealedArray<TextRef> id_refs_;
+    StringArena ids_;
+
+    static uint64_t hash(const char* s, size_t size) { return flat_hash(s, size); }
+};
+
+// Records of type Record keyed by string id. Record is a trivially
+// copyable struct whose strings are TextRefs into text().
+template <typename Record>
+class FlatStore {
+    static_assert(std::is_trivially_copyable<Record>::value, "FlatStore records must be trivially copyable");
+
+public:
+    class Builder {
+    public:
+        // The record for id, zeroed on first use; adding an id again
+        // returns its record, so the last write wins.
+        Record& add(const std::string& id) {
+            auto it = positions_.find(id);
+            if (it != positions_.end()) return records_[it->second];
+            positions_.emplace(id, records_.size());
+            ids_.push_back(id);
+            records_.emplace_back();
+            memset(&records_.back(), 0, sizeof(Record));
+            return records_.back();
+        }
+
+        TextRef text(const std::string& s) { return text_.intern(s); }
+
+        FlatStore build() {
+            FlatStore store;
+            store.index_ = FlatIndex(ids_);
+            store.records_ = SealedArray<Record>(records_);
+            store.records_.seal();
+            store.text_ = std::move(text_);
+            store.text_.finish();
+            *this = Builder();
+            return store;
+        }
+
+    private:
+        std::unordered_map<std::string, size_t> positions_;
+        std::vector<std::string> ids_;
+        std::vector<Record> records_;
+        StringArena text_;
+    };
+
+    // The record for id, or nullptr.
+    const Record* find(const std::string& id) const {
+        int64_t i = index_.find(id);
+        return i < 0 ? nullptr : &records_[i];
+    }
+
+    size_t size() const { return records_.size(); }
+    const Record& at(size_t i) const { return records_[i]; }
+    const StringArena& text() const { return text_; }
+    const FlatIndex& index() const { return index_; }
+    size_t bytes() const { return index_.bytes() + records_.bytes() + text_.bytes(); }
+
+private:
+    FlatIndex index_;
+    SealedArray<Record> records_;
+    StringArena text_;
+};
+
+} // namespace utils
+} // namespace microservice
@@ -0,0 +1,287 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include <new>
+#include <string>
+#include <sys/mman.h>
+#include <utility>
+#include "trace_utils.h"
+
+namespace microservice {
+namespace frontend {
+
+// Deadlines and adaptive concurrency limits for the frontend routes.
+//
+// A request's deadline is its arrival time (accept or read time, not handler
+// start) plus its route's budget. The handler puts it in the trace context,
+// so every downstream call carries it (rpc_utils.h, kFlagDeadline) and every
+// service sheds the request once it has passed instead of doing work nobody
+// waits for. admit() decides before any work is done:
+//
+//   past the deadline already (queued too long)            -> kExpired    (408)
+//   time queued + recent service latency exceeds budget     -> kOverloaded (503)
+//   in-flight requests of the route at its limit            -> kOverloaded (503)
+//
+// The limit adapts by AIMD on the outcome of admitted requests: it grows by
+// one after `limit` requests finished within their deadline and shrinks by
+// 10% when one finishes late, at most once per budget interval so a single
+// slow burst counts once. Requests that fail on time (bad input, a refused
+// connection) move neither way. The latency used for the projection halves
+// for every budget interval without a release, so a route that has been
+// rejecting everything gets probed again.
+//
+//   REQUEST_DEADLINE_MS=search=10,recommend=100,...  per-route budget
+//   ADMISSION_CONTROL=0                              deadlines only, no limits
+//
+// Route state lives in an anonymous MAP_SHARED mapping, so an
+// AdmissionControl must be constructed before fork(): the limit covers all
+// workers together, like the downstream capacity it protects. In-flight
+// requests are also counted per worker (set_worker()), so that the master
+// can take back those of a worker that died before releasing them
+// (reclaim_worker()).
+class AdmissionControl {
+public:
+    static constexpr int kMaxRoutes = 8;
+    static constexpr int kMaxNameLen = 32;
+    static constexpr uint32_t kInitialLimit = 256;
+    static constexpr uint32_t kMinLimit = 4;
+    static constexpr uint32_t kMaxLimit = 4096;
+    static constexpr int kMaxWorkers = 256;
+
+    enum class Decision { kAdmitted, kExpired, kOverloaded };
+
+    struct alignas(64) Route {
+        char name[kMaxNameLen];
+        uint64_t budget_ns;
+        std::atomic<uint32_t> enabled;  // limits and projection; deadlines always apply
+        std::atomic<uint32_t> limit;
+        std::atomic<uint32_t> inflight;  // over all workers, the sum of worker_inflight
+        std::atomic<uint32_t> on_time;  // on-time completions toward the next increase
+        std::atomic<uint64_t> latency_ewma_ns;
+        std::atomic<uint64_t> last_decrease_ns;
+        std::atomic<uint64_t> last_release_ns;
+        std::atomic<uint64_t> admitted;
+        std::atomic<uint64_t> expired;            // arrived past the deadline
+        std::atomic<uint64_t> rejected_limit;     // at the concurrency limit
+        std::atomic<uint64_t> rejected_projected; // projected to miss the deadline
+        std::atomic<uint64_t> deadline_exceeded;  // admitted, finished late
+        std::atomic<uint64_t> failed;             // admitted, failed on time
+        std::atomic<uint64_t> goodput;            // admitted, answered on time
+        std::atomic<uint32_t> worker_inflight[kMaxWorkers];
+    };
+
+    // An admitted request; hand it back to release() when it is answered.
+    struct Ticket {
+        Route* route = nullptr;
+        uint64_t start_ns = 0;
+        uint64_t deadline_ns = 0;
+        int worker = -1;
+    };
+
+    // Routes and their default budgets in milliseconds.
+    AdmissionControl(std::initializer_list<std::pair<const char*, uint64_t>> routes) {
+        void* mem = mmap(nullptr, sizeof(Control), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED) {
+            perror("admission control mmap");
+            return; // every request is admitted without a deadline
+        }
+        control_ = new (mem) Control();
+        const char* budget_env = getenv("REQUEST_DEADLINE_MS");
+        const char* enabled_env = getenv("ADMISSION_CONTROL");
+        const bool enabled = !enabled_env || strcmp(enabled_env, "0") != 0;
+        for (const auto& route : routes) {
+            if (control_->num_routes == static_cast<uint32_t>(kMaxRoutes)) break;
+            Route& r = control_->routes[control_->num_routes++];
+            strncpy(r.name, route.first, kMaxNameLen - 1);
+            uint64_t budget_ms = route.second;
+            if (budget_env) budget_ms = configured_budget(budget_env, route.first, budget_ms);
+            r.budget_ns = budget_ms * 1000000ull;
+            r.enabled.store(enabled);
+            r.limit.store(kInitialLimit);
+        }
+    }
+
+    AdmissionControl(const AdmissionControl&) = delete;
+    AdmissionControl& operator=(const AdmissionControl&) = delete;
+
+    // nullptr if the route is unknown or has no budget
+    Route* route(const char* name) {
+        if (!control_) return nullptr;
+        for (uint32_t i = 0; i < control_->num_routes; ++i) {
+            Route& r = control_->routes[i];
+            if (strcmp(r.name, name) == 0) return r.budget_ns ? &r : nullptr;
+        }
+        return nullptr;
+    }
+
+    uint32_t num_routes() const { return control_ ? control_->num_routes.load() : 0; }
+    Route& route_at(uint32_t i) { return control_->routes[i]; }
+
+    // Called in a worker after fork(): its index in [0, kMaxWorkers), which
+    // a replacement worker takes over. Without one, a dead worker's
+    // in-flight requests cannot be reclaimed.
+    static void set_worker(int index) { worker() = index < kMaxWorkers ? index : -1; }
+
+    // Called in the master once the worker with this index has died: its
+    // admitted requests will never be released, so they stop counting.
+    void reclaim_worker(int index) {
+        if (!control_ || index < 0 || index >= kMaxWorkers) return;
+        for (uint32_t i = 0; i < control_->num_routes; ++i) {
+            Route& r = control_->routes[i];
+            const uint32_t lost = r.worker_inflight[index].exchange(0, std::memory_order_relaxed);
+            if (lost) r.inflight.fetch_sub(lost, std::memory_order_relaxed);
+        }
+    }
+
+    // arrival_ns is on the utils::monotonic_ns() clock. A request admitted
+    // on a null route gets an empty ticket (no deadline) and needs no release.
+    static Decision admit(Route* route, uint64_t arrival_ns, Ticket& ticket) {
+        ticket = Ticket();
+        if (!route) return Decision::kAdmitted;
+        const uint64_t now = utils::monotonic_ns();
+        const uint64_t deadline = arrival_ns + route->budget_ns;
+        if (now >= deadline) {
+            route->expired.fetch_add(1, std::memory_order_relaxed);
+            return Decision::kExpired;
+        }
+        if (route->enabled.load(std::memory_order_relaxed)) {
+            // With nothing in flight there is no fresh latency to go by, so
+            // the request is let through as a probe.
+            const uint64_t waited = now > arrival_ns ? now - arrival_ns : 0;
+            if (route->inflight.load(std::memory_order_relaxed) > 0 &&
+                waited + projected_latency(route, now) > route->budget_ns) {
+                route->rejected_projected.fetch_add(1, std::memory_order_relaxed);
+                return Decision::kOverloaded;
+            }
+            if (route->inflight.fetch_add(1, std::memory_order_relaxed) >=
+                route->limit.load(std::memory_order_relaxed)) {
+                route->inflight.fetch_sub(1, std::memory_order_relaxed);
+                route->rejected_limit.fetch_add(1, std::memory_order_relaxed);
+                return Decision::kOverloaded;
+            }
+        } else {
+            route->inflight.fetch_add(1, std::memory_order_relaxed);
+        }
+        route->admitted.fetch_add(1, std::memory_order_relaxed);
+        ticket.route = route;
+        ticket.start_ns = now;
+        ticket.deadline_ns = deadline;
+        ticket.worker = worker();
+        if (ticket.worker >= 0) route->worker_inflight[ticket.worker].fetch_add(1, std::memory_order_relaxed);
+        return Decision::kAdmitted;
+    }
+
+    // ok: the request was answered with a valid response.
+    static void release(const Ticket& ticket, bool ok) {
+        Route* route = ticket.route;
+        if (!route) return;
+        const uint64_t now = utils::monotonic_ns();
+        if (ticket.worker >= 0) route->worker_inflight[ticket.worker].fetch_sub(1, std::memory_order_relaxed);
+        route->inflight.fetch_sub(1, std::memory_order_relaxed);
+        route->last_release_ns.store(now, std::memory_order_relaxed);
+
+        // EWMA of service time (admission to answer), alpha = 1/8; racy
+        // updates from concurrent releases only lose a sample.
+        const int64_t latency = static_cast<int64_t>(now - ticket.start_ns);
+        const int64_t ewma = static_cast<int64_t>(route->latency_ewma_ns.load(std::memory_order_relaxed));
+        route->latency_ewma_ns.store(static_cast<uint64_t>(ewma ? ewma + (latency - ewma) / 8 : latency),
+                                     std::memory_order_relaxed);
+
+        if (now > ticket.deadline_ns) {
+            route->deadline_exceeded.fetch_add(1, std::memory_order_relaxed);
+            decrease(route, now);
+            return;
+        }
+        if (!ok) {
+            route->failed.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        route->goodput.fetch_add(1, std::memory_order_relaxed);
+        uint32_t limit = route->limit.load(std::memory_order_relaxed);
+        if (route->on_time.fetch_add(1, std::memory_order_relaxed) + 1 >= limit) {
+            route->on_time.store(0, std::memory_order_relaxed);
+            if (limit < kMaxLimit) route->limit.compare_exchange_strong(limit, limit + 1, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    struct Control {
+        std::atomic<uint32_t> num_routes;
+        Route routes[kMaxRoutes];
+    };
+
+    Control* control_ = nullptr;
+
+    // this process's worker index, -1 if unset
+    static int& worker() {
+        static int index = -1;
+        return index;
+    }
+
+    // The latency EWMA, halved for every budget interval since the last
+    // release: it only moves on releases, and a route whose requests are
+    // all rejected has none.
+    static uint64_t projected_latency(const Route* route, uint64_t now) {
+        const uint64_t ewma = route->latency_ewma_ns.load(std::memory_order_relaxed);
+        const uint64_t last = route->last_release_ns.load(std::memory_order_relaxed);
+        if (now <= last) return ewma;
+        const uint64_t idle = (now - last) / route->budget_ns;
+        return idle >= 64 ? 0 : ewma >> idle;
+    }
+
+    static void decrease(Route* route, uint64_t now) {
+        uint64_t last = route->last_decrease_ns.load(std::memory_order_relaxed);
+        if (now - last < route->budget_ns) return;
+        if (!route->last_decrease_ns.compare_exchange_strong(last, now, std::memory_order_relaxed)) return;
+        uint32_t limit = route->limit.load(std::memory_order_relaxed);
+        route->limit.store(std::max(kMinLimit, limit - limit / 10), std::memory_order_relaxed);
+        route->on_time.store(0, std::memory_order_relaxed);
+    }
+
+    static uint64_t configured_budget(const char* list, const char* name, uint64_t fallback) {
+        size_t len = strlen(name);
+        for (const char* p = list; *p;) {
+            const char* end = strchr(p, ',');
+            const char* eq = static_cast<const char*>(memchr(p, '=', end ? end - p : strlen(p)));
+            if (eq && static_cast<size_t>(eq - p) == len && strncmp(p, name, len) == 0) {
+                return strtoull(eq + 1, nullptr, 10);
+            }
+            if (!end) break;
+            p = end + 1;
+        }
+        return fallback;
+    }
+};
+
+// Admission of one httplib request: admits on construction, puts the
+// deadline into the current trace context, and releases on destruction.
+class ScopedAdmission {
+public:
+    ScopedAdmission(AdmissionControl::Route* route, uint64_t arrival_ns)
+        : decision_(AdmissionControl::admit(route, arrival_ns, ticket_)) {
+        utils::current_trace().deadline_ns = ticket_.deadline_ns;
+    }
+
+    ~ScopedAdmission() { AdmissionControl::release(ticket_, ok); }
+
+    ScopedAdmission(const ScopedAdmission&) = delete;
+    ScopedAdmission& operator=(const ScopedAdmission&) = delete;
+
+    AdmissionControl::Decision decision() const { return decision_; }
+    bool deadline_passed() const { return ticket_.deadline_ns && utils::monotonic_ns() >= ticket_.deadline_ns; }
+
+    bool ok = false; // set once the request was answered with a valid response
+
+private:
+    AdmissionControl::Ticket ticket_;
+    AdmissionControl::Decision decision_;
+};
+
+} // namespace frontend
+} // namespace microservice
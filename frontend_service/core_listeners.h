@@ -0,0 +1,152 @@
+#pragma once
+
+#include <arpa/inet.h>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <linux/filter.h>
+#include <netinet/in.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+namespace microservice {
+namespace frontend {
+
+// CPU list in taskset/cpuset syntax, e.g. "0-3,8,10-11"; malformed parts
+// are skipped.
+inline std::vector<int> parse_cpu_list(const char* list) {
+    std::vector<int> cpus;
+    for (const char* p = list; *p;) {
+        char* end;
+        long first = strtol(p, &end, 10);
+        long last = first;
+        if (end != p && *end == '-') {
+            const char* q = end + 1;
+            last = strtol(q, &end, 10);
+            if (end == q) last = first;
+        }
+        if (end != p && first >= 0 && last >= first && last < CPU_SETSIZE) {
+            for (long cpu = first; cpu <= last; ++cpu) cpus.push_back(static_cast<int>(cpu));
+        }
+        p = strchr(end, ',');
+        if (!p) break;
+        ++p;
+    }
+    return cpus;
+}
+
+// FRONTEND_CPUS: the cores frontend workers are pinned to, worker i to
+// entry i modulo the list; empty (no pinning) if unset.
+inline std::vector<int> frontend_cpus() {
+    const char* env = getenv("FRONTEND_CPUS");
+    return env ? parse_cpu_list(env) : std::vector<int>();
+}
+
+inline bool pin_to_cpu(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) == 0) return true;
+    perror("sched_setaffinity");
+    return false;
+}
+
+// One SO_REUSEPORT listener per frontend worker, opened by the master
+// before fork() so their order in the kernel's reuseport group is known:
+// listener i is group index i and belongs to worker i. The master keeps all
+// of them, so a restarted worker takes over its predecessor's listener and
+// the connections queued on it.
+//
+// With steering, a classic BPF program on the group picks the listener by
+// the CPU that received the connection's SYN: the listener of the worker
+// pinned to that CPU. Accept, request processing and the socket's packets
+// then stay on one core. Connections arriving on CPUs without a worker
+// fall back to the kernel's hash.
+class CoreListeners {
+public:
+    CoreListeners() = default;
+    CoreListeners(const CoreListeners&) = delete;
+    CoreListeners& operator=(const CoreListeners&) = delete;
+
+    // cpus[i] is worker i's core; steering needs one worker per core.
+    bool open(const char* host, int port, size_t count, const std::vector<int>& cpus, bool steer) {
+        for (size_t i = 0; i < count; ++i) {
+            int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (fd < 0) {
+                perror("listener socket");
+                return false;
+            }
+            fds_.push_back(fd);
+            int one = 1;
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+            sockaddr_in addr{};
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(static_cast<uint16_t>(port));
+            inet_pton(AF_INET, host, &addr.sin_addr);
+            // the group index is assigned at listen(), in this order
+            if (bind(fd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 4096) < 0) {
+                perror("listener bind");
+                return false;
+            }
+        }
+        if (steer && !fds_.empty()) steering_ = attach_cpu_steering(cpus);
+        return true;
+    }
+
+    // In worker index: its listener; the others are closed in this process.
+    int take(size_t index) {
+        int fd = -1;
+        for (size_t i = 0; i < fds_.size(); ++i) {
+            if (i == index) {
+                fd = fds_[i];
+            } else {
+                close(fds_[i]);
+            }
+        }
+        fds_.clear();
+        return fd;
+    }
+
+    bool steering() const { return steering_; }
+
+private:
+    std::vector<int> fds_;
+    bool steering_ = false;
+
+    bool attach_cpu_steering(const std::vector<int>& cpus) {
+        if (cpus.size() != fds_.size()) return false;
+        for (size_t i = 0; i < cpus.size(); ++i) {
+            for (size_t j = 0; j < i; ++j) {
+                if (cpus[i] == cpus[j]) {
+                    fprintf(stderr, "listener steering needs one worker per core; using the kernel hash\n");
+                    return false;
+                }
+            }
+        }
+        // A = receiving CPU; "if A == cpus[i] return i" for each listener;
+        // an index past the group makes the kernel hash instead.
+        std::vector<sock_filter> code;
+        code.push_back(BPF_STMT(BPF_LD | BPF_W | BPF_ABS, static_cast<uint32_t>(SKF_AD_OFF + SKF_AD_CPU)));
+        for (size_t i = 0; i < cpus.size(); ++i) {
+            code.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, static_cast<uint32_t>(cpus[i]), 0, 1));
+            code.push_back(BPF_STMT(BPF_RET | BPF_K, static_cast<uint32_t>(i)));
+        }
+        code.push_back(BPF_STMT(BPF_RET | BPF_K, 0xffffffffu));
+        if (code.size() > BPF_MAXINSNS) return false;
+        sock_fprog prog;
+        prog.len = static_cast<unsigned short>(code.size());
+        prog.filter = code.data();
+        if (setsockopt(fds_[0], SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) < 0) {
+            perror("SO_ATTACH_REUSEPORT_CBPF");
+            return false;
+        }
+        return true;
+    }
+};
+
+} // namespace frontend
+} // namespace microservice
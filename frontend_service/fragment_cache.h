@@ -0,0 +1,186 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+#include "lock_utils.h"
+
+namespace microservice {
+namespace frontend {
+
+// Counters of every worker's FragmentCache, in an anonymous MAP_SHARED
+// mapping created before fork() so the admin endpoint of any worker can
+// report totals. Each worker claims its own cache-line-sized slot, so the
+// hot path never writes a line another process writes.
+struct FragmentCacheStats {
+    static constexpr uint32_t kMaxSlots = 512;
+
+    struct alignas(64) Slot {
+        std::atomic<int32_t> pid;
+        std::atomic<uint64_t> hits;
+        std::atomic<uint64_t> misses;
+        std::atomic<uint64_t> invalidations; // misses caused by a newer version
+        std::atomic<uint64_t> evictions;
+        std::atomic<uint64_t> bytes_saved;   // fragment bytes served without rendering
+        std::atomic<uint64_t> entries;
+        std::atomic<uint64_t> bytes;
+    };
+
+    std::atomic<uint32_t> next_slot;
+    Slot slots[kMaxSlots];
+
+    Slot* claim() {
+        uint32_t i = next_slot.fetch_add(1, std::memory_order_relaxed) % kMaxSlots;
+        Slot* slot = &slots[i];
+        slot->pid.store(getpid(), std::memory_order_relaxed);
+        slot->entries.store(0, std::memory_order_relaxed);
+        slot->bytes.store(0, std::memory_order_relaxed);
+        return slot;
+    }
+};
+
+// First call must happen before fork(); PreforkHTTPServer does that.
+inline FragmentCacheStats& fragment_cache_stats() {
+    static FragmentCacheStats* stats = [] {
+        void* mem = mmap(nullptr, sizeof(FragmentCacheStats), PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        static FragmentCacheStats unshared; // only if the mapping fails
+        return mem == MAP_FAILED ? &unshared : new (mem) FragmentCacheStats();
+    }();
+    return *stats;
+}
+
+// Per-worker cache of rendered JSON fragments, keyed by hotel id and the
+// content version the profile service stamps on each HotelProfile. A
+// fragment is served only if its version matches the response being
+// rendered, so an updated profile replaces its stale fragment on first use.
+// Version 0 (unversioned) is never cached.
+//
+// Bounded by FRAGMENT_CACHE_BYTES (default 256KB, 0 disables) and evicted
+// with CLOCK: a hit sets the entry's reference bit, and the hand clears bits
+// until it finds an unreferenced entry to drop.
+class FragmentCache {
+public:
+    FragmentCache() : stats_(nullptr) {
+        const char* env = getenv("FRAGMENT_CACHE_BYTES");
+        max_bytes_ = env ? strtoull(env, nullptr, 10) : 256 * 1024;
+    }
+
+    bool enabled() const { return max_bytes_ > 0; }
+
+    // Appends the cached fragment to out; false on a miss.
+    bool append_to(const std::string& id, uint64_t version, std::string& out) {
+        if (!enabled() || version == 0) return false;
+        std::lock_guard<utils::ProfiledMutex> lock(mutex_);
+        FragmentCacheStats::Slot* stats = slot();
+        auto it = index_.find(id);
+        if (it == index_.end()) {
+            stats->misses.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        Entry& e = entries_[it->second];
+        if (e.version != version) {
+            stats->misses.fetch_add(1, std::memory_order_relaxed);
+            stats->invalidations.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        e.referenced = true;
+        out += e.fragment;
+        stats->hits.fetch_add(1, std::memory_order_relaxed);
+        stats->bytes_saved.fetch_add(e.fragment.size(), std::memory_order_relaxed);
+        return true;
+    }
+
+    void insert(const std::string& id, uint64_t version, const char* data, size_t len) {
+        if (!enabled() || version == 0 || len > max_bytes_) return;
+        std::lock_guard<utils::ProfiledMutex> lock(mutex_);
+        auto it = index_.find(id);
+        if (it != index_.end()) {
+            // stale version (or a concurrent render of the same hotel)
+            Entry& e = entries_[it->second];
+            bytes_ -= e.fragment.size();
+            e.version = version;
+            e.fragment.assign(data, len);
+            bytes_ += len;
+        } else {
+            while (bytes_ + len > max_bytes_) {
+                evict_one();
+            }
+            size_t i;
+            if (!free_.empty()) {
+                i = free_.back();
+                free_.pop_back();
+            } else {
+                i = entries_.size();
+                entries_.emplace_back();
+            }
+            Entry& e = entries_[i];
+            e.id = id;
+            e.version = version;
+            e.fragment.assign(data, len);
+            e.referenced = false;
+            e.live = true;
+            index_[id] = i;
+            bytes_ += len;
+        }
+        while (bytes_ > max_bytes_) {
+            evict_one();
+        }
+        FragmentCacheStats::Slot* stats = slot();
+        stats->entries.store(index_.size(), std::memory_order_relaxed);
+        stats->bytes.store(bytes_, std::memory_order_relaxed);
+    }
+
+private:
+    struct Entry {
+        std::string id;
+        uint64_t version = 0;
+        std::string fragment;
+        bool referenced = false;
+        bool live = false;
+    };
+
+    utils::ProfiledMutex mutex_{"fragment_cache"};
+    FragmentCacheStats::Slot* stats_;
+    uint64_t max_bytes_;
+    uint64_t bytes_ = 0;
+    std::vector<Entry> entries_;
+    std::vector<size_t> free_;
+    std::unordered_map<std::string, size_t> index_;
+    size_t hand_ = 0;
+
+    // Claimed lazily so that it happens in the worker, after fork().
+    FragmentCacheStats::Slot* slot() {
+        if (!stats_) stats_ = fragment_cache_stats().claim();
+        return stats_;
+    }
+
+    void evict_one() {
+        for (;;) {
+            if (hand_ >= entries_.size()) hand_ = 0;
+            Entry& e = entries_[hand_++];
+            if (!e.live) continue;
+            if (e.referenced) {
+                e.referenced = false;
+                continue;
+            }
+            bytes_ -= e.fragment.size();
+            index_.erase(e.id);
+            e.live = false;
+            std::string().swap(e.fragment);
+            free_.push_back(hand_ - 1);
+            slot()->evictions.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+};
+
+} // namespace frontend
+} // namespace microservice
@@ -0,0 +1,237 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+namespace microservice {
+namespace frontend {
+
+// Streaming JSON emitter that appends straight into a caller-owned buffer.
+//
+// The output is byte-for-byte what Json::FastWriter (jsoncpp 1.9.5) prints
+// for the same document: no whitespace, doubles as "%.17g" with ".0" added
+// when the result has no '.' or exponent, and jsoncpp's string escaping
+// (named escapes, \u00XX for other control characters, \uXXXX / surrogate
+// pairs for non-ASCII, U+FFFD for invalid UTF-8). FastWriter prints object
+// members sorted by key; callers must emit keys in that order.
+//
+// Nothing is allocated once the buffer has grown to the response size, so
+// reusing one buffer per worker makes rendering allocation-free.
+class JsonWriter {
+public:
+    explicit JsonWriter(std::string& out) : out_(out) {}
+
+    void begin_object() { separate(); out_ += '{'; push(); }
+    void end_object() { pop(); out_ += '}'; }
+    void begin_array() { separate(); out_ += '['; push(); }
+    void end_array() { pop(); out_ += ']'; }
+
+    // key must not need escaping
+    void key(const char* k) {
+        separate();
+        out_ += '"';
+        out_ += k;
+        out_ += "\":";
+        after_key_ = true;
+    }
+
+    void value(const std::string& s) { separate(); append_quoted(s.data(), s.size()); }
+    void value(double v) { separate(); append_double(v); }
+
+    // FastWriter ends the document with a newline
+    void end_document() { out_ += '\n'; }
+
+    void append_quoted(const char* s, size_t len) {
+        out_ += '"';
+        const char* end = s + len;
+        const char* run = s; // start of the pending unescaped run
+        while (s < end) {
+            unsigned char c = static_cast<unsigned char>(*s);
+            if (c >= 0x20 && c < 0x80 && c != '"' && c != '\\') {
+                ++s;
+                continue;
+            }
+            out_.append(run, s - run);
+            switch (c) {
+                case '"': out_ += "\\\""; ++s; break;
+                case '\\': out_ += "\\\\"; ++s; break;
+                case '\b': out_ += "\\b"; ++s; break;
+                case '\f': out_ += "\\f"; ++s; break;
+                case '\n': out_ += "\\n"; ++s; break;
+                case '\r': out_ += "\\r"; ++s; break;
+                case '\t': out_ += "\\t"; ++s; break;
+                default: {
+                    uint32_t cp = decode_utf8(s, end);
+                    if (cp < 0x10000) {
+                        append_hex(cp);
+                    } else {
+                        append_hex(0xD800 + (((cp - 0x10000) >> 10) & 0x3FF));
+                        append_hex(0xDC00 + (cp & 0x3FF));
+                    }
+                }
+            }
+            run = s;
+        }
+        out_.append(run, s - run);
+        out_ += '"';
+    }
+
+    void append_double(double v) {
+        char buf[32];
+        size_t n = format_fixed17(v, buf);
+        if (!n) {
+            if (!std::isfinite(v)) {
+                // jsoncpp without useSpecialFloats
+                out_ += std::isnan(v) ? "null" : (v < 0 ? "-1e+9999" : "1e+9999");
+                return;
+            }
+            n = static_cast<size_t>(snprintf(buf, sizeof(buf), "%.17g", v));
+        }
+        out_.append(buf, n);
+        if (!memchr(buf, '.', n) && !memchr(buf, 'e', n)) out_ += ".0";
+    }
+
+    // Exact "%.17g" for values printed in fixed notation (1e-4 <= |v| < 1e17)
+    // using 128-bit integer arithmetic, which covers coordinates and prices.
+    // Returns 0 where the caller should fall back to snprintf.
+    static size_t format_fixed17(double v, char* buf) {
+        if (v == 0 || !std::isfinite(v)) return 0;
+        uint64_t bits;
+        memcpy(&bits, &v, sizeof(bits));
+        const bool negative = bits >> 63;
+        const int biased = static_cast<int>((bits >> 52) & 0x7ff);
+        if (biased == 0) return 0; // subnormal
+        const uint64_t mantissa = (bits & ((1ull << 52) - 1)) | (1ull << 52);
+        const int shift = 1075 - biased; // |v| = mantissa / 2^shift
+        if (shift < 0 || shift > 120) return 0;
+
+        // Decimal exponent of |v|; the estimate is corrected below.
+        int exp10 = static_cast<int>(std::floor(std::log10(std::fabs(v))));
+        unsigned __int128 digits = 0;
+        for (int attempt = 0; attempt < 2; ++attempt) {
+            const int k = 16 - exp10; // digits = round(|v| * 10^k)
+            if (exp10 < -4 || exp10 > 16 || k > 22) return 0;
+            unsigned __int128 scaled = static_cast<unsigned __int128>(mantissa) * pow10(k);
+            digits = scaled >> shift;
+            if (digits < kLow) { --exp10; continue; }
+            if (digits >= kHigh) { ++exp10; continue; }
+            const unsigned __int128 rem = scaled - (digits << shift);
+            const unsigned __int128 half = shift ? static_cast<unsigned __int128>(1) << (shift - 1) : 0;
+            if (shift && (rem > half || (rem == half && (digits & 1)))) ++digits; // round half to even
+            if (digits == kHigh) {
+                digits = kLow;
+                ++exp10;
+                if (exp10 > 16) return 0;
+            }
+            break;
+        }
+        if (digits < kLow || digits >= kHigh) return 0;
+
+        char d[17];
+        uint64_t hi = static_cast<uint64_t>(digits);
+        for (int i = 16; i >= 0; --i) {
+            d[i] = static_cast<char>('0' + hi % 10);
+            hi /= 10;
+        }
+        int last = 16; // drop trailing zeros, as %g does
+        while (last > 0 && d[last] == '0' && last > exp10) --last;
+
+        char* p = buf;
+        if (negative) *p++ = '-';
+        if (exp10 >= 0) {
+            for (int i = 0; i <= exp10; ++i) *p++ = d[i];
+            if (last > exp10) {
+                *p++ = '.';
+                for (int i = exp10 + 1; i <= last; ++i) *p++ = d[i];
+            }
+        } else {
+            *p++ = '0';
+            *p++ = '.';
+            for (int i = -1; i > exp10; --i) *p++ = '0';
+            for (int i = 0; i <= last; ++i) *p++ = d[i];
+        }
+        return static_cast<size_t>(p - buf);
+    }
+
+private:
+    static constexpr uint64_t kLow = 10000000000000000ull;   // 10^16
+    static constexpr uint64_t kHigh = 100000000000000000ull; // 10^17
+
+    std::string& out_;
+    uint64_t first_ = 0; // bit per nesting level: no member written yet
+    int depth_ = 0;
+    bool after_key_ = false;
+
+    static unsigned __int128 pow10(int k) {
+        unsigned __int128 p = 1;
+        for (int i = 0; i < k; ++i) p *= 10;
+        return p;
+    }
+
+    void push() {
+        ++depth_;
+        first_ |= 1ull << depth_;
+    }
+
+    void pop() { --depth_; }
+
+    void separate() {
+        if (after_key_) {
+            after_key_ = false;
+            return;
+        }
+        if (depth_ == 0) return;
+        if (first_ & (1ull << depth_)) {
+            first_ &= ~(1ull << depth_);
+        } else {
+            out_ += ',';
+        }
+    }
+
+    void append_hex(uint32_t v) {
+        static const char hex[] = "0123456789abcdef";
+        char buf[6] = {'\\', 'u', hex[(v >> 12) & 0xf], hex[(v >> 8) & 0xf],
+                       hex[(v >> 4) & 0xf], hex[v & 0xf]};
+        out_.append(buf, 6);
+    }
+
+    // jsoncpp's utf8ToCodepoint: consumes one sequence and returns U+FFFD
+    // for truncated, overlong or surrogate encodings.
+    static uint32_t decode_utf8(const char*& s, const char* end) {
+        const uint32_t kReplacement = 0xFFFD;
+        const unsigned char* u = reinterpret_cast<const unsigned char*>(s);
+        uint32_t first = u[0];
+        if (first < 0x80) {
+            ++s;
+            return first;
+        }
+        if (first < 0xE0) {
+            if (end - s < 2) { ++s; return kReplacement; }
+            uint32_t cp = ((first & 0x1F) << 6) | (u[1] & 0x3F);
+            s += 2;
+            return cp < 0x80 ? kReplacement : cp;
+        }
+        if (first < 0xF0) {
+            if (end - s < 3) { ++s; return kReplacement; }
+            uint32_t cp = ((first & 0x0F) << 12) | ((u[1] & 0x3F) << 6) | (u[2] & 0x3F);
+            s += 3;
+            if (cp >= 0xD800 && cp <= 0xDFFF) return kReplacement;
+            return cp < 0x800 ? kReplacement : cp;
+        }
+        if (first < 0xF8) {
+            if (end - s < 4) { ++s; return kReplacement; }
+            uint32_t cp = ((first & 0x07) << 18) | ((u[1] & 0x3F) << 12) |
+                          ((u[2] & 0x3F) << 6) | (u[3] & 0x3F);
+            s += 4;
+            return cp < 0x10000 ? kReplacement : cp;
+        }
+        ++s;
+        return kReplacement;
+    }
+};
+
+} // namespace frontend
+} // namespace microservice
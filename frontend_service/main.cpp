@@ -4,6 +4,18 @@
 #include "hotel_reservation.pb.h"
 #include "serialization_utils.h"
 #include "padding_utils.h"
+#include "trace_utils.h"
+#include "rpc_utils.h"
+#include "batch_utils.h"
+#include "singleflight_utils.h"
+#include "thread_pool.h"
+#include "request_binder.h"
+#include "json_writer.h"
+#include "fragment_cache.h"
+#include "response_cache.h"
+#include "admission_control.h"
+#include "reactor_server.h"
+#include "core_listeners.h"
 #include <httplib.h>
 #include <chrono>
 #include <iomanip>
@@ -16,6 +28,34 @@
 #include <signal.h>
 #include <vector>
 #include <algorithm>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <sched.h>
+
+// Head-based sampling decision plus end-to-end timing for one route. The
+// decision made here is what every downstream service follows.
+class RouteTrace {
+public:
+    RouteTrace(microservice::utils::SamplePoint& point, const char* endpoint)
+        : trace_(point), endpoint_(endpoint) {
+        if (microservice::utils::trace_active()) {
+            start_ = microservice::utils::TscClock::instance().now();
+        }
+    }
+
+    ~RouteTrace() {
+        if (microservice::utils::trace_active()) {
+            uint64_t end = microservice::utils::TscClock::instance().now_end();
+            microservice::utils::log_request_timing(endpoint_, start_, end);
+        }
+    }
+
+private:
+    microservice::utils::ScopedTrace trace_;
+    const char* endpoint_;
+    uint64_t start_ = 0;
+};
 
 class FrontEndService {
 public:
@@ -66,156 +106,502 @@ public:
         return req;
     }
 
-    // Helper function to convert protobuf messages to JSON
-    Json::Value searchResponseToJson(const hotelreservation::SearchResponse& resp) {
-        Json::Value json(Json::arrayValue);
-        for (const auto& hotel : resp.hotels()) {
-            Json::Value hotel_json;
-            hotel_json["id"] = hotel.id();
-            hotel_json["name"] = hotel.name();
-            hotel_json["phoneNumber"] = hotel.phone_number();
-            hotel_json["description"] = hotel.description();
-            
-            Json::Value address;
-            address["streetNumber"] = hotel.address().street_number();
-            address["streetName"] = hotel.address().street_name();
-            address["city"] = hotel.address().city();
-            address["state"] = hotel.address().state();
-            address["country"] = hotel.address().country();
-            address["postalCode"] = hotel.address().postal_code();
-            address["latitude"] = hotel.address().lat();
-            address["longitude"] = hotel.address().lon();
-            
-            hotel_json["address"] = address;
-            json.append(hotel_json);
+    // Query-string binders for the GET routes: parameters go straight into
+    // the protobuf request (request_binder.h). The JSON parsers above serve
+    // the POST routes.
+    bool bindSearchRequest(const httplib::Params& params, hotelreservation::SearchRequest& req,
+                           const char** bad_param) {
+        using hotelreservation::SearchRequest;
+        using namespace microservice::frontend;
+        static const ParamBinding<SearchRequest> table[] = {
+            {"customerName", false, [](SearchRequest& r, const std::string& v) { r.set_customer_name(v); return true; }},
+            {"inDate", false, [](SearchRequest& r, const std::string& v) { r.set_in_date(v); return true; }},
+            {"outDate", false, [](SearchRequest& r, const std::string& v) { r.set_out_date(v); return true; }},
+            {"latitude", true, [](SearchRequest& r, const std::string& v) {
+                double d;
+                if (!parse_latitude(v, d)) return false;
+                r.set_lat(d);
+                return true;
+            }},
+            {"longitude", true, [](SearchRequest& r, const std::string& v) {
+                double d;
+                if (!parse_longitude(v, d)) return false;
+                r.set_lon(d);
+                return true;
+            }},
+            {"locale", false, [](SearchRequest& r, const std::string& v) { r.set_locale(v); return true; }},
+        };
+        if (!bind_params(params, table, req, bad_param)) return false;
+        *req.mutable_padding() = microservice::utils::generate_person_padding();
+        return true;
+    }
+
+    bool bindRecommendRequest(const httplib::Params& params, hotelreservation::RecommendRequest& req,
+                              const char** bad_param) {
+        using hotelreservation::RecommendRequest;
+        using namespace microservice::frontend;
+        static const ParamBinding<RecommendRequest> table[] = {
+            {"latitude", true, [](RecommendRequest& r, const std::string& v) {
+                double d;
+                if (!parse_latitude(v, d)) return false;
+                r.set_lat(d);
+                return true;
+            }},
+            {"longitude", true, [](RecommendRequest& r, const std::string& v) {
+                double d;
+                if (!parse_longitude(v, d)) return false;
+                r.set_lon(d);
+                return true;
+            }},
+            {"require", false, [](RecommendRequest& r, const std::string& v) { r.set_require(v); return true; }},
+            {"locale", false, [](RecommendRequest& r, const std::string& v) { r.set_locale(v); return true; }},
+        };
+        if (!bind_params(params, table, req, bad_param)) return false;
+        *req.mutable_padding() = microservice::utils::generate_person_padding();
+        return true;
+    }
+
+    bool bindUserRequest(const httplib::Params& params, hotelreservation::UserRequest& req,
+                         const char** bad_param) {
+        using hotelreservation::UserRequest;
+        using namespace microservice::frontend;
+        static const ParamBinding<UserRequest> table[] = {
+            {"username", false, [](UserRequest& r, const std::string& v) { r.set_username(v); return true; }},
+            {"password", false, [](UserRequest& r, const std::string& v) { r.set_password(v); return true; }},
+        };
+        if (!bind_params(params, table, req, bad_param)) return false;
+        *req.mutable_padding() = microservice::utils::generate_person_padding();
+        return true;
+    }
+
+    bool bindReservationRequest(const httplib::Params& params, hotelreservation::ReservationRequest& req,
+                                const char** bad_param) {
+        using hotelreservation::ReservationRequest;
+        using namespace microservice::frontend;
+        static const ParamBinding<ReservationRequest> table[] = {
+            {"customerName", false, [](ReservationRequest& r, const std::string& v) { r.set_customer_name(v); return true; }},
+            {"hotelId", false, [](ReservationRequest& r, const std::string& v) { r.set_hotel_id(v); return true; }},
+            {"inDate", false, [](ReservationRequest& r, const std::string& v) { r.set_in_date(v); return true; }},
+            {"outDate", false, [](ReservationRequest& r, const std::string& v) { r.set_out_date(v); return true; }},
+            {"roomNumber", true, [](ReservationRequest& r, const std::string& v) {
+                int64_t n;
+                if (!parse_int64(v, n)) return false;
+                r.set_room_number(n);
+                return true;
+            }},
+            {"username", false, [](ReservationRequest& r, const std::string& v) { r.set_username(v); return true; }},
+            {"password", false, [](ReservationRequest& r, const std::string& v) { r.set_password(v); return true; }},
+        };
+        if (!bind_params(params, table, req, bad_param)) return false;
+        *req.mutable_padding() = microservice::utils::generate_person_padding();
+        return true;
+    }
+
+    // Renders a hotel list into a per-thread buffer reused across requests;
+    // httplib runs handlers on a thread pool, so it cannot be a member. Each
+    // hotel comes from the worker's fragment cache when its version matches,
+    // otherwise it is rendered from the protobuf fields (json_writer.h) and
+    // cached. The output is what Json::FastWriter printed for the former
+    // per-hotel Json::Value DOM.
+    template <typename Hotels>
+    const std::string& hotelsToJson(const Hotels& hotels) {
+        static thread_local std::string json_buffer;
+        json_buffer.clear();
+        json_buffer += '[';
+        for (int i = 0; i < hotels.size(); ++i) {
+            const auto& hotel = hotels.Get(i);
+            if (i > 0) json_buffer += ',';
+            if (fragment_cache_.append_to(hotel.id(), hotel.version(), json_buffer)) continue;
+            size_t start = json_buffer.size();
+            microservice::frontend::JsonWriter writer(json_buffer);
+            writeHotel(writer, hotel);
+            fragment_cache_.insert(hotel.id(), hotel.version(), json_buffer.data() + start,
+                                   json_buffer.size() - start);
         }
-        return json;
+        json_buffer += "]\n";
+        return json_buffer;
     }
 
-    Json::Value recommendResponseToJson(const hotelreservation::RecommendResponse& resp) {
-        Json::Value json(Json::arrayValue);
-        for (const auto& hotel : resp.hotels()) {
-            Json::Value hotel_json;
-            hotel_json["id"] = hotel.id();
-            hotel_json["name"] = hotel.name();
-            hotel_json["phoneNumber"] = hotel.phone_number();
-            hotel_json["description"] = hotel.description();
-            
-            Json::Value address;
-            address["streetNumber"] = hotel.address().street_number();
-            address["streetName"] = hotel.address().street_name();
-            address["city"] = hotel.address().city();
-            address["state"] = hotel.address().state();
-            address["country"] = hotel.address().country();
-            address["postalCode"] = hotel.address().postal_code();
-            address["latitude"] = hotel.address().lat();
-            address["longitude"] = hotel.address().lon();
-            
-            hotel_json["address"] = address;
-            json.append(hotel_json);
-        }
-        return json;
-    }
-
-    std::string sendProtobufOverUDS(const std::string& path, const std::string& data) {
-        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
-        if (fd < 0) return "{\"error\": \"socket error\"}";
-        sockaddr_un addr{};
-        addr.sun_family = AF_UNIX;
-        strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
-        if (connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
-            close(fd);
-            return "{\"error\": \"connect error\"}";
-        }
-        uint32_t len = data.size();
-        if (write(fd, &len, 4) != 4) { close(fd); return "{\"error\": \"write error\"}"; }
-        if (write(fd, data.data(), len) != (ssize_t)len) { close(fd); return "{\"error\": \"write error\"}"; }
-        char len_buf[4];
-        if (read(fd, len_buf, 4) != 4) { close(fd); return "{\"error\": \"read error\"}"; }
-        uint32_t resp_len = 0;
-        memcpy(&resp_len, len_buf, 4);
-        std::vector<char> resp_buf(resp_len);
-        if (read(fd, resp_buf.data(), resp_len) != (ssize_t)resp_len) { close(fd); return "{\"error\": \"read error\"}"; }
-        close(fd);
-        return std::string(resp_buf.begin(), resp_buf.end());
+    // The profile fields writeHotel() reads, and the version the fragment
+    // cache checks; the profile and address padding is never rendered.
+    static constexpr uint32_t kRenderedProfileFields =
+        hotelreservation::PROFILE_NAME | hotelreservation::PROFILE_PHONE_NUMBER |
+        hotelreservation::PROFILE_DESCRIPTION | hotelreservation::PROFILE_ADDRESS | hotelreservation::PROFILE_VERSION;
+
+    // Asks the profile service for just those fields, for requests whose
+    // answer is rendered to JSON. Passthrough requests keep whatever fields
+    // their caller asked for.
+    static void renderFields(hotelreservation::SearchRequest& req) { req.set_profile_fields(kRenderedProfileFields); }
+    static void renderFields(hotelreservation::RecommendRequest& req) { req.set_profile_fields(kRenderedProfileFields); }
+
+    template <typename Request>
+    static void renderFields(Request&) {}
+
+    // Members in jsoncpp's sorted key order.
+    static void writeHotel(microservice::frontend::JsonWriter& writer,
+                           const hotelreservation::HotelProfile& hotel) {
+        const auto& address = hotel.address();
+        writer.begin_object();
+        writer.key("address");
+        writer.begin_object();
+        writer.key("city");
+        writer.value(address.city());
+        writer.key("country");
+        writer.value(address.country());
+        writer.key("latitude");
+        writer.value(address.lat());
+        writer.key("longitude");
+        writer.value(address.lon());
+        writer.key("postalCode");
+        writer.value(address.postal_code());
+        writer.key("state");
+        writer.value(address.state());
+        writer.key("streetName");
+        writer.value(address.street_name());
+        writer.key("streetNumber");
+        writer.value(address.street_number());
+        writer.end_object();
+        writer.key("description");
+        writer.value(hotel.description());
+        writer.key("id");
+        writer.value(hotel.id());
+        writer.key("name");
+        writer.value(hotel.name());
+        writer.key("phoneNumber");
+        writer.value(hotel.phone_number());
+        writer.end_object();
+    }
+
+    // Error body for a failed downstream call; it is handed to the response
+    // parser like a real response, which then reports the failure.
+    static std::string callError(microservice::rpc::CallStatus status) {
+        using microservice::rpc::CallStatus;
+        switch (status) {
+            case CallStatus::kOk: break;
+            case CallStatus::kSocketError: return "{\"error\": \"socket error\"}";
+            case CallStatus::kConnectError: return "{\"error\": \"connect error\"}";
+            case CallStatus::kWriteError: return "{\"error\": \"write error\"}";
+            case CallStatus::kReadError: return "{\"error\": \"read error\"}";
+            case CallStatus::kDeadlineExceeded: return "{\"error\": \"deadline exceeded\"}";
+        }
+        return "";
+    }
+
+    // HTTP status for the outcome of a forwarded (protobuf passthrough) call.
+    static int forwardStatus(microservice::rpc::CallStatus status) {
+        using microservice::rpc::CallStatus;
+        if (status == CallStatus::kOk) return 200;
+        return status == CallStatus::kDeadlineExceeded ? 408 : 502;
+    }
+
+    // application/x-protobuf content negotiation: a POST body of this type
+    // is a serialized request for the route's service, and a GET that
+    // accepts it is answered with the service's serialized response.
+    static bool isProtobuf(const std::string& content_type) {
+        return content_type.compare(0, 22, "application/x-protobuf") == 0;
+    }
+
+    static bool acceptsProtobuf(const std::string& accept) {
+        return accept.find("application/x-protobuf") != std::string::npos;
+    }
+
+    // Protobuf passthrough: serialized goes to the service as it is and the
+    // response bytes come back in body unparsed, so nothing is converted on
+    // the way. Returns the HTTP status; on failure body is a JSON error.
+    int Forward(const char* path, const std::string& serialized, std::string& body) {
+        microservice::rpc::CallStatus status = callDownstream(path, serialized, body);
+        if (status != microservice::rpc::CallStatus::kOk) body = callError(status);
+        return forwardStatus(status);
+    }
+
+    // Downstream call, joined into a batch with other threads' calls to the
+    // same service when its route is listed in RPC_BATCH (batch_utils.h).
+    microservice::rpc::CallStatus callDownstream(const std::string& path, const std::string& data,
+                                                 std::string& response) {
+        if (!batchers_.empty()) {
+            auto batcher = batchers_.find(path);
+            if (batcher != batchers_.end()) return batcher->second->call(data, response);
+        }
+        return microservice::rpc::call(path, data, response);
+    }
+
+    // *sent tells whether the call succeeded; if not, the response is its
+    // callError() body.
+    std::string sendProtobufOverUDS(const std::string& path, const std::string& data, bool* sent = nullptr) {
+        std::string response;
+        microservice::rpc::CallStatus status = callDownstream(path, data, response);
+        if (sent) *sent = status == microservice::rpc::CallStatus::kOk;
+        return status == microservice::rpc::CallStatus::kOk ? response : callError(status);
+    }
+
+    // Per-request state between a route and its handler: bypass_cache is set
+    // from the request's Cache-Control header, cache_status is reported back
+    // in X-Cache, and ok tells admission control whether the request was
+    // answered with a valid response.
+    struct RequestContext {
+        bool bypass_cache = false;
+        const char* cache_status = nullptr; // HIT, STALE, MISS or BYPASS; null if not cached
+        bool ok = false;
+    };
+
+    static bool bypassCache(const std::string& cache_control) {
+        return cache_control.find("no-cache") != std::string::npos;
+    }
+
+    // Downstream call shared by concurrent identical requests of every
+    // worker (singleflight_utils.h); followers skip even the serialization.
+    // *sent as for sendProtobufOverUDS().
+    template <typename Request>
+    std::string sendCoalesced(microservice::utils::SingleFlight::Route* route, const std::string& path,
+                              const Request& req, bool* sent) {
+        if (!microservice::utils::SingleFlight::enabled(route)) {
+            return sendProtobufOverUDS(path, microservice::utils::serialize_message(ser1de, req), sent);
+        }
+        std::string response;
+        *sent = flights_.run(route, flightKey(req), response, [&](std::string& out) {
+            std::string serialized_request = microservice::utils::serialize_message(ser1de, req);
+            microservice::rpc::CallStatus status = callDownstream(path, serialized_request, out);
+            if (status == microservice::rpc::CallStatus::kOk) return true;
+            out = callError(status);
+            return false;
+        });
+        return response;
+    }
+
+    microservice::utils::SingleFlight& flights_;
+    microservice::frontend::ResponseCache response_cache_{{"search", 1000}, {"recommend", 10000}};
+    microservice::utils::SingleFlight::Route* search_flight_;
+    microservice::utils::SingleFlight::Route* recommend_flight_;
+    const microservice::frontend::ResponseCache::Route* search_cache_;
+    const microservice::frontend::ResponseCache::Route* recommend_cache_;
+    std::once_flag refresh_pool_once_;
+    std::unique_ptr<ThreadPool> refresh_pool_; // started on the first revalidation
+    microservice::rpc::BatchConfig batching_ = microservice::rpc::BatchConfig::from_env();
+    // by socket path, for the routes in RPC_BATCH
+    std::unordered_map<std::string, std::unique_ptr<microservice::rpc::MicroBatcher>> batchers_;
+
+    // Serves the body from the response cache, or computes it with
+    // compute(req, &ok) and stores it if ok. The first request to find an
+    // entry past its TTL still gets the stale body and revalidates it on
+    // the refresh pool.
+    template <typename Request, typename Compute>
+    std::string cachedResponse(const microservice::frontend::ResponseCache::Route* route, const Request& req,
+                               RequestContext* context, Compute compute) {
+        using Lookup = microservice::frontend::ResponseCache::Lookup;
+        if (!route) return compute(req, context ? &context->ok : nullptr);
+        std::string key = flightKey(req);
+        std::string body;
+        const char* status = "BYPASS";
+        if (context && context->bypass_cache) {
+            response_cache_.record_bypass();
+        } else {
+            switch (response_cache_.get(route, key, body)) {
+                case Lookup::kFresh:
+                    if (context) {
+                        context->cache_status = "HIT";
+                        context->ok = true;
+                    }
+                    return body;
+                case Lookup::kStale:
+                    refreshInBackground(route, key, req, compute);
+                    if (context) {
+                        context->cache_status = "STALE";
+                        context->ok = true;
+                    }
+                    return body;
+                case Lookup::kStaleRefreshing:
+                    if (context) {
+                        context->cache_status = "STALE";
+                        context->ok = true;
+                    }
+                    return body;
+                case Lookup::kMiss:
+                    status = "MISS";
+                    break;
+            }
+        }
+        if (context) context->cache_status = status;
+        bool ok = false;
+        body = compute(req, &ok);
+        if (ok) response_cache_.put(route, key, body);
+        if (context) context->ok = ok;
+        return body;
+    }
+
+    template <typename Request, typename Compute>
+    void refreshInBackground(const microservice::frontend::ResponseCache::Route* route, const std::string& key,
+                             const Request& req, Compute compute) {
+        std::call_once(refresh_pool_once_, [this] { refresh_pool_.reset(new ThreadPool(1)); });
+        refresh_pool_->enqueue_task([this, route, key, req, compute] {
+            bool ok = false;
+            std::string body = compute(req, &ok);
+            if (ok) {
+                response_cache_.put(route, key, body);
+            } else {
+                response_cache_.refresh_failed(route, key);
+            }
+        });
     }
 
 public:
-    FrontEndService() {
+    explicit FrontEndService(microservice::utils::SingleFlight& flights)
+        : flights_(flights),
+          search_flight_(flights.route("search")),
+          recommend_flight_(flights.route("recommend")),
+          search_cache_(response_cache_.route("search")),
+          recommend_cache_(response_cache_.route("recommend")) {
         // Remove all initialization of httplib::Client in constructor
+        // Route name and the socket of the service it calls
+        static const std::pair<const char*, const char*> downstream[] = {
+            {"search", "/tmp/search_service.sock"},
+            {"recommend", "/tmp/recommendation_service.sock"},
+            {"user", "/tmp/user_service.sock"},
+            {"reservation", "/tmp/reservation_service.sock"},
+        };
+        for (const auto& route : downstream) {
+            if (!batching_.enabled(route.first)) continue;
+            batchers_[route.second].reset(
+                new microservice::rpc::MicroBatcher(route.second, batching_.window_ns, batching_.max_items));
+        }
+    }
+
+    const microservice::rpc::BatchConfig& batching() const { return batching_; }
+
+    // Single-flight keys: the request fields the downstream result depends
+    // on (search ignores customerName). Other requests are never coalesced.
+    static std::string flightKey(const hotelreservation::SearchRequest& req) {
+        return microservice::utils::FlightKey().add(req.lat()).add(req.lon()).add(req.in_date())
+            .add(req.out_date()).add(req.locale()).add(req.profile_fields()).str();
+    }
+
+    static std::string flightKey(const hotelreservation::RecommendRequest& req) {
+        return microservice::utils::FlightKey().add(req.lat()).add(req.lon()).add(req.require())
+            .add(req.locale()).add(req.profile_fields()).str();
     }
 
+    template <typename Request>
+    static std::string flightKey(const Request&) { return std::string(); }
+
+    microservice::utils::SingleFlight& flights() { return flights_; }
+
     ~FrontEndService() {
         // No cleanup needed
     }
     
     Ser1de_re ser1de;
+    microservice::frontend::FragmentCache fragment_cache_;
 
-    std::string HandleSearch(const std::string& json_str) {
+    std::string HandleSearch(const std::string& json_str, RequestContext* context = nullptr) {
         Json::Value json;
         Json::Reader reader;
         if (!reader.parse(json_str, json)) {
             return "{\"error\": \"Invalid JSON format\"}";
         }
-        auto search_req = parseSearchRequest(json);
-        std::string serialized_request = microservice::utils::serialize_message(ser1de, search_req);
-        std::string response_str = sendProtobufOverUDS("/tmp/search_service.sock", serialized_request);
+        return HandleSearch(parseSearchRequest(json), context);
+    }
+
+    // The downstream request is cut down to the profile fields the body
+    // renders (renderFields()).
+    std::string HandleSearch(hotelreservation::SearchRequest search_req, RequestContext* context = nullptr) {
+        renderFields(search_req);
+        return cachedResponse(search_cache_, search_req, context,
+                              [this](const hotelreservation::SearchRequest& req, bool* ok) {
+            bool sent = false;
+            std::string response = sendCoalesced(search_flight_, "/tmp/search_service.sock", req, &sent);
+            return FinishSearch(response, sent ? ok : nullptr);
+        });
+    }
+
+    // The Finish* halves turn the downstream response into the JSON body and
+    // set *ok if it was a valid response; the reactor server calls them when
+    // its asynchronous call completes. A failed call's error body is passed
+    // without ok, so nothing built from it is reported ok or cached: search
+    // and recommendation leave a request unanswered when their own
+    // downstream calls fail, rather than answer it empty.
+    std::string FinishSearch(const std::string& response_str, bool* ok = nullptr) {
         hotelreservation::SearchResponse response;
         if (!microservice::utils::deserialize_message(ser1de, response_str, response)) {
             return "{\"error\": \"Failed to process search results\"}";
         }
-        Json::Value response_json = searchResponseToJson(response);
-        Json::FastWriter writer;
-        return writer.write(response_json);
+        if (ok) *ok = true;
+        return hotelsToJson(response.hotels());
     }
 
-    std::string HandleRecommend(const std::string& json_str) {
+    std::string HandleRecommend(const std::string& json_str, RequestContext* context = nullptr) {
         Json::Value json;
         Json::Reader reader;
         if (!reader.parse(json_str, json)) {
             return "{\"error\": \"Invalid JSON format\"}";
         }
-        auto req = parseRecommendRequest(json);
-        std::string serialized_request = microservice::utils::serialize_message(ser1de, req);
-        std::string response_str = sendProtobufOverUDS("/tmp/recommendation_service.sock", serialized_request);
+        return HandleRecommend(parseRecommendRequest(json), context);
+    }
+
+    std::string HandleRecommend(hotelreservation::RecommendRequest recommend_req, RequestContext* context = nullptr) {
+        renderFields(recommend_req);
+        return cachedResponse(recommend_cache_, recommend_req, context,
+                              [this](const hotelreservation::RecommendRequest& req, bool* ok) {
+            bool sent = false;
+            std::string response = sendCoalesced(recommend_flight_, "/tmp/recommendation_service.sock", req, &sent);
+            return FinishRecommend(response, sent ? ok : nullptr);
+        });
+    }
+
+    std::string FinishRecommend(const std::string& response_str, bool* ok = nullptr) {
         hotelreservation::RecommendResponse response;
         if (!microservice::utils::deserialize_message(ser1de, response_str, response)) {
             return "{\"error\": \"Failed to process recommendations\"}";
         }
-        return recommendResponseToJson(response).toStyledString();
+        if (ok) *ok = true;
+        return hotelsToJson(response.hotels());
     }
 
-    std::string HandleUser(const std::string& json_str) {
+    std::string HandleUser(const std::string& json_str, RequestContext* context = nullptr) {
         Json::Value json;
         Json::Reader reader;
         if (!reader.parse(json_str, json)) {
             return "{\"error\": \"Invalid JSON format\"}";
         }
-        auto req = parseUserRequest(json);
+        return HandleUser(parseUserRequest(json), context);
+    }
+
+    std::string HandleUser(const hotelreservation::UserRequest& req, RequestContext* context = nullptr) {
         std::string serialized_request = microservice::utils::serialize_message(ser1de, req);
-        std::string response_str = sendProtobufOverUDS("/tmp/user_service.sock", serialized_request);
+        return FinishUser(sendProtobufOverUDS("/tmp/user_service.sock", serialized_request),
+                          context ? &context->ok : nullptr);
+    }
+
+    std::string FinishUser(const std::string& response_str, bool* ok = nullptr) {
         hotelreservation::UserResponse response;
         if (!microservice::utils::deserialize_message(ser1de, response_str, response)) {
             return "{\"error\": \"Failed to process user request\"}";
         }
+        if (ok) *ok = true;
         Json::Value response_json;
         response_json["message"] = response.message();
         return response_json.toStyledString();
     }
 
-    std::string HandleReservation(const std::string& json_str) {
+    std::string HandleReservation(const std::string& json_str, RequestContext* context = nullptr) {
         Json::Value json;
         Json::Reader reader;
         if (!reader.parse(json_str, json)) {
             return "{\"error\": \"Invalid JSON format\"}";
         }
-        auto req = parseReservationRequest(json);
+        return HandleReservation(parseReservationRequest(json), context);
+    }
+
+    std::string HandleReservation(const hotelreservation::ReservationRequest& req, RequestContext* context = nullptr) {
         std::string serialized_request = microservice::utils::serialize_message(ser1de, req);
-        std::string response_str = sendProtobufOverUDS("/tmp/reservation_service.sock", serialized_request);
+        return FinishReservation(sendProtobufOverUDS("/tmp/reservation_service.sock", serialized_request),
+                                 context ? &context->ok : nullptr);
+    }
+
+    std::string FinishReservation(const std::string& response_str, bool* ok = nullptr) {
         hotelreservation::ReservationResponse response;
         if (!microservice::utils::deserialize_message(ser1de, response_str, response)) {
             return "{\"error\": \"Failed to process reservation\"}";
         }
+        if (ok) *ok = true;
         Json::Value response_json;
         response_json["message"] = response.message();
         return response_json.toStyledString();
@@ -228,14 +614,23 @@ constexpr int FrontEndService::POOL_SIZE;
 class PreforkHTTPServer {
 private:
     int num_workers_;
-    std::vector<pid_t> worker_pids_;
+    std::vector<pid_t> worker_pids_; // indexed by worker index
     bool should_stop_;
+    int worker_index_ = -1;
 
 public:
     PreforkHTTPServer(int num_workers = 32) : num_workers_(num_workers), should_stop_(false) {
         // Set up signal handlers for graceful shutdown
         signal(SIGTERM, [](int) { /* handled in main loop */ });
         signal(SIGINT, [](int) { /* handled in main loop */ });
+        // Clients and downstream services may close before we write
+        signal(SIGPIPE, SIG_IGN);
+        // Calibrate the timing clock and map the shared trace control block
+        // once here so forked workers inherit both
+        microservice::utils::TscClock::instance().report("Frontend");
+        microservice::utils::trace_control();
+        microservice::frontend::fragment_cache_stats();
+        microservice::frontend::response_cache_stats();
     }
 
     // Fork worker processes
@@ -247,6 +642,7 @@ public:
             
             if (pid == 0) {
                 // Worker process
+                worker_index_ = i;
                 std::cout << "HTTP Worker process " << getpid() << " started" << std::endl;
                 return true; // Return true to indicate this is a worker
             } else if (pid > 0) {
@@ -264,8 +660,9 @@ public:
         return false; // Return false to indicate this is the master
     }
 
-    // Master process main loop
-    void master_loop() {
+    // Master process main loop; on_worker_exit(index) runs for each worker
+    // that died, before its replacement is forked.
+    void master_loop(const std::function<void(int)>& on_worker_exit = nullptr) {
         std::cout << "HTTP Master process waiting for workers..." << std::endl;
         
         while (!should_stop_) {
@@ -276,21 +673,21 @@ public:
             if (dead_pid > 0) {
                 std::cout << "HTTP Worker " << dead_pid << " died, restarting..." << std::endl;
                 
-                // Remove from our list
-                worker_pids_.erase(
-                    std::remove(worker_pids_.begin(), worker_pids_.end(), dead_pid),
-                    worker_pids_.end()
-                );
+                // The replacement takes over the dead worker's index
+                auto slot = std::find(worker_pids_.begin(), worker_pids_.end(), dead_pid);
+                if (slot == worker_pids_.end()) continue;
+                if (on_worker_exit) on_worker_exit(static_cast<int>(slot - worker_pids_.begin()));
                 
                 // Fork a new worker
                 pid_t new_pid = fork();
                 if (new_pid == 0) {
                     // New worker process
+                    worker_index_ = static_cast<int>(slot - worker_pids_.begin());
                     std::cout << "Restarted HTTP worker process " << getpid() << std::endl;
                     return; // Return to indicate this is a worker
                 } else if (new_pid > 0) {
                     // Master process
-                    worker_pids_.push_back(new_pid);
+                    *slot = new_pid;
                 }
             }
             
@@ -312,17 +709,635 @@ public:
 
     // Set stop flag for graceful shutdown
     void stop() { should_stop_ = true; }
+
+    // In a worker: its index in [0, num_workers), kept across restarts.
+    int worker_index() const { return worker_index_; }
+};
+
+// Runtime timing control: /admin/timing?enabled=0|1&rate=N[&point=frontend_search]
+// Changes apply to every frontend worker; downstream services follow the
+// per-request decision made here.
+std::string adminTiming(const std::multimap<std::string, std::string>& params, int& status) {
+    auto& ctl = microservice::utils::trace_control();
+    auto param = [&params](const char* name) -> const std::string* {
+        auto it = params.find(name);
+        return it == params.end() ? nullptr : &it->second;
+    };
+    try {
+        if (const std::string* enabled = param("enabled")) {
+            ctl.enabled.store(*enabled != "0");
+        }
+        if (const std::string* rate_param = param("rate")) {
+            int rate = std::stoi(*rate_param);
+            if (rate < 1) throw std::invalid_argument("rate");
+            if (const std::string* point_name = param("point")) {
+                auto* point = ctl.find_or_add(point_name->c_str());
+                if (!point) throw std::invalid_argument("point");
+                point->sample_every.store(rate);
+            } else {
+                ctl.default_sample_every.store(rate);
+            }
+        }
+    } catch (const std::exception&) {
+        status = 400;
+        return "{\"error\": \"Invalid timing parameters\"}";
+    }
+    Json::Value result;
+    result["enabled"] = ctl.enabled.load() != 0;
+    result["sampleRate"] = ctl.default_sample_every.load();
+    Json::Value points(Json::objectValue);
+    for (uint32_t i = 0; i < ctl.num_points.load(); ++i) {
+        points[ctl.points[i].name] = ctl.rate_for(&ctl.points[i]);
+    }
+    result["points"] = points;
+    Json::FastWriter writer;
+    return writer.write(result);
+}
+
+// Fragment cache totals over all workers:
+// /admin/fragment_cache -> hits, misses, hitRate, bytesSaved, ...
+std::string adminFragmentCache(const FrontEndService& service) {
+    auto& stats = microservice::frontend::fragment_cache_stats();
+    uint64_t hits = 0, misses = 0, invalidations = 0, evictions = 0, bytes_saved = 0;
+    uint64_t entries = 0, bytes = 0, workers = 0;
+    uint32_t used = std::min(stats.next_slot.load(), microservice::frontend::FragmentCacheStats::kMaxSlots);
+    for (uint32_t i = 0; i < used; ++i) {
+        const auto& slot = stats.slots[i];
+        hits += slot.hits.load();
+        misses += slot.misses.load();
+        invalidations += slot.invalidations.load();
+        evictions += slot.evictions.load();
+        bytes_saved += slot.bytes_saved.load();
+        if (kill(slot.pid.load(), 0) == 0) { // resident size of live workers only
+            entries += slot.entries.load();
+            bytes += slot.bytes.load();
+            workers++;
+        }
+    }
+    Json::Value result;
+    result["enabled"] = service.fragment_cache_.enabled();
+    result["hits"] = Json::UInt64(hits);
+    result["misses"] = Json::UInt64(misses);
+    result["hitRate"] = hits + misses ? static_cast<double>(hits) / (hits + misses) : 0.0;
+    result["invalidations"] = Json::UInt64(invalidations);
+    result["evictions"] = Json::UInt64(evictions);
+    result["bytesSaved"] = Json::UInt64(bytes_saved);
+    result["entries"] = Json::UInt64(entries);
+    result["bytes"] = Json::UInt64(bytes);
+    result["workers"] = Json::UInt64(workers);
+    Json::FastWriter writer;
+    return writer.write(result);
+}
+
+// Response cache totals over all workers:
+// /admin/response_cache -> hits, staleHits, misses, hitRate, evictions, ...
+std::string adminResponseCache() {
+    auto& stats = microservice::frontend::response_cache_stats();
+    uint64_t hits = 0, stale_hits = 0, misses = 0, bypassed = 0, evictions = 0, refreshes = 0;
+    uint64_t entries = 0, bytes = 0, workers = 0;
+    uint32_t used = std::min(stats.next_slot.load(), microservice::frontend::ResponseCacheStats::kMaxSlots);
+    for (uint32_t i = 0; i < used; ++i) {
+        const auto& slot = stats.slots[i];
+        hits += slot.hits.load();
+        stale_hits += slot.stale_hits.load();
+        misses += slot.misses.load();
+        bypassed += slot.bypassed.load();
+        evictions += slot.evictions.load();
+        refreshes += slot.refreshes.load();
+        if (kill(slot.pid.load(), 0) == 0) { // resident size of live workers only
+            entries += slot.entries.load();
+            bytes += slot.bytes.load();
+            workers++;
+        }
+    }
+    const uint64_t lookups = hits + stale_hits + misses;
+    Json::Value result;
+    result["hits"] = Json::UInt64(hits);
+    result["staleHits"] = Json::UInt64(stale_hits);
+    result["misses"] = Json::UInt64(misses);
+    result["bypassed"] = Json::UInt64(bypassed);
+    result["hitRate"] = lookups ? static_cast<double>(hits + stale_hits) / lookups : 0.0;
+    result["evictions"] = Json::UInt64(evictions);
+    result["refreshes"] = Json::UInt64(refreshes);
+    result["entries"] = Json::UInt64(entries);
+    result["bytes"] = Json::UInt64(bytes);
+    result["workers"] = Json::UInt64(workers);
+    Json::FastWriter writer;
+    return writer.write(result);
+}
+
+// Single-flight control and counters, shared by every worker:
+// /admin/singleflight[?route=search&enabled=0|1]
+std::string adminSingleFlight(FrontEndService& service, const std::multimap<std::string, std::string>& params,
+                              int& status) {
+    auto& flights = service.flights();
+    auto route_param = params.find("route");
+    auto enabled_param = params.find("enabled");
+    if (enabled_param != params.end()) {
+        auto* route = route_param == params.end() ? nullptr : flights.route(route_param->second.c_str());
+        if (!route) {
+            status = 400;
+            return "{\"error\": \"Invalid single-flight parameters\"}";
+        }
+        route->enabled.store(enabled_param->second != "0");
+    }
+    Json::Value result(Json::objectValue);
+    for (uint32_t i = 0; i < flights.num_routes(); ++i) {
+        const auto& route = flights.route_at(i);
+        Json::Value r;
+        r["enabled"] = route.enabled.load() != 0;
+        r["leaders"] = Json::UInt64(route.leaders.load());
+        r["followers"] = Json::UInt64(route.followers.load());
+        r["timeouts"] = Json::UInt64(route.timeouts.load());
+        r["failures"] = Json::UInt64(route.failures.load());
+        r["bypassed"] = Json::UInt64(route.bypassed.load());
+        r["coalesceRatio"] = route.coalesce_ratio();
+        result[route.name] = r;
+    }
+    Json::FastWriter writer;
+    return writer.write(result);
+}
+
+// Admission control state and counters, shared by every worker:
+// /admin/admission[?route=search&enabled=0|1]
+std::string adminAdmission(microservice::frontend::AdmissionControl& admission,
+                           const std::multimap<std::string, std::string>& params, int& status) {
+    auto route_param = params.find("route");
+    auto enabled_param = params.find("enabled");
+    if (enabled_param != params.end()) {
+        auto* route = route_param == params.end() ? nullptr : admission.route(route_param->second.c_str());
+        if (!route) {
+            status = 400;
+            return "{\"error\": \"Invalid admission parameters\"}";
+        }
+        route->enabled.store(enabled_param->second != "0");
+    }
+    Json::Value result(Json::objectValue);
+    for (uint32_t i = 0; i < admission.num_routes(); ++i) {
+        const auto& route = admission.route_at(i);
+        Json::Value r;
+        r["enabled"] = route.enabled.load() != 0;
+        r["budgetMs"] = static_cast<double>(route.budget_ns) / 1e6;
+        r["limit"] = route.limit.load();
+        r["inflight"] = route.inflight.load();
+        r["latencyMs"] = static_cast<double>(route.latency_ewma_ns.load()) / 1e6;
+        r["admitted"] = Json::UInt64(route.admitted.load());
+        r["expired"] = Json::UInt64(route.expired.load());
+        r["rejectedLimit"] = Json::UInt64(route.rejected_limit.load());
+        r["rejectedProjected"] = Json::UInt64(route.rejected_projected.load());
+        r["deadlineExceeded"] = Json::UInt64(route.deadline_exceeded.load());
+        r["failed"] = Json::UInt64(route.failed.load());
+        r["goodput"] = Json::UInt64(route.goodput.load());
+        result[route.name] = r;
+    }
+    Json::FastWriter writer;
+    return writer.write(result);
+}
+
+// Status and body for a request admission control turned away: 408 if it
+// arrived past its deadline, 503 (with Retry-After) if it was shed.
+int rejectionStatus(microservice::frontend::AdmissionControl::Decision decision, std::string& body) {
+    if (decision == microservice::frontend::AdmissionControl::Decision::kExpired) {
+        body = "{\"error\": \"Request timeout\"}";
+        return 408;
+    }
+    body = "{\"error\": \"Service overloaded\"}";
+    return 503;
+}
+
+// Accept time of the connection an httplib pool thread is serving, until
+// the connection's first request takes it; requests after it on a
+// keep-alive connection arrive when the thread reads them.
+thread_local uint64_t connection_accepted_ns = 0;
+// Arrival time of the request being handled, set by the pre-routing handler.
+thread_local uint64_t request_arrival_ns = 0;
+
+// httplib's thread pool, stamping each connection with its accept time so
+// the time spent queued for a pool thread counts against the deadline.
+class AcceptTimedTaskQueue : public httplib::TaskQueue {
+public:
+    explicit AcceptTimedTaskQueue(size_t threads) : pool_(threads) {}
+
+    void enqueue(std::function<void()> fn) override {
+        const uint64_t accepted = microservice::utils::monotonic_ns();
+        pool_.enqueue([fn, accepted] {
+            connection_accepted_ns = accepted;
+            fn();
+        });
+    }
+
+    void shutdown() override { pool_.shutdown(); }
+
+private:
+    httplib::ThreadPool pool_;
 };
 
+bool rejected(const microservice::frontend::ScopedAdmission& admission, httplib::Response& res) {
+    if (admission.decision() == microservice::frontend::AdmissionControl::Decision::kAdmitted) return false;
+    std::string body;
+    res.status = rejectionStatus(admission.decision(), body);
+    if (res.status == 503) res.set_header("Retry-After", "1");
+    res.set_content(body, "application/json");
+    return true;
+}
+
+// A request that failed because its deadline passed downstream is answered
+// with 408, as one that expired before it was admitted.
+void finishAdmitted(microservice::frontend::ScopedAdmission& admission,
+                    const FrontEndService::RequestContext& context, httplib::Response& res) {
+    admission.ok = context.ok;
+    if (!context.ok && admission.deadline_passed()) {
+        res.status = 408;
+        res.set_content("{\"error\": \"Request timeout during processing\"}", "application/json");
+    }
+}
+
+// Answers an httplib request with the protobuf passthrough. The routes time
+// it as "<route>_proto", so the difference to "<route>" is what the JSON
+// gateway costs.
+void answerProtobuf(FrontEndService& service, microservice::frontend::AdmissionControl::Route* route,
+                    const char* socket_path, const std::string& serialized, httplib::Response& res) {
+    microservice::frontend::ScopedAdmission admission(route, request_arrival_ns);
+    if (rejected(admission, res)) return;
+    std::string body;
+    res.status = service.Forward(socket_path, serialized, body);
+    admission.ok = res.status == 200;
+    res.set_content(body, admission.ok ? "application/x-protobuf" : "application/json");
+}
+
+// Routes of the reactor server (FRONTEND_SERVER=reactor): the same endpoints
+// and bodies as the httplib routes, but the downstream call runs
+// asynchronously on the worker's event loop, so one worker keeps many
+// requests in flight.
+struct ReactorRoute {
+    const char* path;
+    const char* endpoint;     // timing log name
+    const char* sample_point;
+    const char* proto_endpoint;     // the same for the protobuf passthrough
+    const char* proto_sample_point;
+    const char* socket_path;
+    const char* flight;       // single-flight and response cache route, or nullptr
+    // Binds (GET) or parses (POST) and serializes the downstream request,
+    // cut down to the rendered profile fields if rendered, and sets its
+    // single-flight key; on failure fills error with the response the
+    // httplib route gives.
+    bool (*prepare)(FrontEndService& service, const microservice::frontend::HttpRequest& request, bool rendered,
+                    std::string& serialized, std::string& key, microservice::frontend::HttpResponse& error);
+    std::string (FrontEndService::*finish)(const std::string& response, bool* ok);
+};
+
+template <typename Request,
+          bool (FrontEndService::*Bind)(const httplib::Params&, Request&, const char**),
+          Request (FrontEndService::*Parse)(const Json::Value&)>
+bool prepareRequest(FrontEndService& service, const microservice::frontend::HttpRequest& http, bool rendered,
+                    std::string& serialized, std::string& key, microservice::frontend::HttpResponse& error) {
+    Request request;
+    if (http.method == "POST") {
+        Json::Value json;
+        Json::Reader reader;
+        if (!reader.parse(http.body, json)) {
+            error.body = "{\"error\": \"Invalid JSON format\"}";
+            return false;
+        }
+        request = (service.*Parse)(json);
+    } else {
+        const char* bad_param = "";
+        if (!(service.*Bind)(http.params, request, &bad_param)) {
+            std::cerr << http.path << " request error: invalid parameter " << bad_param << std::endl;
+            error.status = 400;
+            error.body = "{\"error\": \"Invalid request parameters\"}";
+            return false;
+        }
+    }
+    if (rendered) FrontEndService::renderFields(request);
+    serialized = microservice::utils::serialize_message(service.ser1de, request);
+    key = FrontEndService::flightKey(request);
+    return true;
+}
+
+void runReactorWorker(FrontEndService& service, microservice::frontend::AdmissionControl& admission,
+                      int listen_fd) {
+    using namespace microservice::frontend;
+    using microservice::utils::ScopedTrace;
+    using microservice::utils::TraceContext;
+    static const ReactorRoute routes[] = {
+        {"/search", "search", "frontend_search", "search_proto", "frontend_search_proto",
+         "/tmp/search_service.sock", "search",
+         prepareRequest<hotelreservation::SearchRequest, &FrontEndService::bindSearchRequest,
+                        &FrontEndService::parseSearchRequest>,
+         &FrontEndService::FinishSearch},
+        {"/recommend", "recommend", "frontend_recommend", "recommend_proto", "frontend_recommend_proto",
+         "/tmp/recommendation_service.sock", "recommend",
+         prepareRequest<hotelreservation::RecommendRequest, &FrontEndService::bindRecommendRequest,
+                        &FrontEndService::parseRecommendRequest>,
+         &FrontEndService::FinishRecommend},
+        {"/user", "user", "frontend_user", "user_proto", "frontend_user_proto",
+         "/tmp/user_service.sock", nullptr,
+         prepareRequest<hotelreservation::UserRequest, &FrontEndService::bindUserRequest,
+                        &FrontEndService::parseUserRequest>,
+         &FrontEndService::FinishUser},
+        {"/reservation", "reservation", "frontend_reservation", "reservation_proto", "frontend_reservation_proto",
+         "/tmp/reservation_service.sock", nullptr,
+         prepareRequest<hotelreservation::ReservationRequest, &FrontEndService::bindReservationRequest,
+                        &FrontEndService::parseReservationRequest>,
+         &FrontEndService::FinishReservation},
+    };
+    std::vector<std::unique_ptr<microservice::utils::SamplePoint>> sample_points;
+    std::vector<std::unique_ptr<microservice::utils::SamplePoint>> proto_sample_points;
+    std::vector<microservice::utils::SingleFlight::Route*> flight_routes;
+    std::vector<const ResponseCache::Route*> cache_routes;
+    std::vector<AdmissionControl::Route*> admission_routes;
+    for (const auto& route : routes) {
+        sample_points.emplace_back(new microservice::utils::SamplePoint(route.sample_point));
+        proto_sample_points.emplace_back(new microservice::utils::SamplePoint(route.proto_sample_point));
+        admission_routes.push_back(admission.route(route.endpoint));
+        flight_routes.push_back(route.flight ? service.flights().route(route.flight) : nullptr);
+        cache_routes.push_back(route.flight ? service.response_cache_.route(route.flight) : nullptr);
+    }
+    const auto& clock = microservice::utils::TscClock::instance();
+
+    // Single-flight within the reactor: a request whose key is already in
+    // flight on this worker is parked here instead of blocking the loop on
+    // the shared table, and answered with the leader's body (or error).
+    struct Follower {
+        Reactor::Responder responder;
+        TraceContext trace;
+        uint64_t start;
+        const char* cache_status;
+        AdmissionControl::Ticket ticket;
+    };
+    std::unordered_map<std::string, std::vector<Follower>> in_flight;
+
+    Reactor* reactor_ptr = nullptr;
+    Reactor reactor([&](HttpRequest& request, const Reactor::Responder& responder) {
+        HttpResponse response;
+        if (request.method == "GET" && request.path == "/admin/timing") {
+            response.body = adminTiming(request.params, response.status);
+            responder.send(std::move(response));
+            return;
+        }
+        if (request.method == "GET" && request.path == "/admin/fragment_cache") {
+            response.body = adminFragmentCache(service);
+            responder.send(std::move(response));
+            return;
+        }
+        if (request.method == "GET" && request.path == "/admin/singleflight") {
+            response.body = adminSingleFlight(service, request.params, response.status);
+            responder.send(std::move(response));
+            return;
+        }
+        if (request.method == "GET" && request.path == "/admin/response_cache") {
+            response.body = adminResponseCache();
+            responder.send(std::move(response));
+            return;
+        }
+        if (request.method == "GET" && request.path == "/admin/admission") {
+            response.body = adminAdmission(admission, request.params, response.status);
+            responder.send(std::move(response));
+            return;
+        }
+        for (size_t i = 0; i < sizeof(routes) / sizeof(routes[0]); ++i) {
+            const ReactorRoute& route = routes[i];
+            if (request.path != route.path || (request.method != "GET" && request.method != "POST")) {
+                continue;
+            }
+            // Protobuf passthrough: a protobuf body is forwarded as it is, and
+            // a GET accepting protobuf gets the service's response bytes
+            const std::string* content_type = request.header("content-type");
+            const std::string* accept = request.header("accept");
+            const bool proto_body = request.method == "POST" && content_type &&
+                                    FrontEndService::isProtobuf(*content_type);
+            const bool proto = proto_body ||
+                               (request.method == "GET" && accept && FrontEndService::acceptsProtobuf(*accept));
+            const char* endpoint = proto ? route.proto_endpoint : route.endpoint;
+
+            // Head-based sampling decision, as RouteTrace makes it for httplib
+            ScopedTrace scoped(proto ? *proto_sample_points[i] : *sample_points[i]);
+            TraceContext trace = microservice::utils::current_trace();
+            const uint64_t start = trace.sampled ? clock.now() : 0;
+            std::string serialized;
+            std::string key;
+            if (proto_body) {
+                serialized.swap(request.body);
+            } else if (!route.prepare(service, request, !proto, serialized, key, response)) {
+                if (trace.sampled) microservice::utils::log_request_timing(endpoint, start, clock.now_end());
+                responder.send(std::move(response));
+                return;
+            }
+            // Admission control (admission_control.h); the deadline travels
+            // with the downstream call in the trace context.
+            AdmissionControl::Ticket ticket;
+            const AdmissionControl::Decision decision =
+                AdmissionControl::admit(admission_routes[i], request.arrival_ns, ticket);
+            if (decision != AdmissionControl::Decision::kAdmitted) {
+                response.status = rejectionStatus(decision, response.body);
+                if (response.status == 503) response.headers = "Retry-After: 1\r\n";
+                if (trace.sampled) microservice::utils::log_request_timing(endpoint, start, clock.now_end());
+                responder.send(std::move(response));
+                return;
+            }
+            trace.deadline_ns = ticket.deadline_ns;
+
+            // Passthrough bypasses the response cache and single-flight,
+            // which key and store rendered JSON.
+            if (proto) {
+                reactor_ptr->call(route.socket_path, serialized, trace,
+                                  [&clock, endpoint, trace, start, responder, ticket](
+                                      microservice::rpc::CallStatus status, std::string& payload) {
+                    ScopedTrace resumed(trace);
+                    HttpResponse result;
+                    result.status = FrontEndService::forwardStatus(status);
+                    if (result.status == 200) {
+                        result.body.swap(payload);
+                        result.content_type = "application/x-protobuf";
+                    } else {
+                        result.body = FrontEndService::callError(status);
+                    }
+                    const bool ok = result.status == 200;
+                    if (trace.sampled) microservice::utils::log_request_timing(endpoint, start, clock.now_end());
+                    responder.send(std::move(result));
+                    AdmissionControl::release(ticket, ok);
+                });
+                return;
+            }
+            // Response cache (response_cache.h); a stale hit is answered
+            // right away and revalidated with an unsampled call.
+            const ResponseCache::Route* cache_route = key.empty() ? nullptr : cache_routes[i];
+            const char* cache_status = nullptr;
+            if (cache_route) {
+                const std::string* cache_control = request.header("cache-control");
+                if (cache_control && FrontEndService::bypassCache(*cache_control)) {
+                    service.response_cache_.record_bypass();
+                    cache_status = "BYPASS";
+                } else {
+                    const ResponseCache::Lookup lookup = service.response_cache_.get(cache_route, key, response.body);
+                    if (lookup != ResponseCache::Lookup::kMiss) {
+                        response.headers = lookup == ResponseCache::Lookup::kFresh ? "X-Cache: HIT\r\n"
+                                                                                 : "X-Cache: STALE\r\n";
+                        if (trace.sampled) microservice::utils::log_request_timing(route.endpoint, start, clock.now_end());
+                        responder.send(std::move(response));
+                        AdmissionControl::release(ticket, true);
+                        if (lookup == ResponseCache::Lookup::kStale) {
+                            reactor_ptr->call(route.socket_path, serialized, TraceContext(),
+                                              [&service, &route, cache_route, key](
+                                                  microservice::rpc::CallStatus status, std::string& payload) {
+                                bool ok = false;
+                                std::string body;
+                                if (status == microservice::rpc::CallStatus::kOk) {
+                                    body = (service.*route.finish)(payload, &ok);
+                                }
+                                if (ok) {
+                                    service.response_cache_.put(cache_route, key, body);
+                                } else {
+                                    service.response_cache_.refresh_failed(cache_route, key);
+                                }
+                            });
+                        }
+                        return;
+                    }
+                    cache_status = "MISS";
+                }
+            }
+
+            microservice::utils::SingleFlight::Route* flight = flight_routes[i];
+            std::string flight_key;
+            if (microservice::utils::SingleFlight::enabled(flight) && !key.empty()) {
+                auto joined = in_flight.find(key);
+                if (joined != in_flight.end()) {
+                    joined->second.push_back(Follower{responder, trace, start, cache_status, ticket});
+                    flight->followers.fetch_add(1, std::memory_order_relaxed);
+                    return;
+                }
+                in_flight[key];
+                flight->leaders.fetch_add(1, std::memory_order_relaxed);
+                flight_key = key;
+            }
+            reactor_ptr->call(route.socket_path, serialized, trace,
+                              [&service, &route, &clock, &in_flight, flight_key, cache_route, key, cache_status,
+                               trace, start, responder, ticket](
+                                  microservice::rpc::CallStatus status, std::string& payload) {
+                std::vector<Follower> followers;
+                if (!flight_key.empty()) {
+                    auto joined = in_flight.find(flight_key);
+                    followers.swap(joined->second);
+                    in_flight.erase(joined);
+                }
+                ScopedTrace resumed(trace);
+                HttpResponse result;
+                bool ok = false;
+                if (status == microservice::rpc::CallStatus::kOk) {
+                    result.body = (service.*route.finish)(payload, &ok);
+                } else {
+                    result.body = (service.*route.finish)(FrontEndService::callError(status), nullptr);
+                }
+                if (cache_route && ok) service.response_cache_.put(cache_route, key, result.body);
+                if (cache_status) result.headers = std::string("X-Cache: ") + cache_status + "\r\n";
+                if (!ok && microservice::utils::deadline_passed(trace)) {
+                    result.status = 408;
+                    result.body = "{\"error\": \"Request timeout during processing\"}";
+                }
+                if (trace.sampled) microservice::utils::log_request_timing(route.endpoint, start, clock.now_end());
+                for (const Follower& follower : followers) {
+                    HttpResponse copy;
+                    copy.status = result.status;
+                    copy.body = result.body;
+                    if (follower.cache_status) {
+                        copy.headers = std::string("X-Cache: ") + follower.cache_status + "\r\n";
+                    }
+                    if (follower.trace.sampled) {
+                        ScopedTrace follower_trace(follower.trace);
+                        microservice::utils::log_request_timing(route.endpoint, follower.start, clock.now_end());
+                    }
+                    follower.responder.send(std::move(copy));
+                    AdmissionControl::release(follower.ticket, ok);
+                }
+                responder.send(std::move(result));
+                AdmissionControl::release(ticket, ok);
+            });
+            return;
+        }
+        response.status = 404;
+        responder.send(std::move(response));
+    });
+    reactor_ptr = &reactor;
+    // Micro-batching (RPC_BATCH): the reactor's window is one loop pass
+    for (const auto& route : routes) {
+        if (service.batching().enabled(route.endpoint)) {
+            reactor.batch_calls(route.socket_path, service.batching().max_items);
+        }
+    }
+
+    if (!reactor.listen(listen_fd)) {
+        std::cerr << "Reactor worker " << getpid() << " failed to listen" << std::endl;
+        return;
+    }
+    std::cout << "Reactor worker " << getpid() << " listening on 0.0.0.0:50050" << std::endl;
+    reactor.run();
+}
+
+// FRONTEND_REACTORS, or one reactor per pinned core (FRONTEND_CPUS), or
+// one per CPU this process may run on.
+int reactorCount(const std::vector<int>& cpus) {
+    if (const char* env = getenv("FRONTEND_REACTORS")) {
+        int n = atoi(env);
+        if (n > 0) return n;
+    }
+    if (!cpus.empty()) return static_cast<int>(cpus.size());
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0 && CPU_COUNT(&set) > 0) {
+        return CPU_COUNT(&set);
+    }
+    return static_cast<int>(sysconf(_SC_NPROCESSORS_ONLN));
+}
+
 int main() {
-    const int NUM_WORKERS = FrontEndService::POOL_SIZE;
+    // FRONTEND_SERVER=reactor runs one epoll reactor per core instead of
+    // POOL_SIZE httplib processes
+    const char* server_mode = getenv("FRONTEND_SERVER");
+    const bool use_reactor = server_mode && strcmp(server_mode, "reactor") == 0;
+    // FRONTEND_CPUS pins worker i to the i-th listed core (modulo the list)
+    const std::vector<int> cpus = microservice::frontend::frontend_cpus();
+    const int NUM_WORKERS = use_reactor ? reactorCount(cpus) : FrontEndService::POOL_SIZE;
     
     PreforkHTTPServer server(NUM_WORKERS);
+    microservice::utils::SingleFlight flights("frontend", {"search", "recommend"});
+    microservice::frontend::AdmissionControl admission(
+        {{"search", 10}, {"recommend", 100}, {"user", 100}, {"reservation", 100}});
+
+    // Reactors get one listener each, opened here so that pinned reactors
+    // can be steered the connections their core receives (core_listeners.h;
+    // FRONTEND_STEERING=0 leaves the choice to the kernel's hash)
+    microservice::frontend::CoreListeners listeners;
+    if (use_reactor) {
+        std::vector<int> listener_cpus;
+        for (int i = 0; !cpus.empty() && i < NUM_WORKERS; ++i) listener_cpus.push_back(cpus[i % cpus.size()]);
+        const char* steering_env = getenv("FRONTEND_STEERING");
+        const bool steer = !cpus.empty() && !(steering_env && strcmp(steering_env, "0") == 0);
+        if (!listeners.open("0.0.0.0", 50050, NUM_WORKERS, listener_cpus, steer)) return 1;
+        if (listeners.steering()) std::cout << "Steering connections to the reactor of their CPU" << std::endl;
+    }
     
     // Fork worker processes
-    if (server.fork_workers()) {
+    if (!server.fork_workers()) {
+        // This is the master process. master_loop() also returns in a worker
+        // it restarted, which then serves like the others.
+        std::cout << "Frontend service master process started with " << NUM_WORKERS << " HTTP workers" << std::endl;
+        // A dead worker's admitted requests are never released
+        server.master_loop([&admission](int index) { admission.reclaim_worker(index); });
+        if (server.worker_index() < 0) return 0;
+    }
+
+    {
         // This is a worker process
-        FrontEndService service;
+        if (!cpus.empty()) microservice::frontend::pin_to_cpu(cpus[server.worker_index() % cpus.size()]);
+        microservice::frontend::AdmissionControl::set_worker(server.worker_index());
+        FrontEndService service(flights);
+
+        if (use_reactor) {
+            runReactorWorker(service, admission, listeners.take(server.worker_index()));
+            return 0;
+        }
         
         // Set up HTTP server for this worker
         httplib::Server svr;
@@ -334,41 +1349,49 @@ int main() {
         svr.set_idle_interval(0, 100000);
         svr.set_payload_max_length(1024 * 1024);  // 1MB max payload
 
+        // Deadlines run from accept (or, on a kept-alive connection, read)
+        // time, so a request that queued too long is refused before any work
+        svr.new_task_queue = [] { return new AcceptTimedTaskQueue(CPPHTTPLIB_THREAD_POOL_COUNT); };
+        svr.set_pre_routing_handler([](const httplib::Request&, httplib::Response&) {
+            request_arrival_ns = connection_accepted_ns ? connection_accepted_ns : microservice::utils::monotonic_ns();
+            connection_accepted_ns = 0;
+            return httplib::Server::HandlerResponse::Unhandled;
+        });
+        using microservice::frontend::ScopedAdmission;
+        auto* search_admission = admission.route("search");
+        auto* recommend_admission = admission.route("recommend");
+        auto* user_admission = admission.route("user");
+        auto* reservation_admission = admission.route("reservation");
+
         svr.Get("/search", [&](const httplib::Request& req, httplib::Response& res) {
-            auto start_time = std::chrono::steady_clock::now();
-            
-            auto check_timeout = [&start_time]() -> bool {
-                auto current_time = std::chrono::steady_clock::now();
-                auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
-                    current_time - start_time).count();
-                return elapsed > 10; // 10ms timeout
-            };
-
-            if (check_timeout()) {
-                std::cerr << "Search request timeout - Request took too long to process" << std::endl;
-                res.status = 408;
-                res.set_content("{\"error\": \"Request timeout\"}", "application/json");
-                return;
-            }
+            static microservice::utils::SamplePoint sample_point("frontend_search");
+            static microservice::utils::SamplePoint proto_point("frontend_search_proto");
+            const bool proto = FrontEndService::acceptsProtobuf(req.get_header_value("Accept"));
+            RouteTrace route_trace(proto ? proto_point : sample_point, proto ? "search_proto" : "search");
 
             try {
-                Json::Value json;
-                json["customerName"] = req.get_param_value("customerName");
-                json["inDate"] = req.get_param_value("inDate");
-                json["outDate"] = req.get_param_value("outDate");
-                json["latitude"] = std::stod(req.get_param_value("latitude"));
-                json["longitude"] = std::stod(req.get_param_value("longitude"));
-                json["locale"] = req.get_param_value("locale");    
-
-                if (check_timeout()) {
-                    std::cerr << "Search request timeout during parameter processing" << std::endl;
-                    res.status = 408;
-                    res.set_content("{\"error\": \"Request timeout during processing\"}", "application/json");
+                hotelreservation::SearchRequest search_req;
+                const char* bad_param = "";
+                if (!service.bindSearchRequest(req.params, search_req, &bad_param)) {
+                    std::cerr << "Search request error: invalid parameter " << bad_param << std::endl;
+                    res.status = 400;
+                    res.set_content("{\"error\": \"Invalid request parameters\"}", "application/json");
                     return;
                 }
 
-                Json::FastWriter writer;
-                res.set_content(service.HandleSearch(writer.write(json)), "application/json");
+                if (proto) {
+                    answerProtobuf(service, search_admission, "/tmp/search_service.sock",
+                                   microservice::utils::serialize_message(service.ser1de, search_req), res);
+                    return;
+                }
+
+                ScopedAdmission admission(search_admission, request_arrival_ns);
+                if (rejected(admission, res)) return;
+                FrontEndService::RequestContext context;
+                context.bypass_cache = FrontEndService::bypassCache(req.get_header_value("Cache-Control"));
+                res.set_content(service.HandleSearch(std::move(search_req), &context), "application/json");
+                if (context.cache_status) res.set_header("X-Cache", context.cache_status);
+                finishAdmitted(admission, context, res);
             } catch (const std::exception& e) {
                 std::cerr << "Search request error: " << e.what() << std::endl;
                 res.status = 400;
@@ -377,38 +1400,34 @@ int main() {
         });
 
         svr.Get("/recommend", [&](const httplib::Request& req, httplib::Response& res) {
-            auto start_time = std::chrono::steady_clock::now();
-            
-            auto check_timeout = [&start_time]() -> bool {
-                auto current_time = std::chrono::steady_clock::now();
-                auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
-                    current_time - start_time).count();
-                return elapsed > 100;
-            };
-
-            if (check_timeout()) {
-                std::cerr << "Recommend request timeout - Request took too long to process" << std::endl;
-                res.status = 408;
-                res.set_content("{\"error\": \"Request timeout\"}", "application/json");
-                return;
-            }
+            static microservice::utils::SamplePoint sample_point("frontend_recommend");
+            static microservice::utils::SamplePoint proto_point("frontend_recommend_proto");
+            const bool proto = FrontEndService::acceptsProtobuf(req.get_header_value("Accept"));
+            RouteTrace route_trace(proto ? proto_point : sample_point, proto ? "recommend_proto" : "recommend");
 
             try {
-                Json::Value json;
-                json["latitude"] = std::stod(req.get_param_value("latitude"));
-                json["longitude"] = std::stod(req.get_param_value("longitude"));
-                json["require"] = req.get_param_value("require");
-                json["locale"] = req.get_param_value("locale");
-
-                if (check_timeout()) {
-                    std::cerr << "Recommend request timeout during parameter processing" << std::endl;
-                    res.status = 408;
-                    res.set_content("{\"error\": \"Request timeout during processing\"}", "application/json");
+                hotelreservation::RecommendRequest recommend_req;
+                const char* bad_param = "";
+                if (!service.bindRecommendRequest(req.params, recommend_req, &bad_param)) {
+                    std::cerr << "Recommend request error: invalid parameter " << bad_param << std::endl;
+                    res.status = 400;
+                    res.set_content("{\"error\": \"Invalid request parameters\"}", "application/json");
                     return;
                 }
-                
-                Json::FastWriter writer;
-                res.set_content(service.HandleRecommend(writer.write(json)), "application/json");
+
+                if (proto) {
+                    answerProtobuf(service, recommend_admission, "/tmp/recommendation_service.sock",
+                                   microservice::utils::serialize_message(service.ser1de, recommend_req), res);
+                    return;
+                }
+
+                ScopedAdmission admission(recommend_admission, request_arrival_ns);
+                if (rejected(admission, res)) return;
+                FrontEndService::RequestContext context;
+                context.bypass_cache = FrontEndService::bypassCache(req.get_header_value("Cache-Control"));
+                res.set_content(service.HandleRecommend(std::move(recommend_req), &context), "application/json");
+                if (context.cache_status) res.set_header("X-Cache", context.cache_status);
+                finishAdmitted(admission, context, res);
             } catch (const std::exception& e) {
                 std::cerr << "Recommend request error: " << e.what() << std::endl;
                 res.status = 400;
@@ -417,36 +1436,32 @@ int main() {
         });
 
         svr.Get("/user", [&](const httplib::Request& req, httplib::Response& res) {
-            auto start_time = std::chrono::steady_clock::now();
-            
-            auto check_timeout = [&start_time]() -> bool {
-                auto current_time = std::chrono::steady_clock::now();
-                auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
-                    current_time - start_time).count();
-                return elapsed > 100;
-            };
-
-            if (check_timeout()) {
-                std::cerr << "User request timeout - Request took too long to process" << std::endl;
-                res.status = 408;
-                res.set_content("{\"error\": \"Request timeout\"}", "application/json");
-                return;
-            }
+            static microservice::utils::SamplePoint sample_point("frontend_user");
+            static microservice::utils::SamplePoint proto_point("frontend_user_proto");
+            const bool proto = FrontEndService::acceptsProtobuf(req.get_header_value("Accept"));
+            RouteTrace route_trace(proto ? proto_point : sample_point, proto ? "user_proto" : "user");
 
             try {
-                Json::Value json;
-                json["username"] = req.get_param_value("username");
-                json["password"] = req.get_param_value("password");
-
-                if (check_timeout()) {
-                    std::cerr << "User request timeout during parameter processing" << std::endl;
-                    res.status = 408;
-                    res.set_content("{\"error\": \"Request timeout during processing\"}", "application/json");
+                hotelreservation::UserRequest user_req;
+                const char* bad_param = "";
+                if (!service.bindUserRequest(req.params, user_req, &bad_param)) {
+                    std::cerr << "User request error: invalid parameter " << bad_param << std::endl;
+                    res.status = 400;
+                    res.set_content("{\"error\": \"Invalid request parameters\"}", "application/json");
                     return;
                 }
-                
-                Json::FastWriter writer;
-                res.set_content(service.HandleUser(writer.write(json)), "application/json");
+
+                if (proto) {
+                    answerProtobuf(service, user_admission, "/tmp/user_service.sock",
+                                   microservice::utils::serialize_message(service.ser1de, user_req), res);
+                    return;
+                }
+
+                ScopedAdmission admission(user_admission, request_arrival_ns);
+                if (rejected(admission, res)) return;
+                FrontEndService::RequestContext context;
+                res.set_content(service.HandleUser(user_req, &context), "application/json");
+                finishAdmitted(admission, context, res);
             } catch (const std::exception& e) {
                 std::cerr << "User request error: " << e.what() << std::endl;
                 res.status = 400;
@@ -455,41 +1470,32 @@ int main() {
         });
 
         svr.Get("/reservation", [&](const httplib::Request& req, httplib::Response& res) {
-            auto start_time = std::chrono::steady_clock::now();
-            
-            auto check_timeout = [&start_time]() -> bool {
-                auto current_time = std::chrono::steady_clock::now();
-                auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
-                    current_time - start_time).count();
-                return elapsed > 100;
-            };
-
-            if (check_timeout()) {
-                std::cerr << "Reservation request timeout - Request took too long to process" << std::endl;
-                res.status = 408;
-                res.set_content("{\"error\": \"Request timeout\"}", "application/json");
-                return;
-            }
+            static microservice::utils::SamplePoint sample_point("frontend_reservation");
+            static microservice::utils::SamplePoint proto_point("frontend_reservation_proto");
+            const bool proto = FrontEndService::acceptsProtobuf(req.get_header_value("Accept"));
+            RouteTrace route_trace(proto ? proto_point : sample_point, proto ? "reservation_proto" : "reservation");
 
             try {
-                Json::Value json;
-                json["customerName"] = req.get_param_value("customerName");
-                json["hotelId"] = req.get_param_value("hotelId");
-                json["inDate"] = req.get_param_value("inDate");
-                json["outDate"] = req.get_param_value("outDate");
-                json["roomNumber"] = std::stoi(req.get_param_value("roomNumber"));
-                json["username"] = req.get_param_value("username");
-                json["password"] = req.get_param_value("password");
-
-                if (check_timeout()) {
-                    std::cerr << "Reservation request timeout during parameter processing" << std::endl;
-                    res.status = 408;
-                    res.set_content("{\"error\": \"Request timeout during processing\"}", "application/json");
+                hotelreservation::ReservationRequest reservation_req;
+                const char* bad_param = "";
+                if (!service.bindReservationRequest(req.params, reservation_req, &bad_param)) {
+                    std::cerr << "Reservation request error: invalid parameter " << bad_param << std::endl;
+                    res.status = 400;
+                    res.set_content("{\"error\": \"Invalid request parameters\"}", "application/json");
                     return;
                 }
-                
-                Json::FastWriter writer;
-                res.set_content(service.HandleReservation(writer.write(json)), "application/json");
+
+                if (proto) {
+                    answerProtobuf(service, reservation_admission, "/tmp/reservation_service.sock",
+                                   microservice::utils::serialize_message(service.ser1de, reservation_req), res);
+                    return;
+                }
+
+                ScopedAdmission admission(reservation_admission, request_arrival_ns);
+                if (rejected(admission, res)) return;
+                FrontEndService::RequestContext context;
+                res.set_content(service.HandleReservation(reservation_req, &context), "application/json");
+                finishAdmitted(admission, context, res);
             } catch (const std::exception& e) {
                 std::cerr << "Reservation request error: " << e.what() << std::endl;
                 res.status = 400;
@@ -497,14 +1503,100 @@ int main() {
             }
         });
 
+        // JSON-body variants of the routes above, for POST clients, and the
+        // protobuf passthrough for internal callers (application/x-protobuf)
+        svr.Post("/search", [&](const httplib::Request& req, httplib::Response& res) {
+            static microservice::utils::SamplePoint sample_point("frontend_search");
+            static microservice::utils::SamplePoint proto_point("frontend_search_proto");
+            const bool proto = FrontEndService::isProtobuf(req.get_header_value("Content-Type"));
+            RouteTrace route_trace(proto ? proto_point : sample_point, proto ? "search_proto" : "search");
+            if (proto) {
+                answerProtobuf(service, search_admission, "/tmp/search_service.sock", req.body, res);
+                return;
+            }
+            ScopedAdmission admission(search_admission, request_arrival_ns);
+            if (rejected(admission, res)) return;
+            FrontEndService::RequestContext context;
+            context.bypass_cache = FrontEndService::bypassCache(req.get_header_value("Cache-Control"));
+            res.set_content(service.HandleSearch(req.body, &context), "application/json");
+            if (context.cache_status) res.set_header("X-Cache", context.cache_status);
+            finishAdmitted(admission, context, res);
+        });
+
+        svr.Post("/recommend", [&](const httplib::Request& req, httplib::Response& res) {
+            static microservice::utils::SamplePoint sample_point("frontend_recommend");
+            static microservice::utils::SamplePoint proto_point("frontend_recommend_proto");
+            const bool proto = FrontEndService::isProtobuf(req.get_header_value("Content-Type"));
+            RouteTrace route_trace(proto ? proto_point : sample_point, proto ? "recommend_proto" : "recommend");
+            if (proto) {
+                answerProtobuf(service, recommend_admission, "/tmp/recommendation_service.sock", req.body, res);
+                return;
+            }
+            ScopedAdmission admission(recommend_admission, request_arrival_ns);
+            if (rejected(admission, res)) return;
+            FrontEndService::RequestContext context;
+            context.bypass_cache = FrontEndService::bypassCache(req.get_header_value("Cache-Control"));
+            res.set_content(service.HandleRecommend(req.body, &context), "application/json");
+            if (context.cache_status) res.set_header("X-Cache", context.cache_status);
+            finishAdmitted(admission, context, res);
+        });
+
+        svr.Post("/user", [&](const httplib::Request& req, httplib::Response& res) {
+            static microservice::utils::SamplePoint sample_point("frontend_user");
+            static microservice::utils::SamplePoint proto_point("frontend_user_proto");
+            const bool proto = FrontEndService::isProtobuf(req.get_header_value("Content-Type"));
+            RouteTrace route_trace(proto ? proto_point : sample_point, proto ? "user_proto" : "user");
+            if (proto) {
+                answerProtobuf(service, user_admission, "/tmp/user_service.sock", req.body, res);
+                return;
+            }
+            ScopedAdmission admission(user_admission, request_arrival_ns);
+            if (rejected(admission, res)) return;
+            FrontEndService::RequestContext context;
+            res.set_content(service.HandleUser(req.body, &context), "application/json");
+            finishAdmitted(admission, context, res);
+        });
+
+        svr.Post("/reservation", [&](const httplib::Request& req, httplib::Response& res) {
+            static microservice::utils::SamplePoint sample_point("frontend_reservation");
+            static microservice::utils::SamplePoint proto_point("frontend_reservation_proto");
+            const bool proto = FrontEndService::isProtobuf(req.get_header_value("Content-Type"));
+            RouteTrace route_trace(proto ? proto_point : sample_point, proto ? "reservation_proto" : "reservation");
+            if (proto) {
+                answerProtobuf(service, reservation_admission, "/tmp/reservation_service.sock", req.body, res);
+                return;
+            }
+            ScopedAdmission admission(reservation_admission, request_arrival_ns);
+            if (rejected(admission, res)) return;
+            FrontEndService::RequestContext context;
+            res.set_content(service.HandleReservation(req.body, &context), "application/json");
+            finishAdmitted(admission, context, res);
+        });
+
+        // Runtime timing control: /admin/timing?enabled=0|1&rate=N[&point=frontend_search]
+        svr.Get("/admin/timing", [&](const httplib::Request& req, httplib::Response& res) {
+            res.set_content(adminTiming(req.params, res.status), "application/json");
+        });
+
+        svr.Get("/admin/fragment_cache", [&](const httplib::Request&, httplib::Response& res) {
+            res.set_content(adminFragmentCache(service), "application/json");
+        });
+
+        svr.Get("/admin/singleflight", [&](const httplib::Request& req, httplib::Response& res) {
+            res.set_content(adminSingleFlight(service, req.params, res.status), "application/json");
+        });
+
+        svr.Get("/admin/response_cache", [&](const httplib::Request&, httplib::Response& res) {
+            res.set_content(adminResponseCache(), "application/json");
+        });
+
+        svr.Get("/admin/admission", [&](const httplib::Request& req, httplib::Response& res) {
+            res.set_content(adminAdmission(admission, req.params, res.status), "application/json");
+        });
+
         std::cout << "HTTP Worker " << getpid() << " listening on 0.0.0.0:50050" << std::endl;
         svr.listen("0.0.0.0", 50050);
         
-        return 0;
-    } else {
-        // This is the master process
-        std::cout << "Frontend service master process started with " << NUM_WORKERS << " HTTP workers" << std::endl;
-        server.master_loop();
         return 0;
     }
 }
\ No newline at end of file
@@ -0,0 +1,795 @@
+#pragma once
+
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "rpc_utils.h"
+#include "trace_utils.h"
+
+namespace microservice {
+namespace frontend {
+
+// Single-threaded epoll HTTP/1.1 server with asynchronous UDS calls to the
+// downstream services, used by the frontend when FRONTEND_SERVER=reactor.
+//
+// One reactor runs per worker process (one worker per core). Connections are
+// kept alive, requests are parsed incrementally and may be pipelined; their
+// responses are queued per connection and written in request order, so a
+// slow /search does not block parsing of the requests behind it. A handler
+// receives a Responder and may complete it later, typically from the
+// callback of call(), which runs the frame exchange of rpc_utils.h on a
+// non-blocking socket driven by the same event loop.
+struct HttpRequest {
+    std::string method;
+    std::string path;
+    std::multimap<std::string, std::string> params; // decoded query string
+    std::multimap<std::string, std::string> headers; // names lower-cased
+    std::string body;
+    uint64_t arrival_ns = 0; // utils::monotonic_ns() when the request was read
+
+    const std::string* header(const char* name) const {
+        auto it = headers.find(name);
+        return it == headers.end() ? nullptr : &it->second;
+    }
+};
+
+struct HttpResponse {
+    int status = 200;
+    std::string body;
+    const char* content_type = "application/json";
+    std::string headers; // extra "Name: value\r\n" lines
+};
+
+class Reactor {
+public:
+    static constexpr size_t kMaxHeaderBytes = 64 * 1024;
+    static constexpr size_t kMaxBodyBytes = 1024 * 1024; // as svr.set_payload_max_length
+    static constexpr size_t kMaxPipelined = 64;          // queued responses per connection
+    static constexpr int kIdleTimeoutSec = 5;            // as svr.set_read_timeout
+
+    class Responder {
+    public:
+        void send(HttpResponse&& response) const { reactor_->complete(conn_id_, seq_, std::move(response)); }
+
+    private:
+        friend class Reactor;
+        Responder(Reactor* reactor, uint64_t conn_id, uint64_t seq)
+            : reactor_(reactor), conn_id_(conn_id), seq_(seq) {}
+        Reactor* reactor_;
+        uint64_t conn_id_;
+        uint64_t seq_;
+    };
+
+    using Handler = std::function<void(HttpRequest& request, const Responder& responder)>;
+    using CallCallback = std::function<void(rpc::CallStatus status, std::string& response)>;
+
+    explicit Reactor(Handler handler) : handler_(std::move(handler)) {
+        epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    }
+
+    ~Reactor() {
+        if (listen_fd_ >= 0) close(listen_fd_);
+        if (epoll_fd_ >= 0) close(epoll_fd_);
+    }
+
+    Reactor(const Reactor&) = delete;
+    Reactor& operator=(const Reactor&) = delete;
+
+    // Serves connections accepted on listen_fd, a non-blocking listening
+    // socket of its own (core_listeners.h), which the reactor then owns.
+    bool listen(int listen_fd) {
+        if (listen_fd < 0) return false;
+        listen_fd_ = listen_fd;
+        listener_.kind = Handle::kListener;
+        return add(listen_fd_, &listener_, EPOLLIN);
+    }
+
+    // Runs the event loop; returns only if epoll fails.
+    void run() {
+        epoll_event events[256];
+        time_t last_sweep = now_sec();
+        while (true) {
+            int n = epoll_wait(epoll_fd_, events, 256, wait_timeout_ms());
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                perror("epoll_wait");
+                return;
+            }
+            for (int i = 0; i < n; ++i) {
+                Handle* h = static_cast<Handle*>(events[i].data.ptr);
+                if (h->kind == Handle::kListener) {
+                    accept_all();
+                } else if (h->kind == Handle::kConnection) {
+                    on_connection(static_cast<Connection*>(h), events[i].events);
+                } else {
+                    on_call(static_cast<Call*>(h), events[i].events);
+                }
+            }
+            flush_batches();
+            expire_calls();
+            flush_dirty();
+            time_t now = now_sec();
+            if (now != last_sweep) {
+                last_sweep = now;
+                sweep_idle(now);
+            }
+        }
+    }
+
+    // Sends payload as a request frame to the service listening on path and
+    // invokes done with the response once it arrives, or with the error.
+    // trace is carried in the frame header as by rpc::write_request(); a call
+    // still unanswered at trace.deadline_ns fails with kDeadlineExceeded.
+    void call(const std::string& path, const std::string& payload,
+              const utils::TraceContext& trace, CallCallback done) {
+        if (utils::deadline_passed(trace)) {
+            fail(done, rpc::CallStatus::kDeadlineExceeded);
+            return;
+        }
+        if (!batch_limits_.empty()) {
+            auto limit = batch_limits_.find(path);
+            if (limit != batch_limits_.end()) {
+                queue_batched(path, limit->second, payload, trace, std::move(done));
+                return;
+            }
+        }
+        start_call(path, payload, trace, std::move(done), 0);
+    }
+
+    // Calls to path made during one pass of the event loop go out together
+    // as kFlagBatch frames (rpc_utils.h) of up to max_items calls, sent when
+    // the pass ends or the batch is full. The batch waits as long as its
+    // most patient call; a call whose own deadline passed by the time the
+    // batch is answered fails with kDeadlineExceeded.
+    void batch_calls(const std::string& path, size_t max_items) {
+        if (max_items > 1) batch_limits_[path] = max_items;
+    }
+
+    size_t connections() const { return conns_.size(); }
+
+private:
+    struct Handle {
+        enum Kind { kListener, kConnection, kCall } kind;
+    };
+
+    struct Pending {
+        bool done = false;
+        bool keep_alive = true;
+        std::string data; // serialized HTTP response
+    };
+
+    struct Connection : Handle {
+        int fd = -1;
+        uint64_t id = 0;
+        std::string in;
+        size_t in_off = 0;
+        std::string out;
+        size_t out_off = 0;
+        std::deque<Pending> pending;
+        uint64_t first_seq = 0; // seq of pending.front()
+        uint64_t next_seq = 0;
+        bool close_after = false; // stop reading; close once pending drains
+        bool read_paused = false; // pipeline full, see update_reading()
+        bool dirty = false;
+        bool writable_armed = false;
+        time_t last_active = 0;
+    };
+
+    struct Call;
+    using DeadlineMap = std::multimap<uint64_t, Call*>;
+
+    struct Call : Handle {
+        int fd = -1;
+        std::string out;
+        size_t off = 0;
+        std::string in;
+        CallCallback done;
+        DeadlineMap::iterator deadline;
+        bool has_deadline = false;
+    };
+
+    // Calls queued by batch_calls() for the end of the loop pass.
+    struct OpenBatch {
+        utils::TraceContext trace; // merged, rpc::merge_batch_trace()
+        std::vector<std::string> payloads;
+        std::vector<uint64_t> deadlines;
+        std::vector<CallCallback> dones;
+    };
+
+    Handler handler_;
+    int epoll_fd_ = -1;
+    int listen_fd_ = -1;
+    Handle listener_;
+    uint64_t next_conn_id_ = 1;
+    std::unordered_map<uint64_t, Connection*> conns_;
+    std::vector<Connection*> dirty_;
+    DeadlineMap deadlines_; // calls with a deadline, earliest first
+    std::unordered_map<std::string, size_t> batch_limits_; // batch_calls()
+    std::map<std::string, OpenBatch> open_batches_;
+    size_t queued_ = 0; // calls in open_batches_
+
+    static time_t now_sec() {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+        return ts.tv_sec;
+    }
+
+    bool add(int fd, Handle* h, uint32_t events) {
+        epoll_event ev{};
+        ev.events = events;
+        ev.data.ptr = h;
+        return epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) == 0;
+    }
+
+    void modify(int fd, Handle* h, uint32_t events) {
+        epoll_event ev{};
+        ev.events = events;
+        ev.data.ptr = h;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &ev);
+    }
+
+    void accept_all() {
+        while (true) {
+            int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno == EINTR) continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK) perror("accept4");
+                return;
+            }
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            Connection* c = new Connection();
+            c->kind = Handle::kConnection;
+            c->fd = fd;
+            c->id = next_conn_id_++;
+            c->last_active = now_sec();
+            conns_[c->id] = c;
+            add(fd, c, EPOLLIN | EPOLLRDHUP);
+        }
+    }
+
+    void close_connection(Connection* c) {
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, c->fd, nullptr);
+        close(c->fd);
+        conns_.erase(c->id);
+        // Completions for its in-flight requests find no connection and are
+        // dropped; a dirty_ entry is skipped by id.
+        for (auto& d : dirty_) {
+            if (d == c) d = nullptr;
+        }
+        delete c;
+    }
+
+    void on_connection(Connection* c, uint32_t events) {
+        c->last_active = now_sec();
+        if (events & (EPOLLERR | EPOLLHUP)) {
+            close_connection(c);
+            return;
+        }
+        if (events & EPOLLOUT) {
+            if (!write_connection(c)) return;
+        }
+        if (events & (EPOLLIN | EPOLLRDHUP)) {
+            if (!read_connection(c)) return;
+            parse_requests(c);
+        }
+    }
+
+    // false if the connection was closed
+    bool read_connection(Connection* c) {
+        char buf[16384];
+        while (true) {
+            ssize_t n = read(c->fd, buf, sizeof(buf));
+            if (n > 0) {
+                c->in.append(buf, n);
+                if (static_cast<size_t>(n) < sizeof(buf)) return true;
+                // The rest waits in the socket until parse_requests() makes
+                // room; more than one largest request is never buffered.
+                if (c->in.size() - c->in_off > kMaxHeaderBytes + kMaxBodyBytes) return true;
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return true;
+            // EOF or error: answer what is already queued, then close
+            if (c->pending.empty()) {
+                close_connection(c);
+                return false;
+            }
+            c->close_after = true;
+            modify(c->fd, c, c->writable_armed ? static_cast<uint32_t>(EPOLLOUT) : 0u);
+            return true;
+        }
+    }
+
+    static bool iequals(const char* a, size_t alen, const char* b) {
+        size_t blen = strlen(b);
+        if (alen != blen) return false;
+        for (size_t i = 0; i < alen; ++i) {
+            if (tolower(static_cast<unsigned char>(a[i])) != b[i]) return false;
+        }
+        return true;
+    }
+
+    static int hex_value(char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    // Query-string decoding as httplib does it: %XX escapes and '+' as space.
+    static std::string decode(const char* s, size_t len) {
+        std::string out;
+        out.reserve(len);
+        for (size_t i = 0; i < len; ++i) {
+            if (s[i] == '%' && i + 2 < len && hex_value(s[i + 1]) >= 0 && hex_value(s[i + 2]) >= 0) {
+                out += static_cast<char>(hex_value(s[i + 1]) * 16 + hex_value(s[i + 2]));
+                i += 2;
+            } else if (s[i] == '+') {
+                out += ' ';
+            } else {
+                out += s[i];
+            }
+        }
+        return out;
+    }
+
+    static void parse_query(const char* s, size_t len, std::multimap<std::string, std::string>& params) {
+        const char* end = s + len;
+        while (s < end) {
+            const char* amp = static_cast<const char*>(memchr(s, '&', end - s));
+            const char* pair_end = amp ? amp : end;
+            const char* eq = static_cast<const char*>(memchr(s, '=', pair_end - s));
+            if (pair_end > s) {
+                if (eq) {
+                    params.emplace(decode(s, eq - s), decode(eq + 1, pair_end - eq - 1));
+                } else {
+                    params.emplace(decode(s, pair_end - s), std::string());
+                }
+            }
+            s = amp ? amp + 1 : end;
+        }
+    }
+
+    // Parses and dispatches every complete request in the input buffer.
+    void parse_requests(Connection* c) {
+        const uint64_t id = c->id;
+        const uint64_t arrival = utils::monotonic_ns();
+        while (!c->close_after && c->pending.size() < kMaxPipelined) {
+            const char* base = c->in.data() + c->in_off;
+            size_t avail = c->in.size() - c->in_off;
+            const char* head_end = static_cast<const char*>(memmem(base, avail, "\r\n\r\n", 4));
+            if (!head_end) {
+                if (avail > kMaxHeaderBytes) reject(c, 431);
+                break;
+            }
+            size_t head_len = head_end - base + 4;
+
+            // Request line
+            const char* line_end = static_cast<const char*>(memmem(base, head_len, "\r\n", 2));
+            const char* sp1 = static_cast<const char*>(memchr(base, ' ', line_end - base));
+            const char* sp2 = sp1 ? static_cast<const char*>(memchr(sp1 + 1, ' ', line_end - sp1 - 1)) : nullptr;
+            if (!sp1 || !sp2) {
+                reject(c, 400);
+                break;
+            }
+            HttpRequest request;
+            request.arrival_ns = arrival;
+            request.method.assign(base, sp1 - base);
+            const char* target = sp1 + 1;
+            const char* question = static_cast<const char*>(memchr(target, '?', sp2 - target));
+            request.path.assign(target, (question ? question : sp2) - target);
+            if (question) parse_query(question + 1, sp2 - question - 1, request.params);
+            bool http10 = (line_end - sp2 - 1 == 8) && memcmp(sp2 + 1, "HTTP/1.0", 8) == 0;
+            bool keep_alive = !http10;
+
+            // Headers we act on
+            size_t content_length = 0;
+            bool chunked = false;
+            const char* h = line_end + 2;
+            while (h < head_end) {
+                const char* eol = static_cast<const char*>(memmem(h, head_end + 2 - h, "\r\n", 2));
+                const char* colon = static_cast<const char*>(memchr(h, ':', eol - h));
+                if (colon) {
+                    const char* v = colon + 1;
+                    while (v < eol && (*v == ' ' || *v == '\t')) ++v;
+                    size_t vlen = eol - v;
+                    if (iequals(h, colon - h, "content-length")) {
+                        content_length = strtoull(std::string(v, vlen).c_str(), nullptr, 10);
+                    } else if (iequals(h, colon - h, "connection")) {
+                        if (iequals(v, vlen, "close")) keep_alive = false;
+                        if (iequals(v, vlen, "keep-alive")) keep_alive = true;
+                    } else if (iequals(h, colon - h, "transfer-encoding")) {
+                        chunked = !iequals(v, vlen, "identity");
+                    }
+                    std::string name(h, colon - h);
+                    for (char& ch : name) ch = static_cast<char>(tolower(static_cast<unsigned char>(ch)));
+                    request.headers.emplace(std::move(name), std::string(v, vlen));
+                }
+                h = eol + 2;
+            }
+            if (chunked) {
+                reject(c, 501);
+                break;
+            }
+            if (content_length > kMaxBodyBytes) {
+                reject(c, 413);
+                break;
+            }
+            if (avail < head_len + content_length) break; // body still arriving
+            request.body.assign(base + head_len, content_length);
+            c->in_off += head_len + content_length;
+
+            uint64_t seq = c->next_seq++;
+            c->pending.emplace_back();
+            c->pending.back().keep_alive = keep_alive;
+            if (!keep_alive) c->close_after = true;
+            handler_(request, Responder(this, id, seq));
+            if (!conns_.count(id)) return; // closed by a synchronous completion
+        }
+        if (c->in_off == c->in.size()) {
+            c->in.clear();
+            c->in_off = 0;
+        } else if (c->in_off > 65536) {
+            c->in.erase(0, c->in_off);
+            c->in_off = 0;
+        }
+        update_reading(c);
+    }
+
+    // Stops reading a connection whose pipeline is full, or whose client is
+    // not taking its responses (the socket is not writable), and resumes
+    // once they drain (flush_dirty(), write_connection()). A client that
+    // pipelines without reading responses then waits in its socket
+    // buffers, not in c->in or c->out.
+    void update_reading(Connection* c) {
+        const bool paused = backlogged(c);
+        if (c->close_after || paused == c->read_paused) return;
+        c->read_paused = paused;
+        modify(c->fd, c, read_events(c) | (c->writable_armed ? static_cast<uint32_t>(EPOLLOUT) : 0u));
+    }
+
+    static bool backlogged(const Connection* c) {
+        return c->pending.size() >= kMaxPipelined || c->writable_armed;
+    }
+
+    static uint32_t read_events(const Connection* c) {
+        return c->close_after || c->read_paused ? 0u : static_cast<uint32_t>(EPOLLIN | EPOLLRDHUP);
+    }
+
+    // Answers a malformed request and closes the connection after it.
+    void reject(Connection* c, int status) {
+        uint64_t seq = c->next_seq++;
+        c->pending.emplace_back();
+        c->pending.back().keep_alive = false;
+        c->close_after = true;
+        HttpResponse response;
+        response.status = status;
+        complete(c->id, seq, std::move(response));
+    }
+
+    static const char* reason(int status) {
+        switch (status) {
+            case 200: return "OK";
+            case 400: return "Bad Request";
+            case 404: return "Not Found";
+            case 408: return "Request Timeout";
+            case 413: return "Payload Too Large";
+            case 431: return "Request Header Fields Too Large";
+            case 500: return "Internal Server Error";
+            case 501: return "Not Implemented";
+            case 502: return "Bad Gateway";
+            case 503: return "Service Unavailable";
+        }
+        return "Unknown";
+    }
+
+    void complete(uint64_t conn_id, uint64_t seq, HttpResponse&& response) {
+        auto it = conns_.find(conn_id);
+        if (it == conns_.end()) return; // client went away
+        Connection* c = it->second;
+        size_t index = seq - c->first_seq;
+        if (index >= c->pending.size()) return;
+        Pending& p = c->pending[index];
+        char head[256];
+        int n = snprintf(head, sizeof(head),
+                         "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: %s\r\n",
+                         response.status, reason(response.status), response.content_type,
+                         response.body.size(), p.keep_alive ? "keep-alive" : "close");
+        p.data.reserve(n + response.headers.size() + 2 + response.body.size());
+        p.data.append(head, n);
+        p.data.append(response.headers);
+        p.data.append("\r\n", 2);
+        p.data.append(response.body);
+        p.done = true;
+        if (!c->dirty) {
+            c->dirty = true;
+            dirty_.push_back(c);
+        }
+    }
+
+    // Moves finished responses, in order, to the output buffer and writes.
+    void flush_dirty() {
+        for (size_t i = 0; i < dirty_.size(); ++i) {
+            Connection* c = dirty_[i];
+            if (!c) continue;
+            c->dirty = false;
+            while (!c->pending.empty() && c->pending.front().done) {
+                c->out.append(c->pending.front().data);
+                c->pending.pop_front();
+                c->first_seq++;
+            }
+            if (!write_connection(c)) continue;
+            // Room in the pipeline again: parse requests that were waiting.
+            if (!c->close_after && c->in_off < c->in.size()) {
+                parse_requests(c);
+            } else {
+                update_reading(c);
+            }
+        }
+        dirty_.clear();
+    }
+
+    // false if the connection was closed
+    bool write_connection(Connection* c) {
+        while (c->out_off < c->out.size()) {
+            ssize_t n = write(c->fd, c->out.data() + c->out_off, c->out.size() - c->out_off);
+            if (n > 0) {
+                c->out_off += n;
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                if (!c->writable_armed) {
+                    c->writable_armed = true;
+                    c->read_paused = true;
+                    modify(c->fd, c, read_events(c) | EPOLLOUT);
+                }
+                return true;
+            }
+            close_connection(c);
+            return false;
+        }
+        c->out.clear();
+        c->out_off = 0;
+        if (c->close_after && c->pending.empty()) {
+            close_connection(c);
+            return false;
+        }
+        if (c->writable_armed) {
+            c->writable_armed = false;
+            c->read_paused = backlogged(c);
+            modify(c->fd, c, read_events(c));
+        }
+        return true;
+    }
+
+    void sweep_idle(time_t now) {
+        std::vector<Connection*> idle;
+        for (auto& entry : conns_) {
+            Connection* c = entry.second;
+            if (c->pending.empty() && c->out.empty() && now - c->last_active > kIdleTimeoutSec) {
+                idle.push_back(c);
+            }
+        }
+        for (Connection* c : idle) close_connection(c);
+    }
+
+    void start_call(const std::string& path, const std::string& payload,
+                    const utils::TraceContext& trace, CallCallback done, uint32_t flags) {
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            fail(done, rpc::CallStatus::kSocketError);
+            return;
+        }
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+        // A UDS connect either completes at once or fails (EAGAIN when the
+        // service's backlog is full); there is no in-progress state.
+        if (connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+            close(fd);
+            fail(done, rpc::CallStatus::kConnectError);
+            return;
+        }
+        std::unique_ptr<Call> c(new Call());
+        c->kind = Handle::kCall;
+        c->fd = fd;
+        c->done = std::move(done);
+        char header[rpc::kMaxRequestHeader];
+        size_t header_len = rpc::encode_request_header(header, payload.size(), trace, flags);
+        c->out.reserve(header_len + payload.size());
+        c->out.append(header, header_len);
+        c->out.append(payload);
+        Call* raw = c.release();
+        if (!write_call(raw)) return;
+        add(fd, raw, raw->off < raw->out.size() ? EPOLLIN | EPOLLOUT : EPOLLIN);
+        if (trace.deadline_ns) {
+            raw->deadline = deadlines_.emplace(trace.deadline_ns, raw);
+            raw->has_deadline = true;
+        }
+    }
+
+    void queue_batched(const std::string& path, size_t max_items, const std::string& payload,
+                       const utils::TraceContext& trace, CallCallback done) {
+        OpenBatch& batch = open_batches_[path];
+        if (batch.dones.empty()) {
+            batch.trace = trace;
+        } else {
+            rpc::merge_batch_trace(batch.trace, trace);
+        }
+        batch.payloads.push_back(payload);
+        batch.deadlines.push_back(trace.deadline_ns);
+        batch.dones.push_back(std::move(done));
+        ++queued_;
+        if (batch.dones.size() >= max_items) send_batch(path, batch);
+    }
+
+    // open_batches_ is a std::map, so calls queued by callbacks that run
+    // while a batch is sent do not invalidate the iteration.
+    void flush_batches() {
+        if (queued_ == 0) return;
+        for (auto& entry : open_batches_) {
+            if (!entry.second.dones.empty()) send_batch(entry.first, entry.second);
+        }
+    }
+
+    void send_batch(const std::string& path, OpenBatch& open) {
+        OpenBatch batch;
+        std::swap(batch, open);
+        queued_ -= batch.dones.size();
+        if (batch.dones.size() == 1) {
+            start_call(path, batch.payloads[0], batch.trace, std::move(batch.dones[0]), 0);
+            return;
+        }
+        std::vector<const std::string*> items;
+        items.reserve(batch.payloads.size());
+        for (const std::string& item : batch.payloads) items.push_back(&item);
+        std::string payload;
+        rpc::encode_batch(items, payload);
+        const utils::TraceContext trace = batch.trace;
+        auto callers = std::make_shared<OpenBatch>(std::move(batch));
+        start_call(path, payload, trace, [callers](rpc::CallStatus status, std::string& response) {
+            std::vector<std::string> responses;
+            std::vector<bool> failed;
+            if (status == rpc::CallStatus::kOk &&
+                (!rpc::decode_batch(response, responses, &failed) || responses.size() != callers->dones.size())) {
+                status = rpc::CallStatus::kReadError;
+            }
+            const uint64_t now = utils::monotonic_ns();
+            for (size_t i = 0; i < callers->dones.size(); ++i) {
+                CallCallback& done = callers->dones[i];
+                if (status != rpc::CallStatus::kOk) {
+                    fail(done, status);
+                } else if (callers->deadlines[i] && now >= callers->deadlines[i]) {
+                    fail(done, rpc::CallStatus::kDeadlineExceeded);
+                } else if (failed[i]) {
+                    fail(done, rpc::CallStatus::kReadError);
+                } else {
+                    done(rpc::CallStatus::kOk, responses[i]);
+                }
+            }
+        }, rpc::kFlagBatch);
+    }
+
+    // Until the next idle sweep, or the earliest call deadline if sooner;
+    // no wait while batched calls are queued.
+    int wait_timeout_ms() const {
+        if (queued_) return 0;
+        if (deadlines_.empty()) return 1000;
+        uint64_t now = utils::monotonic_ns();
+        uint64_t first = deadlines_.begin()->first;
+        if (first <= now) return 0;
+        uint64_t ms = (first - now + 999999) / 1000000;
+        return ms < 1000 ? static_cast<int>(ms) : 1000;
+    }
+
+    void expire_calls() {
+        if (deadlines_.empty()) return;
+        uint64_t now = utils::monotonic_ns();
+        while (!deadlines_.empty() && deadlines_.begin()->first <= now) {
+            finish_call(deadlines_.begin()->second, rpc::CallStatus::kDeadlineExceeded);
+        }
+    }
+
+    static void fail(CallCallback& done, rpc::CallStatus status) {
+        std::string empty;
+        done(status, empty);
+    }
+
+    void finish_call(Call* c, rpc::CallStatus status) {
+        if (c->has_deadline) deadlines_.erase(c->deadline);
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, c->fd, nullptr);
+        close(c->fd);
+        std::string payload;
+        if (status == rpc::CallStatus::kOk) payload = c->in.substr(4);
+        CallCallback done = std::move(c->done);
+        delete c;
+        done(status, payload);
+    }
+
+    // false if the call finished (with an error)
+    bool write_call(Call* c) {
+        while (c->off < c->out.size()) {
+            ssize_t n = write(c->fd, c->out.data() + c->off, c->out.size() - c->off);
+            if (n > 0) {
+                c->off += n;
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return true;
+            // not yet registered with epoll when called from call()
+            close(c->fd);
+            CallCallback done = std::move(c->done);
+            delete c;
+            fail(done, rpc::CallStatus::kWriteError);
+            return false;
+        }
+        std::string().swap(c->out);
+        return true;
+    }
+
+    void on_call(Call* c, uint32_t events) {
+        if (events & EPOLLOUT) {
+            while (c->off < c->out.size()) {
+                ssize_t n = write(c->fd, c->out.data() + c->off, c->out.size() - c->off);
+                if (n > 0) {
+                    c->off += n;
+                    continue;
+                }
+                if (n < 0 && errno == EINTR) continue;
+                if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+                finish_call(c, rpc::CallStatus::kWriteError);
+                return;
+            }
+            if (c->off == c->out.size()) {
+                std::string().swap(c->out);
+                modify(c->fd, c, EPOLLIN);
+            }
+        }
+        if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+            char buf[16384];
+            while (true) {
+                ssize_t n = read(c->fd, buf, sizeof(buf));
+                if (n > 0) {
+                    c->in.append(buf, n);
+                    if (c->in.size() >= 4) {
+                        uint32_t word;
+                        memcpy(&word, c->in.data(), 4);
+                        if (c->in.size() >= 4 + static_cast<size_t>(word & rpc::kLengthMask)) {
+                            c->in.resize(4 + (word & rpc::kLengthMask));
+                            finish_call(c, rpc::CallStatus::kOk);
+                            return;
+                        }
+                    }
+                    continue;
+                }
+                if (n < 0 && errno == EINTR) continue;
+                if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+                finish_call(c, rpc::CallStatus::kReadError);
+                return;
+            }
+        }
+    }
+};
+
+} // namespace frontend
+} // namespace microservice
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+namespace microservice {
+namespace frontend {
+
+// Table-driven binding of HTTP query parameters straight into a protobuf
+// request, without going through a Json::Value.
+//
+// Each route declares a static table of ParamBinding entries. bind_params()
+// looks every parameter up once in the request's parameter map and hands the
+// stored value to the entry's setter; numbers are parsed in place (strtod /
+// strtoll with end-pointer checks), so binding allocates nothing beyond the
+// protobuf string fields themselves.
+template <typename Message>
+struct ParamBinding {
+    const char* name;
+    bool required;
+    // Returns false if the value does not parse or fails validation.
+    bool (*bind)(Message& message, const std::string& value);
+};
+
+// Whole-string decimal parse; rejects empty input, trailing characters,
+// overflow, NaN and infinities.
+inline bool parse_double(const std::string& s, double& out) {
+    if (s.empty()) return false;
+    const char* begin = s.c_str();
+    char* end = nullptr;
+    errno = 0;
+    double v = strtod(begin, &end);
+    if (end != begin + s.size() || errno == ERANGE) return false;
+    if (!std::isfinite(v)) return false;
+    out = v;
+    return true;
+}
+
+inline bool parse_int64(const std::string& s, int64_t& out) {
+    if (s.empty()) return false;
+    const char* begin = s.c_str();
+    char* end = nullptr;
+    errno = 0;
+    long long v = strtoll(begin, &end, 10);
+    if (end != begin + s.size() || errno == ERANGE) return false;
+    out = static_cast<int64_t>(v);
+    return true;
+}
+
+inline bool parse_latitude(const std::string& s, double& out) {
+    return parse_double(s, out) && out >= -90.0 && out <= 90.0;
+}
+
+inline bool parse_longitude(const std::string& s, double& out) {
+    return parse_double(s, out) && out >= -180.0 && out <= 180.0;
+}
+
+// Binds every entry of the table from params (an httplib::Params multimap;
+// the first value of a repeated parameter wins, as with get_param_value).
+// On failure, *bad_param names the missing or invalid parameter.
+template <typename Params, typename Message, size_t N>
+bool bind_params(const Params& params, const ParamBinding<Message> (&table)[N],
+                 Message& message, const char** bad_param) {
+    for (const auto& entry : table) {
+        auto it = params.find(entry.name);
+        if (it == params.end()) {
+            if (!entry.required) continue;
+            *bad_param = entry.name;
+            return false;
+        }
+        if (!entry.bind(message, it->second)) {
+            *bad_param = entry.name;
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace frontend
+} // namespace microservice
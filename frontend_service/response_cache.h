@@ -0,0 +1,261 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include <list>
+#include <mutex>
+#include <new>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "lock_utils.h"
+#include "trace_utils.h"
+
+namespace microservice {
+namespace frontend {
+
+// Counters of every worker's ResponseCache, shared across fork() the same
+// way as FragmentCacheStats: one cache-line-sized slot per worker.
+struct ResponseCacheStats {
+    static constexpr uint32_t kMaxSlots = 512;
+
+    struct alignas(64) Slot {
+        std::atomic<int32_t> pid;
+        std::atomic<uint64_t> hits;
+        std::atomic<uint64_t> stale_hits; // served past the TTL while refreshing
+        std::atomic<uint64_t> misses;
+        std::atomic<uint64_t> bypassed;   // Cache-Control: no-cache
+        std::atomic<uint64_t> evictions;
+        std::atomic<uint64_t> refreshes;  // background revalidations started
+        std::atomic<uint64_t> entries;
+        std::atomic<uint64_t> bytes;
+    };
+
+    std::atomic<uint32_t> next_slot;
+    Slot slots[kMaxSlots];
+
+    Slot* claim() {
+        uint32_t i = next_slot.fetch_add(1, std::memory_order_relaxed) % kMaxSlots;
+        Slot* slot = &slots[i];
+        slot->pid.store(getpid(), std::memory_order_relaxed);
+        slot->entries.store(0, std::memory_order_relaxed);
+        slot->bytes.store(0, std::memory_order_relaxed);
+        return slot;
+    }
+};
+
+// First call must happen before fork(); PreforkHTTPServer does that.
+inline ResponseCacheStats& response_cache_stats() {
+    static ResponseCacheStats* stats = [] {
+        void* mem = mmap(nullptr, sizeof(ResponseCacheStats), PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        static ResponseCacheStats unshared; // only if the mapping fails
+        return mem == MAP_FAILED ? &unshared : new (mem) ResponseCacheStats();
+    }();
+    return *stats;
+}
+
+// Per-worker cache of complete response bodies, keyed by route and the
+// normalized request key, so a hit skips the whole downstream graph.
+//
+// Each route has a TTL; for a further stale window after it, the old body is
+// still served and the first request to see it stale gets kStale, telling it
+// to revalidate in the background (stale-while-revalidate). Later requests
+// get kStaleRefreshing until the refreshed body is stored or the refresh is
+// abandoned.
+//
+//   RESPONSE_CACHE_TTL_MS=search=1000,recommend=10000  per-route TTL, 0 = off
+//   RESPONSE_CACHE_STALE_MS=N                          stale window (default 1000)
+//   RESPONSE_CACHE_BYTES=N                             per worker (default 2MB, 0 = off)
+//
+// Entries are spread over kShards LRU lists, each with its own lock and an
+// equal share of the byte budget.
+class ResponseCache {
+public:
+    static constexpr size_t kShards = 16;
+
+    enum class Lookup { kMiss, kFresh, kStale, kStaleRefreshing };
+
+    struct Route {
+        char id;
+        uint64_t ttl_ns;
+    };
+
+    // Routes and their default TTLs in milliseconds.
+    ResponseCache(std::initializer_list<std::pair<const char*, uint64_t>> routes) {
+        const char* bytes_env = getenv("RESPONSE_CACHE_BYTES");
+        const char* stale_env = getenv("RESPONSE_CACHE_STALE_MS");
+        const char* ttl_env = getenv("RESPONSE_CACHE_TTL_MS");
+        shard_max_bytes_ = (bytes_env ? strtoull(bytes_env, nullptr, 10) : 2 * 1024 * 1024) / kShards;
+        stale_ns_ = (stale_env ? strtoull(stale_env, nullptr, 10) : 1000) * 1000000ull;
+        for (const auto& route : routes) {
+            uint64_t ttl_ms = route.second;
+            if (ttl_env) ttl_ms = configured_ttl(ttl_env, route.first, ttl_ms);
+            names_.push_back(route.first);
+            routes_.push_back(Route{static_cast<char>(routes_.size()), ttl_ms * 1000000ull});
+        }
+    }
+
+    // nullptr if the route is not cached
+    const Route* route(const char* name) const {
+        if (shard_max_bytes_ == 0) return nullptr;
+        for (size_t i = 0; i < names_.size(); ++i) {
+            if (strcmp(names_[i], name) == 0) return routes_[i].ttl_ns ? &routes_[i] : nullptr;
+        }
+        return nullptr;
+    }
+
+    // Copies the cached body into body unless the result is kMiss.
+    Lookup get(const Route* route, const std::string& key, std::string& body) {
+        const std::string full = full_key(route, key);
+        Shard& shard = shard_for(full);
+        const uint64_t now = utils::monotonic_ns();
+        std::lock_guard<utils::ProfiledMutex> lock(shard.mutex);
+        ResponseCacheStats::Slot* stats = slot();
+        auto it = shard.index.find(full);
+        if (it == shard.index.end()) {
+            stats->misses.fetch_add(1, std::memory_order_relaxed);
+            return Lookup::kMiss;
+        }
+        Entry& e = *it->second;
+        if (now >= e.expires_ns + stale_ns_) {
+            erase(shard, it->second);
+            stats->misses.fetch_add(1, std::memory_order_relaxed);
+            return Lookup::kMiss;
+        }
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        body = e.body;
+        if (now < e.expires_ns) {
+            stats->hits.fetch_add(1, std::memory_order_relaxed);
+            return Lookup::kFresh;
+        }
+        stats->stale_hits.fetch_add(1, std::memory_order_relaxed);
+        if (e.refreshing) return Lookup::kStaleRefreshing;
+        e.refreshing = true;
+        stats->refreshes.fetch_add(1, std::memory_order_relaxed);
+        return Lookup::kStale;
+    }
+
+    void put(const Route* route, const std::string& key, const std::string& body) {
+        std::string full = full_key(route, key);
+        const size_t bytes = full.size() + body.size() + kEntryOverhead;
+        Shard& shard = shard_for(full);
+        if (bytes > shard_max_bytes_) return;
+        const uint64_t expires = utils::monotonic_ns() + route->ttl_ns;
+        std::lock_guard<utils::ProfiledMutex> lock(shard.mutex);
+        auto it = shard.index.find(full);
+        if (it != shard.index.end()) erase(shard, it->second);
+        while (shard.bytes + bytes > shard_max_bytes_) {
+            erase(shard, std::prev(shard.lru.end()));
+            slot()->evictions.fetch_add(1, std::memory_order_relaxed);
+        }
+        shard.lru.emplace_front();
+        Entry& e = shard.lru.front();
+        e.key = std::move(full);
+        e.body = body;
+        e.bytes = bytes;
+        e.expires_ns = expires;
+        shard.index[e.key] = shard.lru.begin();
+        shard.bytes += bytes;
+        account(bytes, 1);
+    }
+
+    // A kStale revalidation failed; the next stale hit retries it.
+    void refresh_failed(const Route* route, const std::string& key) {
+        const std::string full = full_key(route, key);
+        Shard& shard = shard_for(full);
+        std::lock_guard<utils::ProfiledMutex> lock(shard.mutex);
+        auto it = shard.index.find(full);
+        if (it != shard.index.end()) it->second->refreshing = false;
+    }
+
+    void record_bypass() { slot()->bypassed.fetch_add(1, std::memory_order_relaxed); }
+
+private:
+    static constexpr size_t kEntryOverhead = 96; // list node, index node, bookkeeping
+
+    struct Entry {
+        std::string key;
+        std::string body;
+        size_t bytes = 0;
+        uint64_t expires_ns = 0; // utils::monotonic_ns(), like admission control's timers
+        bool refreshing = false;
+    };
+
+    struct Shard {
+        utils::ProfiledMutex mutex{"response_cache"};
+        std::list<Entry> lru; // most recently used first
+        std::unordered_map<std::string, std::list<Entry>::iterator> index;
+        size_t bytes = 0;
+    };
+
+    Shard shards_[kShards];
+    std::vector<const char*> names_;
+    std::vector<Route> routes_;
+    std::atomic<ResponseCacheStats::Slot*> stats_{nullptr};
+    size_t shard_max_bytes_;
+    uint64_t stale_ns_;
+
+    static uint64_t configured_ttl(const char* list, const char* name, uint64_t fallback) {
+        size_t len = strlen(name);
+        for (const char* p = list; *p;) {
+            const char* end = strchr(p, ',');
+            const char* eq = static_cast<const char*>(memchr(p, '=', end ? end - p : strlen(p)));
+            if (eq && static_cast<size_t>(eq - p) == len && strncmp(p, name, len) == 0) {
+                return strtoull(eq + 1, nullptr, 10);
+            }
+            if (!end) break;
+            p = end + 1;
+        }
+        return fallback;
+    }
+
+    static std::string full_key(const Route* route, const std::string& key) {
+        std::string full;
+        full.reserve(key.size() + 1);
+        full += route->id;
+        full += key;
+        return full;
+    }
+
+    Shard& shard_for(const std::string& full) {
+        return shards_[std::hash<std::string>()(full) % kShards];
+    }
+
+    void erase(Shard& shard, std::list<Entry>::iterator it) {
+        shard.bytes -= it->bytes;
+        account(-static_cast<int64_t>(it->bytes), -1);
+        shard.index.erase(it->key);
+        shard.lru.erase(it);
+    }
+
+    void account(int64_t bytes, int64_t entries) {
+        ResponseCacheStats::Slot* stats = slot();
+        stats->bytes.fetch_add(static_cast<uint64_t>(bytes), std::memory_order_relaxed);
+        stats->entries.fetch_add(static_cast<uint64_t>(entries), std::memory_order_relaxed);
+    }
+
+    // Claimed lazily so that it happens in the worker, after fork(); the
+    // shards are locked independently, so the claim itself is guarded.
+    ResponseCacheStats::Slot* slot() {
+        ResponseCacheStats::Slot* s = stats_.load(std::memory_order_acquire);
+        if (s) return s;
+        static std::mutex claim_mutex;
+        std::lock_guard<std::mutex> lock(claim_mutex);
+        s = stats_.load(std::memory_order_relaxed);
+        if (!s) {
+            s = response_cache_stats().claim();
+            stats_.store(s, std::memory_order_release);
+        }
+        return s;
+    }
+};
+
+} // namespace frontend
+} // namespace microservice
@@ -0,0 +1,264 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+#include "../timing_utils.h"
+#include "geo_index.h"
+
+namespace microservice {
+namespace geo {
+
+// Per-worker cache of nearby answers, for traffic concentrated on a few
+// coordinates. Queries are keyed by their lat/lon cell (GEO_CACHE_CELL_DEG,
+// default 0.0001 degrees, ~11m), radius and k, and an entry answers every
+// query in its cell, so it is stored only if that answer cannot change
+// anywhere in the cell:
+//
+// No two points of a cell are more than e = 2 * cell apart (along a
+// meridian, then a parallel), so moving the query within the cell moves
+// every distance by at most e. The answer computed at the first query's
+// point therefore holds for the whole cell if every result is within
+// radius - e, consecutive results are more than 2e apart, and the nearest
+// non-result is more than 2e past the last result and outside radius + e.
+// A miss asks the index for k + 1 hotels within radius + e to check this.
+//
+// Answers that fail the check are cached for their exact coordinates
+// instead. Bounded by GEO_CACHE_ENTRIES (default 16384, 0 disables) and
+// evicted with CLOCK. Counters go to /logs/geo_cache_<pid>.txt once a
+// second.
+class NearbyCache {
+public:
+    NearbyCache() {
+        const char* entries = getenv("GEO_CACHE_ENTRIES");
+        const char* cell = getenv("GEO_CACHE_CELL_DEG");
+        max_entries_ = entries ? strtoull(entries, nullptr, 10) : 16384;
+        cell_deg_ = cell ? strtod(cell, nullptr) : 0.0001;
+        if (!(cell_deg_ > 0)) cell_deg_ = 0.0001;
+        error_km_ = 2 * kEarthRadiusKm * cell_deg_ * kDegToRad * (1 + 1e-9) + 1e-9;
+    }
+
+    NearbyCache(const NearbyCache&) = delete;
+    NearbyCache& operator=(const NearbyCache&) = delete;
+
+    bool enabled() const { return max_entries_ > 0; }
+    double cell_deg() const { return cell_deg_; }
+
+    // index.nearest() as indices into its locations; valid until the next
+    // call. Index is a GeoIndex or anything with the same nearest().
+    template <typename Index>
+    const std::vector<uint32_t>& nearest(const Index& index, double lat, double lon, double radius_km, size_t k) {
+        ids_.clear();
+        if (!enabled() || k == 0 || !cacheable(lat, lon, radius_km)) {
+            index.nearest(lat, lon, radius_km, k, scratch_);
+            for (const Neighbor& n : scratch_) ids_.push_back(n.index);
+            return ids_;
+        }
+        const Key cell = cell_key(lat, lon, radius_km, k);
+        const Key exact = exact_key(lat, lon, radius_km, k);
+        if (const Entry* e = find(cell)) {
+            ++stats_.cell_hits;
+            return e->ids;
+        }
+        if (const Entry* e = find(exact)) {
+            ++stats_.exact_hits;
+            return e->ids;
+        }
+        ++stats_.misses;
+
+        index.nearest(lat, lon, radius_km + error_km_, k + 1, scratch_);
+        size_t answer = 0;
+        while (answer < scratch_.size() && answer < k && scratch_[answer].distance_km <= radius_km) ++answer;
+        for (size_t i = 0; i < answer; ++i) ids_.push_back(scratch_[i].index);
+        if (stable(answer, radius_km, k)) {
+            insert(cell);
+        } else {
+            ++stats_.unstable;
+            insert(exact);
+        }
+        return ids_;
+    }
+
+    // Drops every entry; call whenever the indexed locations change.
+    void clear() {
+        if (!index_.empty()) ++stats_.invalidations;
+        index_.clear();
+        entries_.clear();
+        free_.clear();
+        hand_ = 0;
+    }
+
+    // Writes the counters if a second has passed since the last write.
+    // Workers call this after each request.
+    void maybe_flush() {
+        if (!enabled()) return;
+        const utils::TscClock& clock = utils::TscClock::instance();
+        uint64_t now = clock.now();
+        if (last_flush_ && clock.to_ns(now - last_flush_) < 1000000000ull) return;
+        last_flush_ = now;
+        flush();
+    }
+
+private:
+    struct Key {
+        int64_t lat; // cell index, or the coordinate's bits for an exact key
+        int64_t lon;
+        uint64_t radius;
+        uint64_t k;  // top bit set for an exact key
+
+        bool operator==(const Key& o) const {
+            return lat == o.lat && lon == o.lon && radius == o.radius && k == o.k;
+        }
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const {
+            uint64_t h = 0x9e3779b97f4a7c15ull;
+            for (uint64_t v : {static_cast<uint64_t>(key.lat), static_cast<uint64_t>(key.lon), key.radius, key.k}) {
+                h = (h ^ v) * 0xff51afd7ed558ccdull;
+                h ^= h >> 32;
+            }
+            return static_cast<size_t>(h);
+        }
+    };
+
+    struct Entry {
+        Key key;
+        std::vector<uint32_t> ids;
+        bool referenced = false;
+        bool live = false;
+    };
+
+    struct Stats {
+        uint64_t cell_hits = 0;
+        uint64_t exact_hits = 0;
+        uint64_t misses = 0;
+        uint64_t unstable = 0; // misses whose answer was cached for the exact point only
+        uint64_t evictions = 0;
+        uint64_t invalidations = 0;
+    };
+
+    uint64_t max_entries_;
+    double cell_deg_;
+    double error_km_; // farthest apart two points of one cell can be
+    std::vector<Entry> entries_;
+    std::vector<size_t> free_;
+    std::unordered_map<Key, size_t, KeyHash> index_;
+    size_t hand_ = 0;
+    std::vector<Neighbor> scratch_;
+    std::vector<uint32_t> ids_;
+    Stats stats_;
+    uint64_t last_flush_ = 0;
+
+    static uint64_t bits(double v) {
+        uint64_t b;
+        memcpy(&b, &v, sizeof(b));
+        return b;
+    }
+
+    bool cacheable(double lat, double lon, double radius_km) const {
+        return std::isfinite(radius_km) && radius_km >= 0 && std::fabs(lat) <= 90 && std::fabs(lon) <= 1e6;
+    }
+
+    Key cell_key(double lat, double lon, double radius_km, size_t k) const {
+        return Key{static_cast<int64_t>(floor(lat / cell_deg_)), static_cast<int64_t>(floor(lon / cell_deg_)),
+                   bits(radius_km), k};
+    }
+
+    static Key exact_key(double lat, double lon, double radius_km, size_t k) {
+        // +0.0 and -0.0 are the same query
+        return Key{static_cast<int64_t>(bits(lat + 0.0)), static_cast<int64_t>(bits(lon + 0.0)), bits(radius_km),
+                   k | (1ull << 63)};
+    }
+
+    // Whether the first answer entries of scratch_ (k + 1 nearest within
+    // radius + e) are the answer for every point of the cell.
+    bool stable(size_t answer, double radius_km, size_t k) const {
+        const double e = error_km_;
+        if (answer > 0 && scratch_[answer - 1].distance_km > radius_km - e) return false;
+        for (size_t i = 1; i < answer; ++i) {
+            if (scratch_[i].distance_km - scratch_[i - 1].distance_km <= 2 * e) return false;
+        }
+        if (answer == scratch_.size()) return true; // nothing else within radius + e
+        if (answer < k) return false;               // a hotel just outside the radius
+        const double last = answer > 0 ? scratch_[answer - 1].distance_km : 0;
+        return scratch_[answer].distance_km - last > 2 * e;
+    }
+
+    const Entry* find(const Key& key) {
+        auto it = index_.find(key);
+        if (it == index_.end()) return nullptr;
+        Entry& e = entries_[it->second];
+        e.referenced = true;
+        return &e;
+    }
+
+    void insert(const Key& key) {
+        while (index_.size() >= max_entries_) evict_one();
+        size_t i;
+        if (!free_.empty()) {
+            i = free_.back();
+            free_.pop_back();
+        } else {
+            i = entries_.size();
+            entries_.emplace_back();
+        }
+        Entry& e = entries_[i];
+        e.key = key;
+        e.ids = ids_;
+        e.referenced = false;
+        e.live = true;
+        index_[key] = i;
+    }
+
+    void evict_one() {
+        for (;;) {
+            if (hand_ >= entries_.size()) hand_ = 0;
+            Entry& e = entries_[hand_++];
+            if (!e.live) continue;
+            if (e.referenced) {
+                e.referenced = false;
+                continue;
+            }
+            index_.erase(e.key);
+            e.live = false;
+            free_.push_back(hand_ - 1);
+            ++stats_.evictions;
+            return;
+        }
+    }
+
+    void flush() const {
+        struct stat st = {};
+        if (stat("/logs", &st) == -1) {
+            mkdir("/logs", 0777);
+        }
+        std::string path = "/logs/geo_cache_" + std::to_string(getpid()) + ".txt";
+        std::string tmp = path + ".tmp";
+        FILE* f = fopen(tmp.c_str(), "w");
+        if (!f) return;
+        const uint64_t hits = stats_.cell_hits + stats_.exact_hits;
+        const uint64_t lookups = hits + stats_.misses;
+        fprintf(f, "# cell_deg %g error_km %.4f max_entries %llu\n", cell_deg_, error_km_,
+                (unsigned long long)max_entries_);
+        fprintf(f, "hits %llu\ncell_hits %llu\nexact_hits %llu\nmisses %llu\nhit_rate %.4f\n",
+                (unsigned long long)hits, (unsigned long long)stats_.cell_hits,
+                (unsigned long long)stats_.exact_hits, (unsigned long long)stats_.misses,
+                lookups ? static_cast<double>(hits) / lookups : 0.0);
+        fprintf(f, "unstable %llu\nevictions %llu\ninvalidations %llu\nentries %zu\n",
+                (unsigned long long)stats_.unstable, (unsigned long long)stats_.evictions,
+                (unsigned long long)stats_.invalidations, index_.size());
+        fclose(f);
+        rename(tmp.c_str(), path.c_str());
+    }
+};
+
+} // namespace geo
+} // namespace microservice
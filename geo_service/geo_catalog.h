@@ -0,0 +1,428 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string>
+#include <sys/mman.h>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "../rcu_utils.h"
+#include "geo_index.h"
+
+namespace microservice {
+namespace geo {
+
+// The hotel catalog shared by every geo worker, in an anonymous MAP_SHARED
+// mapping created before fork(): a table of hotel slots, and a ring naming
+// the slot each change touched, in order. The master process is the only
+// writer (one thread); workers follow the ring, and re-read the whole table
+// if they fall more than a ring behind.
+//
+// Each slot is a seqlock (odd while being written), so a worker never uses
+// a torn slot. A change may be applied by reading its slot's current
+// contents, since any later change to the slot is also in the ring.
+//
+// GEO_CATALOG_CAPACITY bounds the hotels (default 1M); GEO_UPDATE_RING the
+// changes a worker may fall behind by (default 64K). Untouched slots cost
+// no memory.
+class SharedCatalog {
+public:
+    static constexpr size_t kMaxIdBytes = 39;
+
+    struct Hotel {
+        std::string id;
+        double lat;
+        double lon;
+        bool live;
+    };
+
+    // Before fork(); nullptr if the mapping fails.
+    static SharedCatalog* create() {
+        const char* capacity = getenv("GEO_CATALOG_CAPACITY");
+        const char* ring = getenv("GEO_UPDATE_RING");
+        return create(capacity ? strtoull(capacity, nullptr, 10) : 1 << 20,
+                      ring ? strtoull(ring, nullptr, 10) : 1 << 16);
+    }
+
+    static SharedCatalog* create(size_t capacity, size_t ring_size) {
+        if (capacity == 0 || ring_size == 0) return nullptr;
+        size_t bytes = sizeof(Header) + capacity * sizeof(Slot) + ring_size * sizeof(Change);
+        void* mem = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (mem == MAP_FAILED) {
+            perror("geo catalog mmap");
+            return nullptr;
+        }
+        Header* header = new (mem) Header();
+        header->capacity = static_cast<uint32_t>(capacity);
+        header->ring_size = static_cast<uint32_t>(ring_size);
+        return new SharedCatalog(header);
+    }
+
+    SharedCatalog(const SharedCatalog&) = delete;
+    SharedCatalog& operator=(const SharedCatalog&) = delete;
+
+    // Writer side (master process, one thread). Each returns false, and
+    // changes nothing, if the hotel already exists (add), does not exist
+    // (move, remove), the id is too long, or the table is full.
+    bool add(const std::string& id, double lat, double lon) {
+        if (id.empty() || id.size() > kMaxIdBytes || slot_by_id_.count(id) || !valid(lat, lon)) return false;
+        uint32_t slot;
+        if (!free_.empty()) {
+            slot = free_.back();
+            free_.pop_back();
+        } else if (header_->slots_used.load(std::memory_order_relaxed) < header_->capacity) {
+            slot = header_->slots_used.load(std::memory_order_relaxed);
+            header_->slots_used.store(slot + 1, std::memory_order_release);
+        } else {
+            return false;
+        }
+        slot_by_id_[id] = slot;
+        write(slot, id, lat, lon, true);
+        return true;
+    }
+
+    bool move(const std::string& id, double lat, double lon) {
+        auto it = slot_by_id_.find(id);
+        if (it == slot_by_id_.end() || !valid(lat, lon)) return false;
+        write(it->second, id, lat, lon, true);
+        return true;
+    }
+
+    bool remove(const std::string& id) {
+        auto it = slot_by_id_.find(id);
+        if (it == slot_by_id_.end()) return false;
+        const uint32_t slot = it->second;
+        slot_by_id_.erase(it);
+        write(slot, id, 0, 0, false);
+        free_.push_back(slot);
+        return true;
+    }
+
+    // Sequence number of the latest change; 0 before the first.
+    uint64_t version() const { return header_->version.load(std::memory_order_acquire); }
+
+    // Reader side (workers). The table and the ring are read-only here.
+    uint32_t slots_used() const { return header_->slots_used.load(std::memory_order_acquire); }
+    uint32_t ring_size() const { return header_->ring_size; }
+
+    // Slot of change seq; false if the ring has moved past it.
+    bool change(uint64_t seq, uint32_t& slot) const {
+        const Change& c = ring()[seq % header_->ring_size];
+        if (c.seq.load(std::memory_order_acquire) != seq) return false;
+        slot = c.slot.load(std::memory_order_relaxed);
+        return c.seq.load(std::memory_order_acquire) == seq;
+    }
+
+    void read(uint32_t slot, Hotel& out) const {
+        const Slot& s = slots()[slot];
+        for (;;) {
+            uint32_t before = s.seq.load(std::memory_order_acquire);
+            if (before & 1) {
+                std::this_thread::yield();
+                continue;
+            }
+            char id[kMaxIdBytes + 1];
+            memcpy(id, s.id, sizeof(id));
+            const double lat = s.lat;
+            const double lon = s.lon;
+            const bool live = s.live;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (s.seq.load(std::memory_order_relaxed) != before) continue;
+            id[kMaxIdBytes] = '\0';
+            out.id = id;
+            out.lat = lat;
+            out.lon = lon;
+            out.live = live;
+            return;
+        }
+    }
+
+private:
+    struct Header {
+        std::atomic<uint64_t> version{0};
+        std::atomic<uint32_t> slots_used{0};
+        uint32_t capacity = 0;
+        uint32_t ring_size = 0;
+    };
+
+    struct Slot {
+        std::atomic<uint32_t> seq;
+        bool live;
+        char id[kMaxIdBytes + 1];
+        double lat;
+        double lon;
+    };
+
+    struct Change {
+        std::atomic<uint64_t> seq;
+        std::atomic<uint32_t> slot;
+    };
+
+    Header* header_;
+    // writer-only state, in the master's private memory
+    std::unordered_map<std::string, uint32_t> slot_by_id_;
+    std::vector<uint32_t> free_;
+
+    explicit SharedCatalog(Header* header) : header_(header) {}
+
+    Slot* slots() const { return reinterpret_cast<Slot*>(header_ + 1); }
+    Change* ring() const { return reinterpret_cast<Change*>(slots() + header_->capacity); }
+
+    static bool valid(double lat, double lon) { return std::isfinite(lat) && std::isfinite(lon); }
+
+    void write(uint32_t slot, const std::string& id, double lat, double lon, bool live) {
+        Slot& s = slots()[slot];
+        const uint32_t seq = s.seq.load(std::memory_order_relaxed);
+        s.seq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        memset(s.id, 0, sizeof(s.id));
+        memcpy(s.id, id.data(), id.size());
+        s.lat = lat;
+        s.lon = lon;
+        s.live = live;
+        s.seq.store(seq + 2, std::memory_order_release);
+
+        const uint64_t version = header_->version.load(std::memory_order_relaxed) + 1;
+        Change& c = ring()[version % header_->ring_size];
+        c.seq.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        c.slot.store(slot, std::memory_order_relaxed);
+        c.seq.store(version, std::memory_order_release);
+        header_->version.store(version, std::memory_order_release);
+    }
+};
+
+// Hotels and their index as of one rebuild, shared by the snapshots that
+// follow it.
+struct CatalogBase {
+    uint64_t version = 0; // catalog version it was built at
+    std::vector<Location> hotels;
+    std::vector<uint32_t> slots; // shared catalog slot of each hotel
+    std::unique_ptr<GeoIndex> index;
+};
+
+// A worker's immutable view of the catalog: the last rebuilt base, minus
+// the base hotels changed since, plus their current versions and any new
+// hotels in a small scanned delta. Answers are numbered base hotels first,
+// then delta hotels.
+struct CatalogSnapshot {
+    uint64_t version = 0;
+    std::shared_ptr<const CatalogBase> base;
+    std::vector<uint8_t> removed; // by base hotel: moved or removed since the rebuild
+    std::vector<Location> delta;
+    std::unique_ptr<GeoIndex> delta_index;
+
+    const std::string& id(uint32_t i) const {
+        const size_t n = base->hotels.size();
+        return i < n ? base->hotels[i].id : delta[i - n].id;
+    }
+
+    size_t size() const { return base->hotels.size() + delta.size(); }
+
+    // GeoIndex::nearest() over base and delta.
+    void nearest(double lat, double lon, double radius_km, size_t k, std::vector<Neighbor>& out) const {
+        out.clear();
+        if (k == 0 || !std::isfinite(lat) || !std::isfinite(lon) || !(radius_km >= 0)) return;
+        TopK top(k);
+        QueryPoint q(lat, lon, radius_km);
+        q.skip = removed.data();
+        base->index->collect(q, top);
+        q.skip = nullptr;
+        q.index_base = static_cast<uint32_t>(base->hotels.size());
+        delta_index->collect(q, top);
+        top.take_sorted(out);
+    }
+};
+
+// Follows a SharedCatalog in one worker. A background thread polls the
+// ring every GEO_UPDATE_POLL_US (default 10000) and publishes a snapshot
+// with whatever changed since the last poll through an RcuCell; request
+// threads read the current snapshot without locks and never wait for it.
+//
+// Changed hotels go to the snapshot's delta, which costs every query a
+// scan of it, so once more than GEO_UPDATE_DELTA_MAX hotels (default 1024)
+// have changed the poller rebuilds the index over the whole catalog.
+//
+// A replica can start from a base the master built before fork
+// (prebuild()), which every worker then shares copy-on-write instead of
+// building its own; changes made since it was built become the first
+// snapshot's delta.
+class CatalogReplica {
+public:
+    // readers: request threads, each with its own reader slot.
+    CatalogReplica(const SharedCatalog& shared, const char* index_kind, size_t readers = 1,
+                   std::shared_ptr<const CatalogBase> prebuilt = nullptr)
+        : shared_(shared), index_kind_(index_kind ? index_kind : ""),
+          snapshot_(std::unique_ptr<CatalogSnapshot>(new CatalogSnapshot()), readers) {
+        const char* poll = getenv("GEO_UPDATE_POLL_US");
+        const char* delta_max = getenv("GEO_UPDATE_DELTA_MAX");
+        poll_us_ = poll ? strtoull(poll, nullptr, 10) : 10000;
+        if (poll_us_ == 0) poll_us_ = 1;
+        delta_max_ = delta_max ? strtoull(delta_max, nullptr, 10) : 1024;
+        if (prebuilt) {
+            adopt(std::move(prebuilt));
+        } else {
+            resync();
+        }
+        snapshot_.publish(build());
+        poller_ = std::thread([this] { run(); });
+    }
+
+    ~CatalogReplica() {
+        stop_.store(true);
+        if (poller_.joinable()) poller_.join();
+    }
+
+    CatalogReplica(const CatalogReplica&) = delete;
+    CatalogReplica& operator=(const CatalogReplica&) = delete;
+
+    using ReadGuard = utils::RcuCell<CatalogSnapshot>::ReadGuard;
+
+    // The current snapshot, for the duration of a ReadGuard.
+    utils::RcuCell<CatalogSnapshot>& snapshot() { return snapshot_; }
+
+    // Index rebuilds since startup, for logging.
+    uint64_t rebuilds() const { return rebuilds_.load(std::memory_order_relaxed); }
+
+    // A base over the catalog as it is now; in the master, before fork.
+    static std::shared_ptr<const CatalogBase> prebuild(const SharedCatalog& shared, const char* index_kind) {
+        const uint64_t version = shared.version();
+        std::vector<SharedCatalog::Hotel> table(shared.slots_used());
+        for (uint32_t slot = 0; slot < table.size(); ++slot) shared.read(slot, table[slot]);
+        return make_base(table, index_kind ? index_kind : "", version);
+    }
+
+private:
+    const SharedCatalog& shared_;
+    std::string index_kind_;
+    utils::RcuCell<CatalogSnapshot> snapshot_;
+    uint64_t poll_us_;
+    size_t delta_max_;
+    std::atomic<bool> stop_{false};
+    std::atomic<uint64_t> rebuilds_{0};
+    std::thread poller_;
+
+    // poller-only state
+    std::vector<SharedCatalog::Hotel> table_; // by slot
+    uint64_t applied_ = 0;
+    std::shared_ptr<const CatalogBase> base_;
+    std::vector<int32_t> base_position_; // by slot: index in base_->hotels, or -1
+    std::vector<uint32_t> dirty_;        // slots changed since base_ was built
+    std::vector<uint8_t> is_dirty_;      // by slot
+
+    void run() {
+        while (!stop_.load(std::memory_order_relaxed)) {
+            std::this_thread::sleep_for(std::chrono::microseconds(poll_us_));
+            if (catch_up()) snapshot_.publish(build());
+        }
+    }
+
+    // Applies the changes since the last call; true if there were any.
+    bool catch_up() {
+        const uint64_t head = shared_.version();
+        if (head == applied_) return false;
+        if (head - applied_ > shared_.ring_size()) {
+            resync();
+            return true;
+        }
+        for (uint64_t seq = applied_ + 1; seq <= head; ++seq) {
+            uint32_t slot;
+            if (!shared_.change(seq, slot)) {
+                resync();
+                return true;
+            }
+            if (slot >= table_.size()) resize(slot + 1);
+            shared_.read(slot, table_[slot]);
+            mark_dirty(slot);
+        }
+        applied_ = head;
+        return true;
+    }
+
+    void resync() {
+        const uint64_t head = shared_.version();
+        const uint32_t used = shared_.slots_used();
+        resize(used);
+        for (uint32_t slot = 0; slot < used; ++slot) shared_.read(slot, table_[slot]);
+        applied_ = head; // changes after head are read again next time
+        base_.reset();   // forces a rebuild
+    }
+
+    // Starts from a prebuilt base: its hotels are the table as of its
+    // version, and the changes since are read as usual.
+    void adopt(std::shared_ptr<const CatalogBase> base) {
+        uint32_t used = 0;
+        for (uint32_t slot : base->slots) used = std::max(used, slot + 1);
+        resize(used);
+        for (size_t i = 0; i < base->hotels.size(); ++i) {
+            const Location& hotel = base->hotels[i];
+            table_[base->slots[i]] = SharedCatalog::Hotel{hotel.id, hotel.lat, hotel.lon, true};
+            base_position_[base->slots[i]] = static_cast<int32_t>(i);
+        }
+        applied_ = base->version;
+        base_ = std::move(base);
+        catch_up();
+    }
+
+    void resize(size_t slots) {
+        table_.resize(slots, SharedCatalog::Hotel{std::string(), 0, 0, false});
+        base_position_.resize(slots, -1);
+        is_dirty_.resize(slots, 0);
+    }
+
+    void mark_dirty(uint32_t slot) {
+        if (is_dirty_[slot]) return;
+        is_dirty_[slot] = 1;
+        dirty_.push_back(slot);
+    }
+
+    static std::shared_ptr<const CatalogBase> make_base(const std::vector<SharedCatalog::Hotel>& table,
+                                                        const std::string& index_kind, uint64_t version) {
+        std::shared_ptr<CatalogBase> base(new CatalogBase());
+        base->version = version;
+        base->hotels.reserve(table.size());
+        for (uint32_t slot = 0; slot < table.size(); ++slot) {
+            const auto& hotel = table[slot];
+            if (!hotel.live) continue;
+            base->hotels.push_back({hotel.id, hotel.lat, hotel.lon});
+            base->slots.push_back(slot);
+        }
+        base->index = make_geo_index(index_kind.empty() ? nullptr : index_kind.c_str(), base->hotels);
+        return base;
+    }
+
+    void rebuild() {
+        base_ = make_base(table_, index_kind_, applied_);
+        std::fill(base_position_.begin(), base_position_.end(), -1);
+        for (size_t i = 0; i < base_->slots.size(); ++i) base_position_[base_->slots[i]] = static_cast<int32_t>(i);
+        for (uint32_t slot : dirty_) is_dirty_[slot] = 0;
+        dirty_.clear();
+        rebuilds_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    std::unique_ptr<CatalogSnapshot> build() {
+        if (!base_ || dirty_.size() > delta_max_) rebuild();
+        std::unique_ptr<CatalogSnapshot> next(new CatalogSnapshot());
+        next->version = applied_;
+        next->base = base_;
+        next->removed.assign(base_->hotels.size(), 0);
+        for (uint32_t slot : dirty_) {
+            if (base_position_[slot] >= 0) next->removed[base_position_[slot]] = 1;
+            const auto& hotel = table_[slot];
+            if (hotel.live) next->delta.push_back({hotel.id, hotel.lat, hotel.lon});
+        }
+        next->delta_index.reset(new ScanIndex(next->delta));
+        return next;
+    }
+};
+
+} // namespace geo
+} // namespace microservice
@@ -0,0 +1,492 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "geo_kernels.h"
+
+namespace microservice {
+namespace geo {
+
+constexpr double kEarthRadiusKm = 6371.0;
+constexpr double kDegToRad = M_PI / 180.0;
+
+// Great-circle distance in kilometers (haversine), the distance every index
+// reports and filters by; bit for bit the distance GeoService used before.
+inline double haversine_km(double lat1, double lon1, double lat2, double lon2) {
+    double dlat = (lat2 - lat1) * M_PI / 180.0;
+    double dlon = (lon2 - lon1) * M_PI / 180.0;
+    double a = sin(dlat / 2) * sin(dlat / 2) +
+               cos(lat1 * M_PI / 180.0) * cos(lat2 * M_PI / 180.0) * sin(dlon / 2) * sin(dlon / 2);
+    double c = 2 * atan2(sqrt(a), sqrt(1 - a));
+    return kEarthRadiusKm * c;
+}
+
+inline double cos_lat(double lat) { return cos(lat * M_PI / 180.0); }
+
+// The same distance with both cos_lat() values precomputed; the result is
+// identical.
+inline double haversine_km(double lat1, double lon1, double cos_lat1, double lat2, double lon2, double cos_lat2) {
+    double dlat = (lat2 - lat1) * M_PI / 180.0;
+    double dlon = (lon2 - lon1) * M_PI / 180.0;
+    double a = sin(dlat / 2) * sin(dlat / 2) + cos_lat1 * cos_lat2 * sin(dlon / 2) * sin(dlon / 2);
+    double c = 2 * atan2(sqrt(a), sqrt(1 - a));
+    return kEarthRadiusKm * c;
+}
+
+inline void to_unit(double lat, double lon, double* v) {
+    double phi = lat * kDegToRad;
+    double lambda = lon * kDegToRad;
+    v[0] = cos(phi) * cos(lambda);
+    v[1] = cos(phi) * sin(lambda);
+    v[2] = sin(phi);
+}
+
+// Smallest unit-vector dot product of two locations at most distance_km
+// apart, lowered slightly so rounding never drops a location at exactly
+// that distance.
+inline double min_dot(double distance_km) {
+    double angle = distance_km / kEarthRadiusKm;
+    return angle >= M_PI ? -2.0 : cos(angle) - 1e-12;
+}
+
+struct Location {
+    std::string id;
+    double lat;
+    double lon;
+};
+
+struct Neighbor {
+    double distance_km;
+    uint32_t index;        // into the indexed locations
+    const std::string* id; // orders equal distances
+};
+
+// The locations an index scans, as a structure of arrays: unit vectors for
+// the dot-product prefilter (geo_kernels.h), and the degrees and cos_lat()
+// the exact distance of the survivors needs, so a scan touches neither the
+// ids nor anything it does not use.
+struct LocationArrays {
+    std::vector<double> x, y, z;
+    std::vector<double> lat, lon, cos_lat;
+    std::vector<uint32_t> index; // into the indexed locations
+
+    void reserve(size_t n) {
+        for (auto* v : {&x, &y, &z, &lat, &lon, &cos_lat}) v->reserve(n);
+        index.reserve(n);
+    }
+
+    void push(const Location& l, uint32_t i) {
+        double v[3];
+        to_unit(l.lat, l.lon, v);
+        x.push_back(v[0]);
+        y.push_back(v[1]);
+        z.push_back(v[2]);
+        lat.push_back(l.lat);
+        lon.push_back(l.lon);
+        cos_lat.push_back(geo::cos_lat(l.lat));
+        index.push_back(i);
+    }
+
+    size_t size() const { return index.size(); }
+};
+
+// The k nearest candidates seen so far, as a max-heap on (distance, id):
+// equal distances are ordered by id, so every index returns what sorting
+// all in-radius (distance, id) pairs would.
+class TopK {
+public:
+    explicit TopK(size_t k) : k_(k) { heap_.reserve(k); }
+
+    bool full() const { return heap_.size() == k_; }
+
+    // Distance a candidate must not exceed to enter; infinite until full.
+    double bound() const { return full() ? heap_.front().distance_km : std::numeric_limits<double>::infinity(); }
+
+    void push(double distance_km, uint32_t index, const std::string& id) {
+        Neighbor candidate{distance_km, index, &id};
+        if (!full()) {
+            heap_.push_back(candidate);
+            std::push_heap(heap_.begin(), heap_.end(), Closer());
+        } else if (Closer()(candidate, heap_.front())) {
+            std::pop_heap(heap_.begin(), heap_.end(), Closer());
+            heap_.back() = candidate;
+            std::push_heap(heap_.begin(), heap_.end(), Closer());
+        }
+    }
+
+    // Nearest first; leaves the heap empty.
+    void take_sorted(std::vector<Neighbor>& out) {
+        std::sort_heap(heap_.begin(), heap_.end(), Closer());
+        out.swap(heap_);
+        heap_.clear();
+    }
+
+private:
+    struct Closer {
+        bool operator()(const Neighbor& a, const Neighbor& b) const {
+            if (a.distance_km != b.distance_km) return a.distance_km < b.distance_km;
+            return *a.id < *b.id;
+        }
+    };
+
+    size_t k_;
+    std::vector<Neighbor> heap_;
+};
+
+// A query in the forms the scan needs. min_dot starts at the radius and
+// rises to the k-th nearest distance once k candidates are found.
+struct QueryPoint {
+    double lat, lon, cos_lat;
+    double v[3];
+    double radius_km;
+    double min_dot;
+    const uint8_t* skip = nullptr; // if set, locations i with skip[i] are left out
+    uint32_t index_base = 0;       // added to the reported indices
+
+    QueryPoint(double lat, double lon, double radius_km)
+        : lat(lat), lon(lon), cos_lat(geo::cos_lat(lat)), radius_km(radius_km), min_dot(geo::min_dot(radius_km)) {
+        to_unit(lat, lon, v);
+    }
+};
+
+// Radius-bounded k-nearest queries over a fixed set of locations, which
+// the index refers to and which must outlive it.
+class GeoIndex {
+public:
+    explicit GeoIndex(const std::vector<Location>& locations) : locations_(locations), filter_(dot_filter()) {}
+    virtual ~GeoIndex() = default;
+
+    GeoIndex(const GeoIndex&) = delete;
+    GeoIndex& operator=(const GeoIndex&) = delete;
+
+    virtual const char* name() const = 0;
+
+    // The k nearest locations within radius_km (inclusive) of lat/lon,
+    // nearest first.
+    void nearest(double lat, double lon, double radius_km, size_t k, std::vector<Neighbor>& out) const {
+        out.clear();
+        if (k == 0 || locations_.empty() || !std::isfinite(lat) || !std::isfinite(lon) || !(radius_km >= 0)) {
+            return;
+        }
+        TopK top(k);
+        QueryPoint q(lat, lon, radius_km);
+        search(q, top);
+        top.take_sorted(out);
+    }
+
+    // Adds this index's candidates for q to top, for queries over several
+    // indexes.
+    void collect(QueryPoint& q, TopK& top) const {
+        if (!locations_.empty()) search(q, top);
+    }
+
+protected:
+    const std::vector<Location>& locations_;
+    const DotFilter filter_;
+
+    virtual void search(QueryPoint& q, TopK& top) const = 0;
+
+    // Offers arrays[begin, end) to top: the SIMD prefilter on the whole
+    // range, then the exact distance for the survivors only.
+    void offer(const LocationArrays& arrays, uint32_t begin, uint32_t end, QueryPoint& q, TopK& top) const {
+        constexpr uint32_t kChunk = 1024;
+        uint32_t hits[kChunk];
+        for (uint32_t chunk = begin; chunk < end; chunk += kChunk) {
+            const uint32_t chunk_end = std::min(end, chunk + kChunk);
+            const uint32_t n = filter_(arrays.x.data(), arrays.y.data(), arrays.z.data(), chunk, chunk_end,
+                                       q.v, q.min_dot, hits);
+            for (uint32_t h = 0; h < n; ++h) {
+                const uint32_t i = hits[h];
+                const uint32_t index = arrays.index[i];
+                if (q.skip && q.skip[index]) continue;
+                double d = haversine_km(q.lat, q.lon, q.cos_lat, arrays.lat[i], arrays.lon[i], arrays.cos_lat[i]);
+                if (d > q.radius_km || d > top.bound()) continue;
+                top.push(d, q.index_base + index, locations_[index].id);
+                if (top.full()) q.min_dot = std::max(q.min_dot, geo::min_dot(top.bound()));
+            }
+        }
+    }
+};
+
+// Every location, every query: the former behavior, now through the
+// prefilter kernel over the arrays.
+class ScanIndex : public GeoIndex {
+public:
+    explicit ScanIndex(const std::vector<Location>& locations) : GeoIndex(locations) {
+        arrays_.reserve(locations.size());
+        for (size_t i = 0; i < locations.size(); ++i) arrays_.push(locations[i], static_cast<uint32_t>(i));
+    }
+
+    const char* name() const override { return "scan"; }
+
+protected:
+    void search(QueryPoint& q, TopK& top) const override {
+        offer(arrays_, 0, static_cast<uint32_t>(arrays_.size()), q, top);
+    }
+
+private:
+    LocationArrays arrays_;
+};
+
+// Latitude/longitude bounding box of a query circle, widened slightly so
+// rounding never leaves out a cell the circle touches.
+struct QueryBox {
+    double lat_lo, lat_hi;
+    double dlon;    // half-width in degrees of longitude
+    bool all_lon;   // the circle reaches a pole or wraps the whole globe
+
+    QueryBox(double lat, double radius_km) {
+        const double angle = radius_km / kEarthRadiusKm;
+        const double dlat = angle / kDegToRad * (1 + 1e-9) + 1e-9;
+        lat_lo = lat - dlat;
+        lat_hi = lat + dlat;
+        all_lon = lat_lo <= -90 || lat_hi >= 90 || angle >= M_PI / 2;
+        dlon = 180;
+        if (!all_lon) {
+            // widest longitude extent of a spherical cap that contains no pole
+            double s = sin(angle) / cos(lat * kDegToRad);
+            if (s >= 1) {
+                all_lon = true;
+            } else {
+                dlon = asin(s) / kDegToRad * (1 + 1e-9) + 1e-9;
+                if (dlon >= 180) all_lon = true;
+            }
+        }
+    }
+};
+
+// Fixed-size latitude/longitude cells. Locations are stored grouped by cell
+// in row-major cell order (CSR), so the cells of one row of the query's
+// bounding box are one contiguous run of the arrays: one binary search and
+// one prefilter pass per row. The cell size should be about the query
+// radius (GEO_GRID_CELL_DEG, default 0.1 degrees, ~11km of latitude).
+class GridIndex : public GeoIndex {
+public:
+    GridIndex(const std::vector<Location>& locations, double cell_deg)
+        : GeoIndex(locations), cell_deg_(cell_deg > 0 ? cell_deg : 0.1) {
+        rows_ = static_cast<int64_t>(ceil(180 / cell_deg_));
+        cols_ = static_cast<int64_t>(ceil(360 / cell_deg_));
+        std::vector<std::pair<uint64_t, uint32_t>> keyed;
+        keyed.reserve(locations.size());
+        for (size_t i = 0; i < locations.size(); ++i) {
+            keyed.push_back({cell_key(row(locations[i].lat), col(locations[i].lon)), static_cast<uint32_t>(i)});
+        }
+        std::sort(keyed.begin(), keyed.end());
+        arrays_.reserve(keyed.size());
+        for (size_t i = 0; i < keyed.size(); ++i) {
+            if (i == 0 || keyed[i].first != keyed[i - 1].first) {
+                keys_.push_back(keyed[i].first);
+                starts_.push_back(static_cast<uint32_t>(i));
+            }
+            arrays_.push(locations[keyed[i].second], keyed[i].second);
+        }
+        starts_.push_back(static_cast<uint32_t>(keyed.size()));
+    }
+
+    const char* name() const override { return "grid"; }
+
+    size_t cells() const { return keys_.size(); }
+
+protected:
+    void search(QueryPoint& q, TopK& top) const override {
+        const QueryBox box(q.lat, q.radius_km);
+        const int64_t row_lo = row(box.lat_lo);
+        const int64_t row_hi = row(box.lat_hi);
+        int64_t col_lo = 0;
+        int64_t col_hi = cols_ - 1;
+        if (!box.all_lon) {
+            col_lo = static_cast<int64_t>(floor((normalized_lon(q.lon) - box.dlon + 180) / cell_deg_));
+            col_hi = static_cast<int64_t>(floor((normalized_lon(q.lon) + box.dlon + 180) / cell_deg_));
+            if (col_hi - col_lo + 1 >= cols_) {
+                col_lo = 0;
+                col_hi = cols_ - 1;
+            }
+        }
+        for (int64_t r = row_lo; r <= row_hi; ++r) {
+            // a box across the antimeridian is two column runs
+            if (col_lo < 0) {
+                scan_run(r, 0, col_hi, q, top);
+                scan_run(r, col_lo + cols_, cols_ - 1, q, top);
+            } else if (col_hi >= cols_) {
+                scan_run(r, col_lo, cols_ - 1, q, top);
+                scan_run(r, 0, col_hi - cols_, q, top);
+            } else {
+                scan_run(r, col_lo, col_hi, q, top);
+            }
+        }
+    }
+
+private:
+    double cell_deg_;
+    int64_t rows_;
+    int64_t cols_;
+    std::vector<uint64_t> keys_;   // occupied cells, ascending
+    std::vector<uint32_t> starts_; // locations of keys_[i]: arrays_[starts_[i], starts_[i + 1])
+    LocationArrays arrays_;
+
+    static double normalized_lon(double lon) {
+        lon = fmod(lon + 180, 360.0);
+        if (lon < 0) lon += 360;
+        return lon - 180;
+    }
+
+    int64_t row(double lat) const {
+        int64_t r = static_cast<int64_t>(floor((std::max(-90.0, std::min(90.0, lat)) + 90) / cell_deg_));
+        return std::max<int64_t>(0, std::min(rows_ - 1, r));
+    }
+
+    int64_t col(double lon) const {
+        int64_t c = static_cast<int64_t>(floor((normalized_lon(lon) + 180) / cell_deg_));
+        return std::max<int64_t>(0, std::min(cols_ - 1, c));
+    }
+
+    uint64_t cell_key(int64_t r, int64_t c) const { return static_cast<uint64_t>(r * cols_ + c); }
+
+    void scan_run(int64_t r, int64_t c_lo, int64_t c_hi, QueryPoint& q, TopK& top) const {
+        auto first = std::lower_bound(keys_.begin(), keys_.end(), cell_key(r, c_lo));
+        auto last = std::upper_bound(first, keys_.end(), cell_key(r, c_hi));
+        if (first == last) return;
+        offer(arrays_, starts_[first - keys_.begin()], starts_[last - keys_.begin()], q, top);
+    }
+};
+
+// k-d tree over the locations as unit vectors. Straight-line (chord)
+// distance between unit vectors grows monotonically with great-circle
+// distance (chord^2 = 2 - 2 dot), so planar pruning is exact on the
+// sphere, with no special cases at the poles or the antimeridian. The
+// arrays are kept in tree order, so a leaf is one prefilter pass.
+class KdTreeIndex : public GeoIndex {
+public:
+    explicit KdTreeIndex(const std::vector<Location>& locations) : GeoIndex(locations) {
+        std::vector<Point> points;
+        points.reserve(locations.size());
+        for (size_t i = 0; i < locations.size(); ++i) {
+            Point p;
+            to_unit(locations[i].lat, locations[i].lon, p.v);
+            p.index = static_cast<uint32_t>(i);
+            points.push_back(p);
+        }
+        axes_.assign(points.size(), 0);
+        build(points, 0, points.size());
+        arrays_.reserve(points.size());
+        for (const Point& p : points) arrays_.push(locations[p.index], p.index);
+        coords_[0] = arrays_.x.data();
+        coords_[1] = arrays_.y.data();
+        coords_[2] = arrays_.z.data();
+    }
+
+    const char* name() const override { return "kdtree"; }
+
+protected:
+    void search(QueryPoint& q, TopK& top) const override {
+        visit(0, static_cast<uint32_t>(arrays_.size()), q, top);
+    }
+
+private:
+    static constexpr uint32_t kLeafSize = 16;
+
+    struct Point {
+        double v[3];
+        uint32_t index;
+    };
+
+    LocationArrays arrays_;     // in tree order
+    const double* coords_[3];   // arrays_.x/y/z by axis
+    std::vector<uint8_t> axes_; // split axis of the node at the middle of each range
+
+    void build(std::vector<Point>& points, size_t lo, size_t hi) {
+        if (hi - lo <= kLeafSize) return;
+        double min[3] = {2, 2, 2};
+        double max[3] = {-2, -2, -2};
+        for (size_t i = lo; i < hi; ++i) {
+            for (int a = 0; a < 3; ++a) {
+                min[a] = std::min(min[a], points[i].v[a]);
+                max[a] = std::max(max[a], points[i].v[a]);
+            }
+        }
+        uint8_t axis = 0;
+        for (uint8_t a = 1; a < 3; ++a) {
+            if (max[a] - min[a] > max[axis] - min[axis]) axis = a;
+        }
+        size_t mid = lo + (hi - lo) / 2;
+        std::nth_element(points.begin() + lo, points.begin() + mid, points.begin() + hi,
+                         [axis](const Point& a, const Point& b) { return a.v[axis] < b.v[axis]; });
+        axes_[mid] = axis;
+        build(points, lo, mid);
+        build(points, mid + 1, hi);
+    }
+
+    void visit(uint32_t lo, uint32_t hi, QueryPoint& q, TopK& top) const {
+        if (hi - lo <= kLeafSize) {
+            offer(arrays_, lo, hi, q, top);
+            return;
+        }
+        uint32_t mid = lo + (hi - lo) / 2;
+        const uint8_t axis = axes_[mid];
+        offer(arrays_, mid, mid + 1, q, top);
+        double diff = q.v[axis] - coords_[axis][mid];
+        if (diff < 0) {
+            visit(lo, mid, q, top);
+            if (diff * diff <= 2 - 2 * q.min_dot) visit(mid + 1, hi, q, top);
+        } else {
+            visit(mid + 1, hi, q, top);
+            if (diff * diff <= 2 - 2 * q.min_dot) visit(lo, mid, q, top);
+        }
+    }
+};
+
+// Z-order (Morton) code of a location's cell in a 65536 x 65536 grid over
+// the globe (~0.003 x 0.005 degrees); nearby cells mostly get nearby codes.
+inline uint32_t morton_code(double lat, double lon) {
+    auto quantize = [](double unit) -> uint32_t {
+        if (!(unit > 0)) return 0;
+        return unit >= 1 ? 0xffff : static_cast<uint32_t>(unit * 65536);
+    };
+    auto spread = [](uint32_t v) {
+        v = (v | (v << 8)) & 0x00ff00ff;
+        v = (v | (v << 4)) & 0x0f0f0f0f;
+        v = (v | (v << 2)) & 0x33333333;
+        v = (v | (v << 1)) & 0x55555555;
+        return v;
+    };
+    double wrapped = fmod(lon + 180, 360.0);
+    if (wrapped < 0) wrapped += 360;
+    return spread(quantize((lat + 90) / 180)) << 1 | spread(quantize(wrapped / 360));
+}
+
+// Positions of n query points in Z-order, so that answering them in that
+// order walks the index cell by cell instead of jumping across it.
+template <typename LatLon>
+void spatial_order(size_t n, LatLon&& lat_lon, std::vector<uint32_t>& order) {
+    std::vector<std::pair<uint32_t, uint32_t>> keyed(n);
+    for (size_t i = 0; i < n; ++i) {
+        double lat, lon;
+        lat_lon(i, lat, lon);
+        keyed[i] = {morton_code(lat, lon), static_cast<uint32_t>(i)};
+    }
+    std::sort(keyed.begin(), keyed.end());
+    order.resize(n);
+    for (size_t i = 0; i < n; ++i) order[i] = keyed[i].second;
+}
+
+// GEO_INDEX=kdtree|grid|scan (default kdtree, the fastest at every catalog
+// size in experiments/geo_bench); GEO_GRID_CELL_DEG sizes the grid's cells.
+inline std::unique_ptr<GeoIndex> make_geo_index(const char* kind, const std::vector<Location>& locations) {
+    if (kind && strcmp(kind, "scan") == 0) return std::unique_ptr<GeoIndex>(new ScanIndex(locations));
+    if (kind && strcmp(kind, "grid") == 0) {
+        const char* cell = getenv("GEO_GRID_CELL_DEG");
+        return std::unique_ptr<GeoIndex>(new GridIndex(locations, cell ? strtod(cell, nullptr) : 0.1));
+    }
+    return std::unique_ptr<GeoIndex>(new KdTreeIndex(locations));
+}
+
+} // namespace geo
+} // namespace microservice
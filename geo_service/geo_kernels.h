@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace microservice {
+namespace geo {
+
+// Distance prefilter over unit vectors stored as separate x/y/z arrays:
+// writes to out the indices i in [begin, end) whose dot product with the
+// query vector q is at least min_dot, and returns how many. out must hold
+// end - begin entries.
+//
+// The dot product of two unit vectors is the cosine of the angle between
+// them, so "within distance r" is "dot >= cos(r / R)": three multiply-adds
+// per location instead of the haversine's trigonometry. Callers widen
+// min_dot slightly and compute the exact distance for the survivors only.
+using DotFilter = uint32_t (*)(const double* x, const double* y, const double* z, uint32_t begin, uint32_t end,
+                               const double* q, double min_dot, uint32_t* out);
+
+inline uint32_t dot_filter_scalar(const double* x, const double* y, const double* z, uint32_t begin, uint32_t end,
+                                  const double* q, double min_dot, uint32_t* out) {
+    uint32_t n = 0;
+    for (uint32_t i = begin; i < end; ++i) {
+        if (x[i] * q[0] + y[i] * q[1] + z[i] * q[2] >= min_dot) out[n++] = i;
+    }
+    return n;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("avx2,fma")))
+inline uint32_t dot_filter_avx2(const double* x, const double* y, const double* z, uint32_t begin, uint32_t end,
+                                const double* q, double min_dot, uint32_t* out) {
+    const __m256d qx = _mm256_set1_pd(q[0]);
+    const __m256d qy = _mm256_set1_pd(q[1]);
+    const __m256d qz = _mm256_set1_pd(q[2]);
+    const __m256d threshold = _mm256_set1_pd(min_dot);
+    uint32_t n = 0;
+    uint32_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        __m256d dot = _mm256_mul_pd(_mm256_loadu_pd(x + i), qx);
+        dot = _mm256_fmadd_pd(_mm256_loadu_pd(y + i), qy, dot);
+        dot = _mm256_fmadd_pd(_mm256_loadu_pd(z + i), qz, dot);
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_pd(_mm256_cmp_pd(dot, threshold, _CMP_GE_OQ)));
+        while (mask) {
+            out[n++] = i + static_cast<uint32_t>(__builtin_ctz(mask));
+            mask &= mask - 1;
+        }
+    }
+    return n + dot_filter_scalar(x, y, z, i, end, q, min_dot, out + n);
+}
+
+__attribute__((target("avx512f")))
+inline uint32_t dot_filter_avx512(const double* x, const double* y, const double* z, uint32_t begin, uint32_t end,
+                                  const double* q, double min_dot, uint32_t* out) {
+    const __m512d qx = _mm512_set1_pd(q[0]);
+    const __m512d qy = _mm512_set1_pd(q[1]);
+    const __m512d qz = _mm512_set1_pd(q[2]);
+    const __m512d threshold = _mm512_set1_pd(min_dot);
+    uint32_t n = 0;
+    uint32_t i = begin;
+    for (; i + 8 <= end; i += 8) {
+        __m512d dot = _mm512_mul_pd(_mm512_loadu_pd(x + i), qx);
+        dot = _mm512_fmadd_pd(_mm512_loadu_pd(y + i), qy, dot);
+        dot = _mm512_fmadd_pd(_mm512_loadu_pd(z + i), qz, dot);
+        unsigned mask = _mm512_cmp_pd_mask(dot, threshold, _CMP_GE_OQ);
+        while (mask) {
+            out[n++] = i + static_cast<uint32_t>(__builtin_ctz(mask));
+            mask &= mask - 1;
+        }
+    }
+    return n + dot_filter_scalar(x, y, z, i, end, q, min_dot, out + n);
+}
+#endif
+
+// The widest kernel the CPU supports, chosen once per process;
+// GEO_SIMD=scalar|avx2|avx512 caps it.
+inline DotFilter dot_filter() {
+    static const DotFilter selected = [] {
+        const char* cap = getenv("GEO_SIMD");
+#if defined(__x86_64__)
+        __builtin_cpu_init();
+        const bool allow512 = !cap || strcmp(cap, "avx512") == 0;
+        const bool allow256 = allow512 || strcmp(cap, "avx2") == 0;
+        if (allow512 && __builtin_cpu_supports("avx512f")) return &dot_filter_avx512;
+        if (allow256 && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return &dot_filter_avx2;
+#else
+        (void)cap;
+#endif
+        return &dot_filter_scalar;
+    }();
+    return selected;
+}
+
+inline const char* dot_filter_name() {
+    DotFilter f = dot_filter();
+#if defined(__x86_64__)
+    if (f == &dot_filter_avx512) return "avx512";
+    if (f == &dot_filter_avx2) return "avx2";
+#endif
+    return f == &dot_filter_scalar ? "scalar" : "unknown";
+}
+
+} // namespace geo
+} // namespace microservice
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "timing_utils.h"
+#include "trace_utils.h"
+
+// Set to 0 to make ProfiledMutex a plain std::mutex.
+#ifndef ENABLE_LOCK_PROFILING
+#define ENABLE_LOCK_PROFILING 1
+#endif
+
+namespace microservice {
+namespace utils {
+
+#if ENABLE_LOCK_PROFILING
+
+// Mutex that records, per named lock, how often acquisition had to wait and
+// log2 histograms of wait and hold times.
+//
+// Contention is detected with try_lock(), so an uncontended acquisition of an
+// untraced request costs one extra atomic increment. Wait and hold times are
+// measured only while the current request is sampled (trace_utils.h).
+//
+// Stats are written next to the request latency logs, as
+// /logs/lock_<name>_<service>_<host>_<pid>.txt (process_log_name()), at most
+// once a second from unlock().
+class ProfiledMutex {
+public:
+    static constexpr int kBuckets = 40; // bucket i counts durations in [2^(i-1), 2^i) ns
+
+    explicit ProfiledMutex(const char* name) : name_(name) {}
+
+    ProfiledMutex(const ProfiledMutex&) = delete;
+    ProfiledMutex& operator=(const ProfiledMutex&) = delete;
+
+    void lock() {
+        const bool timed = trace_active();
+        const TscClock& clock = TscClock::instance();
+        acquisitions_.fetch_add(1, std::memory_order_relaxed);
+        if (mutex_.try_lock()) {
+            if (timed) record(wait_hist_, wait_total_ns_, 0);
+        } else {
+            contended_.fetch_add(1, std::memory_order_relaxed);
+            uint64_t start = timed ? clock.now() : 0;
+            mutex_.lock();
+            if (timed) record(wait_hist_, wait_total_ns_, clock.interval_ns(start, clock.now_end()));
+        }
+        hold_start_ = timed ? clock.now() : 0;
+    }
+
+    bool try_lock() {
+        if (!mutex_.try_lock()) {
+            return false;
+        }
+        acquisitions_.fetch_add(1, std::memory_order_relaxed);
+        hold_start_ = trace_active() ? TscClock::instance().now() : 0;
+        return true;
+    }
+
+    void unlock() {
+        uint64_t start = hold_start_; // still ours until the unlock below
+        mutex_.unlock();
+        const TscClock& clock = TscClock::instance();
+        if (start) {
+            uint64_t end = clock.now_end();
+            record(hold_hist_, hold_total_ns_, clock.interval_ns(start, end));
+            maybe_flush(end);
+        } else {
+            // the counters grow on every acquisition, sampled or not
+            maybe_flush(clock.now());
+        }
+    }
+
+    const char* name() const { return name_; }
+    uint64_t acquisitions() const { return acquisitions_.load(std::memory_order_relaxed); }
+    uint64_t contended() const { return contended_.load(std::memory_order_relaxed); }
+
+    // Writes the current counters and histograms; called periodically from
+    // unlock(), and safe to call from anywhere else.
+    void flush() const {
+        struct stat st = {};
+        if (stat("/logs", &st) == -1) {
+            mkdir("/logs", 0777);
+        }
+        std::string path = "/logs/lock_" + std::string(name_) + "_" + process_log_name() + ".txt";
+        std::string tmp = path + ".tmp";
+        FILE* f = fopen(tmp.c_str(), "w");
+        if (!f) return;
+        fprintf(f, "lock %s\n", name_);
+        fprintf(f, "acquisitions %llu\n", (unsigned long long)acquisitions());
+        fprintf(f, "contended %llu\n", (unsigned long long)contended());
+        fprintf(f, "wait_total_ns %llu\n", (unsigned long long)wait_total_ns_.load(std::memory_order_relaxed));
+        fprintf(f, "hold_total_ns %llu\n", (unsigned long long)hold_total_ns_.load(std::memory_order_relaxed));
+        fprintf(f, "# bucket_upper_ns wait_count hold_count\n");
+        for (int i = 0; i < kBuckets; ++i) {
+            uint64_t w = wait_hist_[i].load(std::memory_order_relaxed);
+            uint64_t h = hold_hist_[i].load(std::memory_order_relaxed);
+            if (w || h) {
+                fprintf(f, "%llu %llu %llu\n", 1ull << i, (unsigned long long)w, (unsigned long long)h);
+            }
+        }
+        fclose(f);
+        rename(tmp.c_str(), path.c_str());
+    }
+
+private:
+    std::mutex mutex_;
+    const char* name_;
+    uint64_t hold_start_ = 0;
+
+    std::atomic<uint64_t> acquisitions_{0};
+    std::atomic<uint64_t> contended_{0};
+    std::atomic<uint64_t> wait_total_ns_{0};
+    std::atomic<uint64_t> hold_total_ns_{0};
+    std::atomic<uint64_t> wait_hist_[kBuckets] = {};
+    std::atomic<uint64_t> hold_hist_[kBuckets] = {};
+    std::atomic<uint64_t> last_flush_{0};
+
+    static int bucket_of(uint64_t ns) {
+        int b = ns ? 64 - __builtin_clzll(ns) : 0;
+        return b < kBuckets ? b : kBuckets - 1;
+    }
+
+    static void record(std::atomic<uint64_t>* hist, std::atomic<uint64_t>& total, uint64_t ns) {
+        hist[bucket_of(ns)].fetch_add(1, std::memory_order_relaxed);
+        total.fetch_add(ns, std::memory_order_relaxed);
+    }
+
+    void maybe_flush(uint64_t now) {
+        const TscClock& clock = TscClock::instance();
+        uint64_t last = last_flush_.load(std::memory_order_relaxed);
+        if (last && clock.to_ns(now - last) < 1000000000ull) return;
+        if (last_flush_.compare_exchange_strong(last, now, std::memory_order_relaxed)) {
+            flush();
+        }
+    }
+};
+
+#else
+
+class ProfiledMutex : public std::mutex {
+public:
+    explicit ProfiledMutex(const char*) {}
+};
+
+#endif
+
+} // namespace utils
+} // namespace microservice
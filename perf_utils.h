@@ -0,0 +1,279 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "timing_utils.h"
+#include "trace_utils.h"
+
+// Set to 0 to compile the counter sampling out entirely.
+#ifndef ENABLE_PERF_COUNTERS
+#define ENABLE_PERF_COUNTERS 1
+#endif
+
+namespace microservice {
+namespace utils {
+
+// Hardware performance counters around the deserialize / handler / serialize
+// phases of a worker.
+//
+// Enabled at runtime with PERF_COUNTERS=1 and then read only for sampled
+// requests (trace_utils.h). Opens one perf_event_open group per worker:
+// cycles, instructions, cache misses, branch misses and context switches. If
+// the PMU is not reachable (VMs, restricted containers) it falls back to a
+// software group: task clock, page faults, context switches.
+//
+// When other perf users leave the PMU short, the kernel multiplexes the
+// group: it counts only part of the time. Each phase's counts are scaled
+// by the time the group was enabled over the time it ran, and the file
+// reports the fraction it ran, so a multiplexed phase is visible.
+//
+// Per-endpoint, per-phase averages are written to
+// /logs/perf_<service>_<pid>.txt at most once a second.
+class PerfProfiler {
+public:
+    enum Phase { kDeserialize, kHandler, kSerialize, kNumPhases };
+    static constexpr int kNumEvents = 5;
+
+    // One group read: PERF_FORMAT_GROUP with both total times.
+    struct Reading {
+        uint64_t enabled_ns;
+        uint64_t running_ns;
+        uint64_t values[kNumEvents];
+    };
+
+    static PerfProfiler& instance() {
+        static PerfProfiler profiler;
+        return profiler;
+    }
+
+    bool enabled() const { return enabled_; }
+
+    // Counts one phase of the current request while in scope.
+    class Scope {
+    public:
+        Scope(const char* service, const char* endpoint, Phase phase)
+            : profiler_(instance()), active_(false) {
+#if ENABLE_PERF_COUNTERS
+            if (profiler_.enabled_ && trace_active() && profiler_.read(start_)) {
+                active_ = true;
+                service_ = service;
+                endpoint_ = endpoint;
+                phase_ = phase;
+            }
+#else
+            (void)service; (void)endpoint; (void)phase;
+#endif
+        }
+
+        ~Scope() {
+#if ENABLE_PERF_COUNTERS
+            Reading end;
+            if (active_ && profiler_.read(end)) {
+                profiler_.accumulate(service_, endpoint_, phase_, start_, end);
+            }
+#endif
+        }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        PerfProfiler& profiler_;
+        bool active_;
+        const char* service_ = nullptr;
+        const char* endpoint_ = nullptr;
+        Phase phase_ = kHandler;
+        Reading start_ = {};
+    };
+
+    // Writes the per-phase averages if a second has passed since the last
+    // write. Workers call this after each request.
+    void maybe_flush() {
+        if (!enabled_ || stats_.empty()) return;
+        const TscClock& clock = TscClock::instance();
+        uint64_t now = clock.now();
+        if (last_flush_ && clock.to_ns(now - last_flush_) < 1000000000ull) return;
+        last_flush_ = now;
+        flush();
+    }
+
+    void flush() const {
+        if (stats_.empty()) return;
+        struct stat st = {};
+        if (stat("/logs", &st) == -1) {
+            mkdir("/logs", 0777);
+        }
+        std::string path = "/logs/perf_" + std::string(stats_[0].service) + "_" +
+                           std::to_string(getpid()) + ".txt";
+        std::string tmp = path + ".tmp";
+        FILE* f = fopen(tmp.c_str(), "w");
+        if (!f) return;
+        static const char* phase_names[kNumPhases] = {"deserialize", "handler", "serialize"};
+        fprintf(f, "# mode %s (per-request averages)\n", hardware_ ? "hardware" : "software");
+        fprintf(f, "# counts scaled for multiplexing; running = fraction of the phases the group was counting\n");
+        fprintf(f, "# endpoint phase count");
+        for (int e = 0; e < kNumEvents; ++e) fprintf(f, " %s", event_names()[e]);
+        if (hardware_) fprintf(f, " ipc");
+        fprintf(f, " running\n");
+        for (const auto& s : stats_) {
+            if (!s.count) continue;
+            fprintf(f, "%s %s %llu", s.endpoint, phase_names[s.phase], (unsigned long long)s.count);
+            for (int e = 0; e < kNumEvents; ++e) {
+                fprintf(f, " %.1f", s.totals[e] / s.count);
+            }
+            if (hardware_) {
+                fprintf(f, " %.3f", s.totals[0] ? s.totals[1] / s.totals[0] : 0.0);
+            }
+            fprintf(f, " %.3f", s.enabled_ns ? static_cast<double>(s.running_ns) / s.enabled_ns : 1.0);
+            fprintf(f, "\n");
+        }
+        fclose(f);
+        rename(tmp.c_str(), path.c_str());
+    }
+
+private:
+    struct PhaseStats {
+        const char* service;
+        const char* endpoint;
+        Phase phase;
+        uint64_t count;
+        double totals[kNumEvents]; // scaled
+        uint64_t enabled_ns;
+        uint64_t running_ns;
+    };
+
+    bool enabled_ = false;
+    bool hardware_ = false;
+    int group_fd_ = -1;
+    std::vector<int> fds_;
+    std::vector<PhaseStats> stats_;
+    uint64_t last_flush_ = 0;
+
+    PerfProfiler() {
+#if ENABLE_PERF_COUNTERS
+        const char* env = getenv("PERF_COUNTERS");
+        if (!env || strcmp(env, "1") != 0) return;
+        static const std::pair<uint32_t, uint64_t> hardware_events[kNumEvents] = {
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+            {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+        };
+        static const std::pair<uint32_t, uint64_t> software_events[kNumEvents] = {
+            {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+            {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS_MIN},
+            {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS_MAJ},
+            {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS},
+            {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+        };
+        hardware_ = open_group(hardware_events);
+        if (!hardware_ && !open_group(software_events)) {
+            perror("perf_event_open");
+            return;
+        }
+        enabled_ = true;
+        std::cout << "Worker " << getpid() << " perf counters: "
+                  << (hardware_ ? "hardware" : "software fallback") << std::endl;
+#endif
+    }
+
+    ~PerfProfiler() {
+        for (int fd : fds_) close(fd);
+    }
+
+    const char* const* event_names() const {
+        static const char* hardware[kNumEvents] = {
+            "cycles", "instructions", "cache_misses", "branch_misses", "context_switches"};
+        static const char* software[kNumEvents] = {
+            "task_clock_ns", "minor_faults", "major_faults", "cpu_migrations", "context_switches"};
+        return hardware_ ? hardware : software;
+    }
+
+    static int perf_event_open(perf_event_attr* attr, int group_fd) {
+        return static_cast<int>(syscall(__NR_perf_event_open, attr, 0, -1, group_fd, 0));
+    }
+
+    bool open_group(const std::pair<uint32_t, uint64_t> (&events)[kNumEvents]) {
+        // Count kernel time too when perf_event_paranoid allows it; the
+        // handler phase of fan-out services is mostly socket syscalls.
+        for (int exclude_kernel = 0; exclude_kernel <= 1; ++exclude_kernel) {
+            std::vector<int> fds;
+            for (int e = 0; e < kNumEvents; ++e) {
+                perf_event_attr attr;
+                memset(&attr, 0, sizeof(attr));
+                attr.size = sizeof(attr);
+                attr.type = events[e].first;
+                attr.config = events[e].second;
+                attr.disabled = (e == 0);
+                attr.exclude_kernel = exclude_kernel;
+                attr.exclude_hv = 1;
+                attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                                   PERF_FORMAT_TOTAL_TIME_RUNNING;
+                int fd = perf_event_open(&attr, e == 0 ? -1 : fds[0]);
+                if (fd < 0) break;
+                fds.push_back(fd);
+            }
+            if (static_cast<int>(fds.size()) == kNumEvents) {
+                fds_ = fds;
+                group_fd_ = fds[0];
+                ioctl(group_fd_, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+                ioctl(group_fd_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+                return true;
+            }
+            for (int fd : fds) close(fd);
+        }
+        return false;
+    }
+
+    bool read(Reading& reading) const {
+        uint64_t buf[3 + kNumEvents]; // nr, time_enabled, time_running, values
+        if (::read(group_fd_, buf, sizeof(buf)) != static_cast<ssize_t>(sizeof(buf)) ||
+            buf[0] != static_cast<uint64_t>(kNumEvents)) {
+            return false;
+        }
+        reading.enabled_ns = buf[1];
+        reading.running_ns = buf[2];
+        memcpy(reading.values, buf + 3, sizeof(uint64_t) * kNumEvents);
+        return true;
+    }
+
+    void accumulate(const char* service, const char* endpoint, Phase phase,
+                    const Reading& start, const Reading& end) {
+        PhaseStats* s = nullptr;
+        for (auto& candidate : stats_) {
+            if (candidate.phase == phase && strcmp(candidate.endpoint, endpoint) == 0) {
+                s = &candidate;
+                break;
+            }
+        }
+        if (!s) {
+            stats_.push_back(PhaseStats{service, endpoint, phase, 0, {}, 0, 0});
+            s = &stats_.back();
+        }
+        const uint64_t enabled = end.enabled_ns - start.enabled_ns;
+        const uint64_t running = end.running_ns - start.running_ns;
+        // counted for running of enabled ns: extrapolate to the whole phase
+        const double scale = running && running < enabled ? static_cast<double>(enabled) / running : 1.0;
+        s->count++;
+        s->enabled_ns += enabled;
+        s->running_ns += running;
+        for (int e = 0; e < kNumEvents; ++e) {
+            s->totals[e] += static_cast<double>(end.values[e] - start.values[e]) * scale;
+        }
+    }
+};
+
+} // namespace utils
+} // namespace microservice
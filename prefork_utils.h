@@ -9,6 +9,13 @@
 #include <cstring>
 #include <vector>
 #include <algorithm>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include "timing_utils.h"
+#include "trace_utils.h"
+#include "rpc_utils.h"
+#include "perf_utils.h"
 
 class PreforkServer {
 private:
@@ -16,12 +23,20 @@ private:
     int num_workers_;
     std::vector<pid_t> worker_pids_;
     bool should_stop_;
+    bool is_worker_ = false;
 
 public:
     PreforkServer(int NUM_WORKERS = 16) : num_workers_(NUM_WORKERS), should_stop_(false) {
         // Set up signal handlers for graceful shutdown
         signal(SIGTERM, [](int) { /* handled in main loop */ });
         signal(SIGINT, [](int) { /* handled in main loop */ });
+        // A caller that gave up at its deadline has closed its end; the
+        // late response write must fail with EPIPE, not kill the worker
+        signal(SIGPIPE, SIG_IGN);
+        // Calibrate the timing clock and map the shared trace control block
+        // once here so forked workers inherit both
+        microservice::utils::TscClock::instance().report("Prefork server");
+        microservice::utils::trace_control();
     }
 
     ~PreforkServer() {
@@ -70,6 +85,7 @@ public:
             
             if (pid == 0) {
                 // Worker process
+                is_worker_ = true;
                 std::cout << "Worker process " << getpid() << " started" << std::endl;
                 return true; // Return true to indicate this is a worker
             } else if (pid > 0) {
@@ -87,7 +103,9 @@ public:
         return false; // Return false to indicate this is the master
     }
 
-    // Master process main loop
+    // Master process main loop. Also returns in a worker it restarted,
+    // which then serves like the others: data built before fork_workers()
+    // is already there, so a restart costs one fork.
     void master_loop() {
         std::cout << "Master process waiting for workers..." << std::endl;
         
@@ -109,6 +127,7 @@ public:
                 pid_t new_pid = fork();
                 if (new_pid == 0) {
                     // New worker process
+                    is_worker_ = true;
                     std::cout << "Restarted worker process " << getpid() << std::endl;
                     return; // Return to indicate this is a worker
                 } else if (new_pid > 0) {
@@ -138,8 +157,145 @@ public:
 
     // Set stop flag for graceful shutdown
     void stop() { should_stop_ = true; }
+
+    // Whether this process is a worker (fork_workers() or master_loop()
+    // returned in it).
+    bool is_worker() const { return is_worker_; }
 };
 
+// Answers a kFlagBatch frame: each item is handled as a request of its own
+// by handle(item, response) -> bool, and the responses go back as one batch
+// in item order, with the items handle() refused marked failed. Returns
+// false, sending nothing, if the payload is not a valid batch.
+template<typename Handle>
+bool serve_batch(int client_fd, const std::string& payload, Handle&& handle) {
+    std::vector<std::string> items;
+    if (!microservice::rpc::decode_batch(payload, items)) return false;
+    std::vector<std::string> responses(items.size());
+    std::vector<const std::string*> answers(items.size(), nullptr);
+    for (size_t i = 0; i < items.size(); ++i) {
+        if (handle(items[i], responses[i])) answers[i] = &responses[i];
+    }
+    std::string resp_str;
+    microservice::rpc::encode_batch(answers, resp_str);
+    microservice::rpc::write_response(client_fd, resp_str);
+    return true;
+}
+
+// Whether ServiceType has process_batch(const std::vector<RequestType>&,
+// std::vector<ResponseType>&), answering a whole kFlagBatch frame at once.
+template<typename ServiceType, typename RequestType, typename ResponseType, typename = void>
+struct has_process_batch : std::false_type {};
+
+template<typename ServiceType, typename RequestType, typename ResponseType>
+struct has_process_batch<ServiceType, RequestType, ResponseType,
+                         decltype(void(std::declval<ServiceType&>().process_batch(
+                             std::declval<const std::vector<RequestType>&>(),
+                             std::declval<std::vector<ResponseType>&>())))> : std::true_type {};
+
+// serve_batch() for services with process_batch(): the items that
+// deserialize go to one process_batch() call, the rest are marked failed.
+template<typename ServiceType, typename RequestType, typename ResponseType>
+bool serve_whole_batch(int client_fd, const std::string& payload, ServiceType& service, Ser1de_re& ser1de,
+                       const char* service_name, const char* endpoint_name) {
+    using Perf = microservice::utils::PerfProfiler;
+    std::vector<std::string> items;
+    if (!microservice::rpc::decode_batch(payload, items)) return false;
+    std::vector<RequestType> requests;
+    std::vector<size_t> positions; // item of each request
+    requests.reserve(items.size());
+    {
+        Perf::Scope phase(service_name, endpoint_name, Perf::kDeserialize);
+        for (size_t i = 0; i < items.size(); ++i) {
+            requests.emplace_back();
+            if (microservice::utils::deserialize_message(ser1de, items[i], requests.back())) {
+                positions.push_back(i);
+            } else {
+                requests.pop_back();
+            }
+        }
+    }
+    std::vector<ResponseType> responses(requests.size());
+    {
+        Perf::Scope phase(service_name, endpoint_name, Perf::kHandler);
+        service.process_batch(requests, responses);
+    }
+    std::vector<std::string> encoded(items.size());
+    std::vector<const std::string*> answers(items.size(), nullptr);
+    {
+        Perf::Scope phase(service_name, endpoint_name, Perf::kSerialize);
+        for (size_t r = 0; r < responses.size(); ++r) {
+            encoded[positions[r]] = microservice::utils::serialize_message(ser1de, responses[r]);
+            answers[positions[r]] = &encoded[positions[r]];
+        }
+    }
+    std::string resp_str;
+    microservice::rpc::encode_batch(answers, resp_str);
+    microservice::rpc::write_response(client_fd, resp_str);
+    return true;
+}
+
+template<typename ServiceType, typename RequestType, typename ResponseType, typename Handle>
+bool serve_batch_frame(int client_fd, const std::string& payload, ServiceType& service, Ser1de_re& ser1de,
+                       const char* service_name, const char* endpoint_name, Handle&, std::true_type) {
+    return serve_whole_batch<ServiceType, RequestType, ResponseType>(client_fd, payload, service, ser1de,
+                                                                     service_name, endpoint_name);
+}
+
+template<typename ServiceType, typename RequestType, typename ResponseType, typename Handle>
+bool serve_batch_frame(int client_fd, const std::string& payload, ServiceType&, Ser1de_re&,
+                       const char*, const char*, Handle& handle, std::false_type) {
+    return serve_batch(client_fd, payload, handle);
+}
+
+// Whether ServiceType has encode_response(const RequestType&, std::string&)
+// -> bool, writing a request's serialized response itself (e.g. from bytes
+// it stores pre-encoded) or returning false to fall back to
+// process_request(). Such bytes are protobuf wire format, so the hook is
+// skipped when ser1de does the serializing.
+template<typename ServiceType, typename RequestType, typename = void>
+struct has_encode_response : std::false_type {};
+
+template<typename ServiceType, typename RequestType>
+struct has_encode_response<ServiceType, RequestType,
+                           decltype(void(std::declval<ServiceType&>().encode_response(
+                               std::declval<const RequestType&>(), std::declval<std::string&>())))>
+    : std::integral_constant<bool, !USE_SER1DE> {};
+
+template<typename ServiceType, typename RequestType>
+bool encode_response(ServiceType& service, const RequestType& request, std::string& resp_str, std::true_type) {
+    return service.encode_response(request, resp_str);
+}
+
+template<typename ServiceType, typename RequestType>
+bool encode_response(ServiceType&, const RequestType&, std::string&, std::false_type) {
+    return false;
+}
+
+// Whether ServiceType has process_request(const RequestType&, ResponseType&)
+// -> bool, for handlers that can fail (e.g. when a downstream call does):
+// false leaves the request unanswered, which the caller sees as a failed
+// call rather than an empty, valid response.
+template<typename ServiceType, typename RequestType, typename ResponseType, typename = void>
+struct has_fallible_process : std::false_type {};
+
+template<typename ServiceType, typename RequestType, typename ResponseType>
+struct has_fallible_process<ServiceType, RequestType, ResponseType,
+                            decltype(void(std::declval<ServiceType&>().process_request(
+                                std::declval<const RequestType&>(), std::declval<ResponseType&>())))>
+    : std::true_type {};
+
+template<typename ServiceType, typename RequestType, typename ResponseType>
+bool process_request(ServiceType& service, const RequestType& request, ResponseType& response, std::true_type) {
+    return service.process_request(request, response);
+}
+
+template<typename ServiceType, typename RequestType, typename ResponseType>
+bool process_request(ServiceType& service, const RequestType& request, ResponseType& response, std::false_type) {
+    response = service.process_request(request);
+    return true;
+}
+
 // Worker process main loop template
 template<typename ServiceType, typename RequestType, typename ResponseType>
 void worker_loop(int server_fd, ServiceType& service, Ser1de_re& ser1de,
@@ -158,35 +314,68 @@ void worker_loop(int server_fd, ServiceType& service, Ser1de_re& ser1de,
         }
 
         // Handle the client
-        char len_buf[4];
-        ssize_t n = read(client_fd, len_buf, 4);
-        if (n != 4) { 
-            close(client_fd); 
-            continue; 
+        std::string payload;
+        microservice::utils::TraceContext incoming;
+        uint32_t flags = 0;
+        if (!microservice::rpc::read_request(client_fd, payload, incoming, &flags)) {
+            close(client_fd);
+            continue;
         }
-        
-        uint32_t msg_len = 0;
-        memcpy(&msg_len, len_buf, 4);
-        std::vector<char> buf(msg_len);
-        n = read(client_fd, buf.data(), msg_len);
-        if (n != (ssize_t)msg_len) { 
-            close(client_fd); 
-            continue; 
+        // Past its deadline the caller has stopped waiting: shed the request
+        // without an answer, which the caller sees as a failed call
+        if (microservice::utils::deadline_passed(incoming)) {
+            close(client_fd);
+            continue;
         }
-        
-        RequestType request;
-        bool ok = microservice::utils::deserialize_message(ser1de, std::string(buf.begin(), buf.end()), request);
-        if (ok) {
-            auto start_time = std::chrono::steady_clock::now();
-            auto response = service.process_request(request);
-            std::string resp_str = microservice::utils::serialize_message(ser1de, response);
-            uint32_t resp_len = resp_str.size();
-            ssize_t written = write(client_fd, &resp_len, 4);
-            if (written == 4) {
-                write(client_fd, resp_str.data(), resp_len);
+        microservice::utils::ScopedTrace trace(incoming);
+        using Perf = microservice::utils::PerfProfiler;
+
+        // Timing starts once the (first) request is deserialized
+        const auto& clock = microservice::utils::TscClock::instance();
+        const bool timed = microservice::utils::trace_active();
+        uint64_t start_time = 0;
+        auto handle = [&](const std::string& item, std::string& resp_str) {
+            RequestType request;
+            {
+                Perf::Scope phase(service_name, endpoint_name, Perf::kDeserialize);
+                if (!microservice::utils::deserialize_message(ser1de, item, request)) return false;
             }
-            auto end_time = std::chrono::steady_clock::now();
+            if (timed && !start_time) start_time = clock.now();
+            ResponseType response;
+            {
+                Perf::Scope phase(service_name, endpoint_name, Perf::kHandler);
+                // a service that encodes its own response has no serialize phase
+                if (encode_response(service, request, resp_str, has_encode_response<ServiceType, RequestType>())) {
+                    return true;
+                }
+                if (!process_request(service, request, response,
+                                     has_fallible_process<ServiceType, RequestType, ResponseType>())) {
+                    return false;
+                }
+            }
+            {
+                Perf::Scope phase(service_name, endpoint_name, Perf::kSerialize);
+                resp_str = microservice::utils::serialize_message(ser1de, response);
+            }
+            return true;
+        };
+
+        bool answered;
+        if (flags & microservice::rpc::kFlagBatch) {
+            using whole = has_process_batch<ServiceType, RequestType, ResponseType>;
+            // deserialized all at once, so timed from the frame's arrival
+            if (timed && whole::value) start_time = clock.now();
+            answered = serve_batch_frame<ServiceType, RequestType, ResponseType>(
+                client_fd, payload, service, ser1de, service_name, endpoint_name, handle, whole());
+        } else {
+            std::string resp_str;
+            answered = handle(payload, resp_str);
+            if (answered) microservice::rpc::write_response(client_fd, resp_str);
+        }
+        if (answered && start_time) {
+            uint64_t end_time = clock.now_end();
             microservice::utils::log_service_request_timing(service_name, endpoint_name, start_time, end_time);
+            Perf::instance().maybe_flush();
         }
         close(client_fd);
     }
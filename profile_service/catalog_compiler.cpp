@@ -0,0 +1,168 @@
+// Compiles a hotel profile catalog for the profile service (PROFILE_CATALOG):
+// reads profiles from CSV or JSONL, encodes each as a HotelProfile with its
+// padding and content version, and writes the catalog (profile_catalog.h).
+//
+// Usage: profile_catalog_compiler <input.csv|input.jsonl> <output>
+//
+// CSV: a header row naming the columns, in any order, out of id, name,
+// phone_number, description, street_number, street_name, city, state,
+// country, postal_code, lat and lon (id is required). Fields may be quoted,
+// with "" for a quote inside.
+//
+// JSONL (any other extension): one HotelProfile per line in protobuf's
+// JSON mapping, e.g.
+//   {"id": "1", "name": "Clift Hotel", "address": {"city": "San Francisco", "lat": 37.7867}}
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include <google/protobuf/util/json_util.h>
+#include "hotel_reservation.pb.h"
+#include "padding_utils.h"
+#include "profile_catalog.h"
+
+namespace {
+
+// Splits one CSV record off in; false at the end of the input. Quoted
+// fields may span lines.
+bool read_csv_record(std::istream& in, std::vector<std::string>& fields) {
+    fields.clear();
+    int c = in.get();
+    if (c == EOF) return false;
+    std::string field;
+    bool quoted = false;
+    for (; c != EOF; c = in.get()) {
+        if (quoted) {
+            if (c != '"') {
+                field.push_back(static_cast<char>(c));
+            } else if (in.peek() == '"') {
+                field.push_back('"');
+                in.get();
+            } else {
+                quoted = false;
+            }
+        } else if (c == '"') {
+            quoted = true;
+        } else if (c == ',') {
+            fields.push_back(field);
+            field.clear();
+        } else if (c == '\n') {
+            break;
+        } else if (c != '\r') {
+            field.push_back(static_cast<char>(c));
+        }
+    }
+    fields.push_back(field);
+    return true;
+}
+
+bool read_csv(const char* path, std::vector<hotelreservation::HotelProfile>& profiles, std::string& error) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        error = std::string("cannot open ") + path;
+        return false;
+    }
+    std::vector<std::string> header;
+    if (!read_csv_record(in, header)) {
+        error = std::string(path) + " is empty";
+        return false;
+    }
+    std::map<std::string, size_t> column;
+    for (size_t i = 0; i < header.size(); ++i) column[header[i]] = i;
+    if (!column.count("id")) {
+        error = std::string(path) + " has no id column";
+        return false;
+    }
+    std::vector<std::string> fields;
+    for (size_t line = 2; read_csv_record(in, fields); ++line) {
+        if (fields.size() == 1 && fields[0].empty()) continue;
+        if (fields.size() != header.size()) {
+            error = std::string(path) + ":" + std::to_string(line) + ": expected " + std::to_string(header.size()) +
+                    " fields, got " + std::to_string(fields.size());
+            return false;
+        }
+        const auto get = [&](const char* name) -> std::string {
+            auto it = column.find(name);
+            return it == column.end() ? std::string() : fields[it->second];
+        };
+        hotelreservation::HotelProfile profile;
+        profile.set_id(get("id"));
+        profile.set_name(get("name"));
+        profile.set_phone_number(get("phone_number"));
+        profile.set_description(get("description"));
+        auto* address = profile.mutable_address();
+        address->set_street_number(get("street_number"));
+        address->set_street_name(get("street_name"));
+        address->set_city(get("city"));
+        address->set_state(get("state"));
+        address->set_country(get("country"));
+        address->set_postal_code(get("postal_code"));
+        address->set_lat(strtod(get("lat").c_str(), nullptr));
+        address->set_lon(strtod(get("lon").c_str(), nullptr));
+        profiles.push_back(std::move(profile));
+    }
+    return true;
+}
+
+bool read_jsonl(const char* path, std::vector<hotelreservation::HotelProfile>& profiles, std::string& error) {
+    std::ifstream in(path);
+    if (!in) {
+        error = std::string("cannot open ") + path;
+        return false;
+    }
+    std::string text;
+    for (size_t line = 1; std::getline(in, text); ++line) {
+        if (text.find_first_not_of(" \t\r") == std::string::npos) continue;
+        hotelreservation::HotelProfile profile;
+        auto status = google::protobuf::util::JsonStringToMessage(text, &profile);
+        if (!status.ok()) {
+            error = std::string(path) + ":" + std::to_string(line) + ": " + std::string(status.message());
+            return false;
+        }
+        profiles.push_back(std::move(profile));
+    }
+    return true;
+}
+
+bool ends_with(const std::string& s, const std::string& suffix) {
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        std::cerr << "usage: " << argv[0] << " <input.csv|input.jsonl> <output>" << std::endl;
+        return 2;
+    }
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<hotelreservation::HotelProfile> profiles;
+    std::string error;
+    const bool csv = ends_with(argv[1], ".csv");
+    if (!(csv ? read_csv(argv[1], profiles, error) : read_jsonl(argv[1], profiles, error))) {
+        std::cerr << error << std::endl;
+        return 1;
+    }
+    for (auto& profile : profiles) {
+        if (profile.id().empty()) {
+            std::cerr << "a profile has no id" << std::endl;
+            return 1;
+        }
+        // as the service sends them
+        *profile.mutable_address()->mutable_padding() = microservice::utils::generate_person_padding();
+        *profile.mutable_padding() = microservice::utils::generate_person_padding();
+        profile.set_version(microservice::profile::content_version(profile));
+    }
+    if (!microservice::profile::write_catalog(profiles, argv[2], error)) {
+        std::cerr << error << std::endl;
+        return 1;
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%zu profiles -> %s in %.2f s\n", profiles.size(), argv[2], seconds);
+    return 0;
+}
@@ -13,18 +13,30 @@
 #include <thread>
 #include <cstring>
 #include "../prefork_utils.h"
+#include "profile_catalog.h"
+#include "profile_store.h"
 
 class ProfileService {
 private:
-    std::unordered_map<std::string, hotelreservation::HotelProfile> profiles_;
+    const microservice::profile::ProfileStore& profiles_;
+    const microservice::profile::ProfileCatalog* catalog_;
+    std::string response_tail_; // the response's padding field, encoded
+    std::string projected_;     // findProjected()'s last answer
 
 public:
-    ProfileService() {
-        // Initialize with some sample data
-        InitializeSampleData();
+    // Serves from catalog if there is one, else from profiles.
+    ProfileService(const microservice::profile::ProfileStore& profiles,
+                   const microservice::profile::ProfileCatalog* catalog)
+        : profiles_(profiles), catalog_(catalog) {
+        hotelreservation::GetProfilesResponse tail;
+        *tail.mutable_padding() = microservice::utils::generate_person_padding();
+        tail.SerializeToString(&response_tail_);
     }
 
-    void InitializeSampleData() {
+    // The sample profiles as a flat store; in the master, before the
+    // workers start, so they share it.
+    static microservice::profile::ProfileStore BuildSampleStore() {
+        std::unordered_map<std::string, hotelreservation::HotelProfile> profiles;
         // Hotel 1
         hotelreservation::HotelProfile profile1;
         profile1.set_id("1");
@@ -42,7 +54,7 @@ public:
         address1->set_lon(-122.4112);
         *address1->mutable_padding() = microservice::utils::generate_person_padding();
         *profile1.mutable_padding() = microservice::utils::generate_person_padding();
-        profiles_[profile1.id()] = profile1;
+        profiles[profile1.id()] = profile1;
 
         // Hotel 2
         hotelreservation::HotelProfile profile2;
@@ -61,7 +73,7 @@ public:
         address2->set_lon(-122.4005);
         *address2->mutable_padding() = microservice::utils::generate_person_padding();
         *profile2.mutable_padding() = microservice::utils::generate_person_padding();
-        profiles_[profile2.id()] = profile2;
+        profiles[profile2.id()] = profile2;
 
         // Hotel 3
         hotelreservation::HotelProfile profile3;
@@ -80,7 +92,7 @@ public:
         address3->set_lon(-122.4071);
         *address3->mutable_padding() = microservice::utils::generate_person_padding();
         *profile3.mutable_padding() = microservice::utils::generate_person_padding();
-        profiles_[profile3.id()] = profile3;
+        profiles[profile3.id()] = profile3;
 
         // Hotel 4
         hotelreservation::HotelProfile profile4;
@@ -99,7 +111,7 @@ public:
         address4->set_lon(-122.3930);
         *address4->mutable_padding() = microservice::utils::generate_person_padding();
         *profile4.mutable_padding() = microservice::utils::generate_person_padding();
-        profiles_[profile4.id()] = profile4;
+        profiles[profile4.id()] = profile4;
 
         // Hotel 5
         hotelreservation::HotelProfile profile5;
@@ -118,7 +130,7 @@ public:
         address5->set_lon(-122.4181);
         *address5->mutable_padding() = microservice::utils::generate_person_padding();
         *profile5.mutable_padding() = microservice::utils::generate_person_padding();
-        profiles_[profile5.id()] = profile5;
+        profiles[profile5.id()] = profile5;
 
         // Hotel 6
         hotelreservation::HotelProfile profile6;
@@ -137,7 +149,7 @@ public:
         address6->set_lon(-122.4015);
         *address6->mutable_padding() = microservice::utils::generate_person_padding();
         *profile6.mutable_padding() = microservice::utils::generate_person_padding();
-        profiles_[profile6.id()] = profile6;
+        profiles[profile6.id()] = profile6;
 
         // Add more hotels 7-80 with generated data
         for (int i = 7; i <= 80; i++) {
@@ -158,23 +170,70 @@ public:
             address->set_lon(-122.41 + static_cast<double>(i)/500.0*4);
             *address->mutable_padding() = microservice::utils::generate_person_padding();
             *profile.mutable_padding() = microservice::utils::generate_person_padding();
-            profiles_[profile.id()] = profile;
+            profiles[profile.id()] = profile;
         }
+
+        microservice::profile::ProfileStore::Builder builder;
+        for (auto& entry : profiles) {
+            entry.second.set_version(microservice::profile::content_version(entry.second));
+            microservice::profile::add_profile(builder, entry.second);
+        }
+        return builder.build();
     }
 
     hotelreservation::GetProfilesResponse process_request(const hotelreservation::GetProfilesRequest& req) {
         hotelreservation::GetProfilesResponse response;
+        const uint32_t fields = microservice::profile::normalize_fields(req.profile_fields());
         
         for (const auto& hotel_id : req.hotel_ids()) {
-            auto it = profiles_.find(hotel_id);
-            if (it != profiles_.end()) {
-                *response.add_profiles() = it->second;
+            if (catalog_) {
+                // only reached when ser1de serializes (see encode_response)
+                const char* bytes;
+                size_t size;
+                if (findProjected(hotel_id, fields, bytes, size)) {
+                    response.add_profiles()->ParseFromArray(bytes, static_cast<int>(size));
+                }
+            } else if (const auto* profile = profiles_.find(hotel_id)) {
+                microservice::profile::fill_profile(profiles_, *profile, response.add_profiles(), fields);
             }
         }
         
         *response.mutable_padding() = microservice::utils::generate_person_padding();
         return response;
     }
+
+    // With a catalog, the encoded response (worker_loop): each profile's
+    // stored bytes, or the requested fields of them, as one
+    // GetProfilesResponse.profiles field, then the padding, which is
+    // exactly what serializing process_request()'s answer would give.
+    // Without one, false, for process_request().
+    bool encode_response(const hotelreservation::GetProfilesRequest& req, std::string& out) {
+        if (!catalog_) return false;
+        const uint32_t fields = microservice::profile::normalize_fields(req.profile_fields());
+        out.clear();
+        for (const auto& hotel_id : req.hotel_ids()) {
+            const char* bytes;
+            size_t size;
+            if (!findProjected(hotel_id, fields, bytes, size)) continue;
+            out.push_back(static_cast<char>(0x0a)); // field 1, length-delimited
+            microservice::profile::wire::append_varint(out, size);
+            out.append(bytes, size);
+        }
+        out += response_tail_;
+        return true;
+    }
+
+private:
+    // A catalog profile's encoding, with only fields (0 for all of them).
+    bool findProjected(const std::string& hotel_id, uint32_t fields, const char*& bytes, size_t& size) {
+        if (!catalog_->find(hotel_id, bytes, size)) return false;
+        if (fields == 0) return true;
+        projected_.clear();
+        if (!microservice::profile::project_profile(bytes, size, fields, projected_)) return false;
+        bytes = projected_.data();
+        size = projected_.size();
+        return true;
+    }
 };
 
 int main() {
@@ -182,6 +241,21 @@ int main() {
     const int NUM_WORKERS = 16;  // Number of worker processes
     
     PreforkServer server(NUM_WORKERS);
+    // PROFILE_CATALOG names a compiled catalog (profile_catalog_compiler) to
+    // map instead of the sample profiles
+    const char* catalog_path = getenv("PROFILE_CATALOG");
+    std::unique_ptr<microservice::profile::ProfileCatalog> catalog;
+    if (catalog_path && *catalog_path) {
+        std::string error;
+        catalog = microservice::profile::ProfileCatalog::open(catalog_path, error);
+        if (!catalog) {
+            std::cerr << "Failed to open profile catalog: " << error << std::endl;
+            return 1;
+        }
+        std::cout << "Profile catalog " << catalog_path << ": " << catalog->size() << " hotels" << std::endl;
+    }
+    const microservice::profile::ProfileStore profiles =
+        catalog ? microservice::profile::ProfileStore() : ProfileService::BuildSampleStore();
     
     if (!server.setup_socket(socket_path)) {
         std::cerr << "Failed to setup socket" << std::endl;
@@ -191,9 +265,17 @@ int main() {
     std::cout << "Profile service socket setup complete" << std::endl;
     
     // Fork worker processes
-    if (server.fork_workers()) {
+    if (!server.fork_workers()) {
+        // This is the master process. master_loop() also returns in a worker
+        // it restarted, which then serves like the others.
+        std::cout << "Profile service master process started with " << NUM_WORKERS << " workers" << std::endl;
+        server.master_loop();
+        if (!server.is_worker()) return 0;
+    }
+
+    {
         // This is a worker process
-        ProfileService service;
+        ProfileService service(profiles, catalog.get());
         Ser1de_re ser1de;
         
         // Worker process main loop
@@ -201,10 +283,5 @@ int main() {
             server.get_server_fd(), service, ser1de, "profile", "profiles");
         
         return 0;
-    } else {
-        // This is the master process
-        std::cout << "Profile service master process started with " << NUM_WORKERS << " workers" << std::endl;
-        server.master_loop();
-        return 0;
     }
 } 
\ No newline at end of file
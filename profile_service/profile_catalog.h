@@ -0,0 +1,256 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include "hotel_reservation.pb.h"
+#include "../flat_store_utils.h"
+
+namespace microservice {
+namespace profile {
+
+// A compiled profile catalog: HotelProfiles pre-encoded in wire format,
+// with an id table, in a file the service maps read-only. Opening one is
+// an mmap and a header check whatever the catalog's size, and its pages
+// sit in the page cache, shared by every worker and every container that
+// maps the same file. Lookups return the stored bytes, which the service
+// splices into its response without parsing them.
+//
+// Layout (native byte order, sections 8-byte aligned):
+//   CatalogHeader
+//   slots    [slot_count]  the ids' open-addressed table, as in FlatIndex
+//   entries  [count]       CatalogEntry
+//   blob                   ids and encoded profiles
+// Catalogs are written by profile_catalog_compiler (catalog_compiler.cpp)
+// and must come from the same build as the service: the padding is encoded
+// in the profiles.
+struct CatalogHeader {
+    char magic[8];
+    uint32_t format;
+    uint32_t count;
+    uint64_t slot_count; // a power of two, at least 2 * count
+    uint64_t slots_offset;
+    uint64_t entries_offset;
+    uint64_t blob_offset;
+    uint64_t blob_size;
+    uint64_t file_size;
+};
+
+struct CatalogSlot {
+    uint32_t tag;   // upper half of the id's flat_hash
+    uint32_t index; // entry, or kCatalogEmptySlot
+};
+
+struct CatalogEntry {
+    uint64_t id_offset; // in the blob
+    uint64_t profile_offset;
+    uint32_t id_size;
+    uint32_t profile_size;
+};
+
+static const char kCatalogMagic[8] = {'H', 'R', 'P', 'R', 'O', 'F', 'C', 'T'};
+constexpr uint32_t kCatalogFormat = 1;
+constexpr uint32_t kCatalogEmptySlot = 0xffffffffu;
+
+// Version of a profile's content: FNV-1a over the profile serialized
+// without padding, so it changes whenever a field clients see changes.
+// Lets the frontend keep rendered profiles until they go stale.
+inline uint64_t content_version(const hotelreservation::HotelProfile& profile) {
+    hotelreservation::HotelProfile content = profile;
+    content.clear_padding();
+    content.mutable_address()->clear_padding();
+    content.clear_version();
+    std::string bytes;
+    content.SerializeToString(&bytes);
+    uint64_t h = 14695981039346656037ull;
+    for (unsigned char c : bytes) {
+        h ^= c;
+        h *= 1099511628211ull;
+    }
+    return h ? h : 1; // 0 means unversioned
+}
+
+// Writes profiles, encoded as they are, to a catalog at path. Writes a
+// temporary file and renames it into place, so services still mapping the
+// old catalog keep it. False, with the reason in error, on duplicate ids
+// or I/O failure.
+inline bool write_catalog(const std::vector<hotelreservation::HotelProfile>& profiles, const std::string& path,
+                          std::string& error) {
+    const auto align = [](uint64_t n) { return (n + 7) & ~uint64_t(7); };
+    CatalogHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, kCatalogMagic, sizeof(header.magic));
+    header.format = kCatalogFormat;
+    header.count = static_cast<uint32_t>(profiles.size());
+    header.slot_count = 16;
+    while (header.slot_count < profiles.size() * 2) header.slot_count <<= 1;
+
+    std::vector<CatalogSlot> slots(header.slot_count, CatalogSlot{0, kCatalogEmptySlot});
+    std::vector<CatalogEntry> entries(profiles.size());
+    std::string blob;
+    for (size_t i = 0; i < profiles.size(); ++i) {
+        const std::string& id = profiles[i].id();
+        const uint64_t h = utils::flat_hash(id.data(), id.size());
+        size_t s = h & (header.slot_count - 1);
+        for (; slots[s].index != kCatalogEmptySlot; s = (s + 1) & (header.slot_count - 1)) {
+            const CatalogEntry& other = entries[slots[s].index];
+            if (other.id_size == id.size() && blob.compare(other.id_offset, other.id_size, id) == 0) {
+                error = "duplicate hotel id " + id;
+                return false;
+            }
+        }
+        slots[s] = CatalogSlot{static_cast<uint32_t>(h >> 32), static_cast<uint32_t>(i)};
+        CatalogEntry& entry = entries[i];
+        entry.id_offset = blob.size();
+        entry.id_size = static_cast<uint32_t>(id.size());
+        blob += id;
+        entry.profile_offset = blob.size();
+        const size_t before = blob.size();
+        profiles[i].AppendToString(&blob);
+        entry.profile_size = static_cast<uint32_t>(blob.size() - before);
+    }
+    header.slots_offset = align(sizeof(header));
+    header.entries_offset = align(header.slots_offset + slots.size() * sizeof(CatalogSlot));
+    header.blob_offset = align(header.entries_offset + entries.size() * sizeof(CatalogEntry));
+    header.blob_size = blob.size();
+    header.file_size = header.blob_offset + blob.size();
+
+    const std::string tmp = path + ".tmp";
+    FILE* f = fopen(tmp.c_str(), "wb");
+    if (!f) {
+        error = "cannot create " + tmp + ": " + strerror(errno);
+        return false;
+    }
+    const auto write_at = [f](uint64_t offset, const void* data, size_t size) {
+        return fseek(f, static_cast<long>(offset), SEEK_SET) == 0 && fwrite(data, 1, size, f) == size;
+    };
+    bool ok = write_at(0, &header, sizeof(header)) &&
+              write_at(header.slots_offset, slots.data(), slots.size() * sizeof(CatalogSlot)) &&
+              write_at(header.entries_offset, entries.data(), entries.size() * sizeof(CatalogEntry)) &&
+              write_at(header.blob_offset, blob.data(), blob.size());
+    ok = fclose(f) == 0 && ok;
+    if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+        error = "cannot write " + path + ": " + strerror(errno);
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+// A catalog file mapped read-only.
+class ProfileCatalog {
+public:
+    // nullptr, with the reason in error, if path is not a catalog.
+    static std::unique_ptr<ProfileCatalog> open(const char* path, std::string& error) {
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0) {
+            error = std::string("cannot open ") + path + ": " + strerror(errno);
+            return nullptr;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(CatalogHeader)) {
+            close(fd);
+            error = std::string(path) + " is too short for a catalog";
+            return nullptr;
+        }
+        const size_t size = static_cast<size_t>(st.st_size);
+        void* p = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED) {
+            error = std::string("cannot map ") + path + ": " + strerror(errno);
+            return nullptr;
+        }
+        madvise(p, size, MADV_RANDOM); // lookups touch a few scattered pages
+        std::unique_ptr<ProfileCatalog> catalog(new ProfileCatalog(static_cast<const char*>(p), size));
+        if (!catalog->valid()) {
+            error = std::string(path) + " is not a profile catalog of this format";
+            return nullptr;
+        }
+        return catalog;
+    }
+
+    ~ProfileCatalog() { munmap(const_cast<char*>(base_), size_); }
+
+    ProfileCatalog(const ProfileCatalog&) = delete;
+    ProfileCatalog& operator=(const ProfileCatalog&) = delete;
+
+    size_t size() const { return header_->count; }
+
+    // The encoded HotelProfile of id; false if the catalog has none.
+    bool find(const char* id, size_t id_size, const char*& bytes, size_t& bytes_size) const {
+        const uint64_t h = utils::flat_hash(id, id_size);
+        const uint32_t tag = static_cast<uint32_t>(h >> 32);
+        const uint64_t mask = header_->slot_count - 1;
+        for (uint64_t s = h & mask, probes = 0; probes <= mask; s = (s + 1) & mask, ++probes) {
+            const CatalogSlot& slot = slots_[s];
+            if (slot.index == kCatalogEmptySlot || slot.index >= header_->count) return false;
+            if (slot.tag != tag) continue;
+            const CatalogEntry& entry = entries_[slot.index];
+            // checked per lookup rather than at open, which stays O(1)
+            if (!in_blob(entry.id_offset, entry.id_size) || !in_blob(entry.profile_offset, entry.profile_size)) {
+                return false;
+            }
+            if (entry.id_size == id_size && memcmp(blob_ + entry.id_offset, id, id_size) == 0) {
+                bytes = blob_ + entry.profile_offset;
+                bytes_size = entry.profile_size;
+                return true;
+            }
+        }
+        return false;
+    }
+    bool find(const std::string& id, const char*& bytes, size_t& bytes_size) const {
+        return find(id.data(), id.size(), bytes, bytes_size);
+    }
+
+private:
+    const char* base_;
+    size_t size_;
+    const CatalogHeader* header_;
+    const CatalogSlot* slots_ = nullptr;
+    const CatalogEntry* entries_ = nullptr;
+    const char* blob_ = nullptr;
+
+    ProfileCatalog(const char* base, size_t size)
+        : base_(base), size_(size), header_(reinterpret_cast<const CatalogHeader*>(base)) {}
+
+    // The header and the section bounds; the entries are checked by find().
+    bool valid() {
+        const CatalogHeader& h = *header_;
+        if (memcmp(h.magic, kCatalogMagic, sizeof(h.magic)) != 0 || h.format != kCatalogFormat) return false;
+        if (h.file_size != size_ || h.slot_count < 2 * static_cast<uint64_t>(h.count) ||
+            (h.slot_count & (h.slot_count - 1)) != 0) {
+            return false;
+        }
+        if ((h.slots_offset | h.entries_offset | h.blob_offset) & 7) return false;
+        if (h.slots_offset < sizeof(CatalogHeader) || h.slot_count > (size_ - h.slots_offset) / sizeof(CatalogSlot)) {
+            return false;
+        }
+        if (h.entries_offset < h.slots_offset + h.slot_count * sizeof(CatalogSlot) ||
+            h.count > (size_ - h.entries_offset) / sizeof(CatalogEntry)) {
+            return false;
+        }
+        if (h.blob_offset < h.entries_offset + h.count * sizeof(CatalogEntry) || h.blob_offset > size_ ||
+            h.blob_size != size_ - h.blob_offset) {
+            return false;
+        }
+        slots_ = reinterpret_cast<const CatalogSlot*>(base_ + h.slots_offset);
+        entries_ = reinterpret_cast<const CatalogEntry*>(base_ + h.entries_offset);
+        blob_ = base_ + h.blob_offset;
+        return true;
+    }
+
+    bool in_blob(uint64_t offset, uint64_t size) const {
+        return offset <= header_->blob_size && size <= header_->blob_size - offset;
+    }
+};
+
+} // namespace profile
+} // namespace microservice
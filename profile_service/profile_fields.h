@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "hotel_reservation.pb.h"
+
+namespace microservice {
+namespace profile {
+
+// Field projection (GetProfilesRequest.profile_fields): the ProfileField
+// bits a caller asks for, 0 or all of them meaning the whole profile.
+constexpr uint32_t kAllProfileFields =
+    hotelreservation::PROFILE_NAME | hotelreservation::PROFILE_PHONE_NUMBER |
+    hotelreservation::PROFILE_DESCRIPTION | hotelreservation::PROFILE_ADDRESS |
+    hotelreservation::PROFILE_ADDRESS_PADDING | hotelreservation::PROFILE_PADDING | hotelreservation::PROFILE_VERSION;
+
+inline uint32_t normalize_fields(uint32_t fields) {
+    return (fields & kAllProfileFields) == kAllProfileFields ? 0 : fields;
+}
+
+inline bool wants(uint32_t fields, hotelreservation::ProfileField field) {
+    return fields == 0 || (fields & field) != 0;
+}
+
+namespace wire {
+
+inline bool read_varint(const char*& p, const char* end, uint64_t& v) {
+    v = 0;
+    for (int shift = 0; shift < 64 && p < end; shift += 7) {
+        const uint8_t b = static_cast<uint8_t>(*p++);
+        v |= static_cast<uint64_t>(b & 0x7f) << shift;
+        if (b < 0x80) return true;
+    }
+    return false;
+}
+
+inline void append_varint(std::string& out, uint64_t v) {
+    for (; v >= 0x80; v >>= 7) out.push_back(static_cast<char>((v & 0x7f) | 0x80));
+    out.push_back(static_cast<char>(v));
+}
+
+// Calls f(field number, field start, payload start, field end) for each
+// field of the encoded message [p, end); false if it is malformed.
+template <typename F>
+bool for_each_field(const char* p, const char* end, F f) {
+    while (p < end) {
+        const char* start = p;
+        uint64_t tag, n;
+        if (!read_varint(p, end, tag)) return false;
+        const char* payload = p;
+        switch (tag & 7) {
+            case 0:
+                if (!read_varint(p, end, n)) return false;
+                break;
+            case 1:
+                if (end - p < 8) return false;
+                p += 8;
+                break;
+            case 2:
+                if (!read_varint(p, end, n) || n > static_cast<uint64_t>(end - p)) return false;
+                payload = p;
+                p += n;
+                break;
+            case 5:
+                if (end - p < 4) return false;
+                p += 4;
+                break;
+            default:
+                return false;
+        }
+        f(static_cast<uint32_t>(tag >> 3), start, payload, p);
+    }
+    return true;
+}
+
+} // namespace wire
+
+// Appends the fields of the encoded HotelProfile [bytes, bytes + size) that
+// fields asks for, which is what serializing the profile with only those
+// fields set gives: its encoded fields are copied as they are, and the
+// address is re-encoded only to drop its padding or keep only that. False,
+// with out as it was, if the bytes are malformed.
+inline bool project_profile(const char* bytes, size_t size, uint32_t fields, std::string& out) {
+    using namespace hotelreservation;
+    const size_t mark = out.size();
+    const uint32_t address_fields = fields & (PROFILE_ADDRESS | PROFILE_ADDRESS_PADDING);
+    const auto address_keeps = [address_fields](uint32_t field) {
+        return (address_fields & (field == Address::kPaddingFieldNumber ? PROFILE_ADDRESS_PADDING : PROFILE_ADDRESS)) != 0;
+    };
+    bool ok = true;
+    const bool parsed = wire::for_each_field(bytes, bytes + size, [&](uint32_t field, const char* start,
+                                                                    const char* payload, const char* end) {
+        bool keep;
+        switch (field) {
+            case HotelProfile::kIdFieldNumber: keep = true; break;
+            case HotelProfile::kNameFieldNumber: keep = (fields & PROFILE_NAME) != 0; break;
+            case HotelProfile::kPhoneNumberFieldNumber: keep = (fields & PROFILE_PHONE_NUMBER) != 0; break;
+            case HotelProfile::kDescriptionFieldNumber: keep = (fields & PROFILE_DESCRIPTION) != 0; break;
+            case HotelProfile::kPaddingFieldNumber: keep = (fields & PROFILE_PADDING) != 0; break;
+            case HotelProfile::kVersionFieldNumber: keep = (fields & PROFILE_VERSION) != 0; break;
+            case HotelProfile::kAddressFieldNumber:
+                keep = address_fields == (PROFILE_ADDRESS | PROFILE_ADDRESS_PADDING);
+                if (!keep && address_fields) {
+                    // the address's kept fields, measured, then copied
+                    size_t length = 0;
+                    ok = ok && wire::for_each_field(payload, end, [&](uint32_t f, const char* s, const char*,
+                                                                      const char* e) {
+                        if (address_keeps(f)) length += e - s;
+                    });
+                    if (!ok) break;
+                    out.push_back(static_cast<char>(HotelProfile::kAddressFieldNumber << 3 | 2));
+                    wire::append_varint(out, length);
+                    wire::for_each_field(payload, end, [&](uint32_t f, const char* s, const char*, const char* e) {
+                        if (address_keeps(f)) out.append(s, e - s);
+                    });
+                }
+                break;
+            default: keep = false; break;
+        }
+        if (keep) out.append(start, end - start);
+    });
+    if (!parsed || !ok) {
+        out.resize(mark);
+        return false;
+    }
+    return true;
+}
+
+} // namespace profile
+} // namespace microservice
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include "hotel_reservation.pb.h"
+#include "../flat_store_utils.h"
+#include "../padding_utils.h"
+#include "profile_fields.h"
+
+namespace microservice {
+namespace profile {
+
+// A HotelProfile without its padding, flattened for utils::FlatStore.
+struct ProfileRecord {
+    utils::TextRef id;
+    utils::TextRef name;
+    utils::TextRef phone_number;
+    utils::TextRef description;
+    utils::TextRef street_number;
+    utils::TextRef street_name;
+    utils::TextRef city;
+    utils::TextRef state;
+    utils::TextRef country;
+    utils::TextRef postal_code;
+    double lat;
+    double lon;
+    uint64_t version;
+};
+
+using ProfileStore = utils::FlatStore<ProfileRecord>;
+
+inline void add_profile(ProfileStore::Builder& builder, const hotelreservation::HotelProfile& profile) {
+    ProfileRecord& r = builder.add(profile.id());
+    const hotelreservation::Address& address = profile.address();
+    r.id = builder.text(profile.id());
+    r.name = builder.text(profile.name());
+    r.phone_number = builder.text(profile.phone_number());
+    r.description = builder.text(profile.description());
+    r.street_number = builder.text(address.street_number());
+    r.street_name = builder.text(address.street_name());
+    r.city = builder.text(address.city());
+    r.state = builder.text(address.state());
+    r.country = builder.text(address.country());
+    r.postal_code = builder.text(address.postal_code());
+    r.lat = address.lat();
+    r.lon = address.lon();
+    r.version = profile.version();
+}
+
+// Writes a record into out, padding included, as the service returns it;
+// only the fields that fields asks for (profile_fields.h), and the id.
+inline void fill_profile(const ProfileStore& store, const ProfileRecord& r, hotelreservation::HotelProfile* out,
+                         uint32_t fields = 0) {
+    using namespace hotelreservation;
+    const utils::StringArena& text = store.text();
+    out->set_id(text.data(r.id), r.id.size);
+    if (wants(fields, PROFILE_NAME)) out->set_name(text.data(r.name), r.name.size);
+    if (wants(fields, PROFILE_PHONE_NUMBER)) out->set_phone_number(text.data(r.phone_number), r.phone_number.size);
+    if (wants(fields, PROFILE_DESCRIPTION)) out->set_description(text.data(r.description), r.description.size);
+    if (wants(fields, PROFILE_ADDRESS)) {
+        Address* address = out->mutable_address();
+        address->set_street_number(text.data(r.street_number), r.street_number.size);
+        address->set_street_name(text.data(r.street_name), r.street_name.size);
+        address->set_city(text.data(r.city), r.city.size);
+        address->set_state(text.data(r.state), r.state.size);
+        address->set_country(text.data(r.country), r.country.size);
+        address->set_postal_code(text.data(r.postal_code), r.postal_code.size);
+        address->set_lat(r.lat);
+        address->set_lon(r.lon);
+    }
+    if (wants(fields, PROFILE_ADDRESS_PADDING)) {
+        *out->mutable_address()->mutable_padding() = utils::generate_person_padding();
+    }
+    if (wants(fields, PROFILE_PADDING)) *out->mutable_padding() = utils::generate_person_padding();
+    if (wants(fields, PROFILE_VERSION)) out->set_version(r.version);
+}
+
+} // namespace profile
+} // namespace microservice
@@ -15,65 +15,48 @@
 #include <condition_variable>
 #include <cstring>
 #include "../prefork_utils.h"
+#include "rate_calendar.h"
 
 class RateService {
 private:
-    std::unordered_map<std::string, std::vector<hotelreservation::RoomType>> hotel_rates_;
+    const microservice::rate::RateCalendar& calendar_;
 
 public:
-    RateService() {
-        InitializeSampleRates();
-    }
-
-    void InitializeSampleRates() {
-        // Add sample room types and rates for hotels
-        for (int i = 1; i <= 10; i++) {
-            std::string hotel_id = std::to_string(i);
-            std::vector<hotelreservation::RoomType> room_types;
-
-            // Standard Room
-            hotelreservation::RoomType standard;
-            standard.set_bookable_rate(100.0 + (rand() % 50));
-            standard.set_code("STD");
-            standard.set_room_description("Standard Room");
-            standard.set_total_rate(standard.bookable_rate() * 1.1);
-            standard.set_total_rate_inclusive(standard.total_rate() * 1.2);
-            *standard.mutable_padding() = microservice::utils::generate_person_padding();
-            room_types.push_back(standard);
-
-            // Deluxe Room
-            hotelreservation::RoomType deluxe;
-            deluxe.set_bookable_rate(200.0 + (rand() % 100));
-            deluxe.set_code("DLX");
-            deluxe.set_room_description("Deluxe Room");
-            deluxe.set_total_rate(deluxe.bookable_rate() * 1.1);
-            deluxe.set_total_rate_inclusive(deluxe.total_rate() * 1.2);
-            *deluxe.mutable_padding() = microservice::utils::generate_person_padding();
-            room_types.push_back(deluxe);
-
-            hotel_rates_[hotel_id] = room_types;
-        }
-    }
+    explicit RateService(const microservice::rate::RateCalendar& calendar) : calendar_(calendar) {}
 
+    // One rate plan per room type of each known hotel, priced night by
+    // night over [in_date, out_date). Stays that cannot be priced (bad
+    // dates, or nights outside the calendar) get no plans.
     hotelreservation::GetRatesResponse process_request(const hotelreservation::GetRatesRequest& req) {
         hotelreservation::GetRatesResponse response;
-        
-        for (const auto& hotel_id : req.hotel_ids()) {
-            auto it = hotel_rates_.find(hotel_id);
-            if (it != hotel_rates_.end()) {
-                // Create a rate plan for each room type
-                for (const auto& room_type : it->second) {
+        int32_t in_day, out_day;
+        uint32_t first, nights;
+        if (microservice::rate::parse_day(req.in_date(), in_day) &&
+            microservice::rate::parse_day(req.out_date(), out_day) &&
+            calendar_.stay(in_day, out_day, first, nights)) {
+            const auto& room_types = calendar_.room_types();
+            for (const auto& hotel_id : req.hotel_ids()) {
+                int64_t slot = calendar_.slot(hotel_id);
+                if (slot < 0) continue;
+                for (size_t r = 0; r < room_types.size(); ++r) {
+                    const double total = calendar_.total(slot, r, first, nights);
                     auto* rate_plan = response.add_rate_plans();
                     rate_plan->set_hotel_id(hotel_id);
-                    rate_plan->set_code(room_type.code());
+                    rate_plan->set_code(room_types[r].code);
                     rate_plan->set_in_date(req.in_date());
                     rate_plan->set_out_date(req.out_date());
-                    *rate_plan->mutable_room_type() = room_type;
+                    auto* room_type = rate_plan->mutable_room_type();
+                    room_type->set_bookable_rate(total / nights);
+                    room_type->set_code(room_types[r].code);
+                    room_type->set_room_description(room_types[r].description);
+                    room_type->set_total_rate(total);
+                    room_type->set_total_rate_inclusive(total * 1.2);
+                    *room_type->mutable_padding() = microservice::utils::generate_person_padding();
                     *rate_plan->mutable_padding() = microservice::utils::generate_person_padding();
                 }
             }
         }
-        
+
         *response.mutable_padding() = microservice::utils::generate_person_padding();
         return response;
     }
@@ -84,6 +67,10 @@ int main() {
     const int NUM_WORKERS = 16;  // Number of worker processes
     
     PreforkServer server(NUM_WORKERS);
+
+    // Built before the fork, so the workers share its pages
+    const microservice::rate::RateCalendar calendar = microservice::rate::RateCalendar::from_env();
+    std::cout << "Rate calendar: " << calendar.hotels() << " hotels" << std::endl;
     
     if (!server.setup_socket(socket_path)) {
         std::cerr << "Failed to setup socket" << std::endl;
@@ -93,9 +80,17 @@ int main() {
     std::cout << "Rate service socket setup complete" << std::endl;
     
     // Fork worker processes
-    if (server.fork_workers()) {
+    if (!server.fork_workers()) {
+        // This is the master process. master_loop() also returns in a worker
+        // it restarted, which then serves like the others.
+        std::cout << "Rate service master process started with " << NUM_WORKERS << " workers" << std::endl;
+        server.master_loop();
+        if (!server.is_worker()) return 0;
+    }
+
+    {
         // This is a worker process
-        RateService service;
+        RateService service(calendar);
         Ser1de_re ser1de;
         
         // Worker process main loop
@@ -103,10 +98,5 @@ int main() {
             server.get_server_fd(), service, ser1de, "rate", "rates");
         
         return 0;
-    } else {
-        // This is the master process
-        std::cout << "Rate service master process started with " << NUM_WORKERS << " workers" << std::endl;
-        server.master_loop();
-        return 0;
     }
 } 
\ No newline at end of file
@@ -0,0 +1,243 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+#include "../flat_store_utils.h"
+#include "../sealed_utils.h"
+
+namespace microservice {
+namespace rate {
+
+// Days since 1970-01-01 of a "YYYY-MM-DD" date; false if s is not one.
+inline bool parse_day(const std::string& s, int32_t& day) {
+    if (s.size() != 10 || s[4] != '-' || s[7] != '-') return false;
+    int v[3] = {0, 0, 0};
+    const int begin[3] = {0, 5, 8};
+    const int len[3] = {4, 2, 2};
+    for (int f = 0; f < 3; ++f) {
+        for (int i = begin[f]; i < begin[f] + len[f]; ++i) {
+            if (s[i] < '0' || s[i] > '9') return false;
+            v[f] = v[f] * 10 + (s[i] - '0');
+        }
+    }
+    const int y = v[0], m = v[1], d = v[2];
+    static const int month_days[12] = {31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    if (m < 1 || m > 12 || d < 1 || d > month_days[m - 1]) return false;
+    const bool leap = (y % 4 == 0 && y % 100 != 0) || y % 400 == 0;
+    if (m == 2 && d == 29 && !leap) return false;
+    // civil-to-days over 400-year eras starting in March
+    const int yy = m <= 2 ? y - 1 : y;
+    const int era = yy / 400;
+    const int yoe = yy - era * 400;
+    const int doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    const int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    day = era * 146097 + doe - 719468;
+    return true;
+}
+
+// 0 = Sunday ... 6 = Saturday
+inline int weekday(int32_t day) {
+    return static_cast<int>(((day % 7) + 11) % 7);
+}
+
+// Sum of n nightly rates. Accumulates in double, which holds sums of
+// float prices exactly, so every kernel returns the same total.
+using NightSum = double (*)(const float* rates, uint32_t n);
+
+inline double sum_nights_scalar(const float* rates, uint32_t n) {
+    double sum = 0;
+    for (uint32_t i = 0; i < n; ++i) sum += rates[i];
+    return sum;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("avx2")))
+inline double sum_nights_avx2(const float* rates, uint32_t n) {
+    __m256d lo = _mm256_setzero_pd();
+    __m256d hi = _mm256_setzero_pd();
+    uint32_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 v = _mm256_loadu_ps(rates + i);
+        lo = _mm256_add_pd(lo, _mm256_cvtps_pd(_mm256_castps256_ps128(v)));
+        hi = _mm256_add_pd(hi, _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1)));
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, _mm256_add_pd(lo, hi));
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + sum_nights_scalar(rates + i, n - i);
+}
+#endif
+
+// The widest kernel the CPU supports, chosen once per process;
+// RATE_SIMD=scalar disables the AVX2 one.
+inline NightSum sum_nights() {
+    static const NightSum selected = [] {
+#if defined(__x86_64__)
+        const char* cap = getenv("RATE_SIMD");
+        __builtin_cpu_init();
+        if ((!cap || strcmp(cap, "scalar") != 0) && __builtin_cpu_supports("avx2")) return &sum_nights_avx2;
+#endif
+        return &sum_nights_scalar;
+    }();
+    return selected;
+}
+
+// Nightly rates of every room type of every hotel, one float per day in
+// [first_day, first_day + days), stored as one contiguous array per
+// (hotel, room type). A stay's price is the sum of its nights' entries.
+//
+// Base rates come from the hotel id (standard 100-149, deluxe 200-299),
+// Friday and Saturday nights cost 15% more, and seasonal overrides
+// multiply the rates of a date range, for every room type or one code.
+class RateCalendar {
+public:
+    struct RoomType {
+        std::string code;
+        std::string description;
+        float base;  // lowest base rate
+        int spread;  // base rates range over [base, base + spread)
+    };
+
+    struct Season {
+        int32_t first_day; // inclusive
+        int32_t last_day;  // inclusive
+        float factor;
+        std::string code;  // empty for every room type
+    };
+
+    // Calendar for hotels "1" .. "<hotels>".
+    RateCalendar(uint32_t hotels, int32_t first_day, uint32_t days)
+        : room_types_{{"STD", "Standard Room", 100.0f, 50}, {"DLX", "Deluxe Room", 200.0f, 100}},
+          first_day_(first_day),
+          days_(days) {
+        rates_ = utils::SealedArray<float>(static_cast<size_t>(hotels) * room_types_.size() * days_);
+        std::vector<std::string> ids;
+        ids.reserve(hotels);
+        for (uint32_t h = 0; h < hotels; ++h) {
+            ids.push_back(std::to_string(h + 1));
+            uint64_t seed = hash(ids.back());
+            for (size_t r = 0; r < room_types_.size(); ++r) {
+                const RoomType& type = room_types_[r];
+                const float base = type.base + static_cast<float>((seed >> (16 * r)) % type.spread);
+                float* row = rates_.mutable_data() + (static_cast<size_t>(h) * room_types_.size() + r) * days_;
+                for (uint32_t d = 0; d < days_; ++d) {
+                    const int wd = weekday(first_day_ + static_cast<int32_t>(d));
+                    row[d] = (wd == 5 || wd == 6) ? base * 1.15f : base;
+                }
+            }
+        }
+        slots_ = utils::FlatIndex(ids);
+    }
+
+    // Sized by RATE_HOTELS (default 10), RATE_CALENDAR_START (default
+    // 2023-01-01) and RATE_CALENDAR_DAYS (default 730), with RATE_SEASONS
+    // applied: comma-separated "first:last:factor[:code]" with inclusive
+    // YYYY-MM-DD dates, e.g. "2023-12-20:2024-01-02:1.4". Sealed.
+    static RateCalendar from_env() {
+        const char* hotels = getenv("RATE_HOTELS");
+        const char* start = getenv("RATE_CALENDAR_START");
+        const char* days = getenv("RATE_CALENDAR_DAYS");
+        int32_t first_day = 0;
+        if (!start || !parse_day(start, first_day)) parse_day("2023-01-01", first_day);
+        uint32_t n_days = days ? static_cast<uint32_t>(strtoul(days, nullptr, 10)) : 730;
+        if (n_days == 0) n_days = 730;
+        RateCalendar calendar(hotels ? static_cast<uint32_t>(strtoul(hotels, nullptr, 10)) : 10, first_day, n_days);
+        if (const char* seasons = getenv("RATE_SEASONS")) {
+            std::string spec(seasons);
+            size_t pos = 0;
+            while (pos <= spec.size()) {
+                size_t end = spec.find(',', pos);
+                if (end == std::string::npos) end = spec.size();
+                std::string entry = spec.substr(pos, end - pos);
+                Season season;
+                if (!entry.empty() && parse_season(entry, season)) {
+                    calendar.apply(season);
+                } else if (!entry.empty()) {
+                    std::cerr << "Ignoring malformed RATE_SEASONS entry: " << entry << std::endl;
+                }
+                pos = end + 1;
+            }
+        }
+        calendar.seal();
+        return calendar;
+    }
+
+    // Makes the rates read-only; apply() must not be called after.
+    void seal() { rates_.seal(); }
+
+    // Multiplies the rates of the season's nights that fall in the calendar.
+    void apply(const Season& season) {
+        const int64_t first = std::max<int64_t>(season.first_day - first_day_, 0);
+        const int64_t last = std::min<int64_t>(season.last_day - first_day_, static_cast<int64_t>(days_) - 1);
+        if (first > last) return;
+        const size_t hotels = slots_.size();
+        for (size_t r = 0; r < room_types_.size(); ++r) {
+            if (!season.code.empty() && season.code != room_types_[r].code) continue;
+            for (size_t h = 0; h < hotels; ++h) {
+                float* row = rates_.mutable_data() + (h * room_types_.size() + r) * days_;
+                for (int64_t d = first; d <= last; ++d) row[d] *= season.factor;
+            }
+        }
+    }
+
+    const std::vector<RoomType>& room_types() const { return room_types_; }
+    uint32_t hotels() const { return static_cast<uint32_t>(slots_.size()); }
+
+    // Row of a hotel in the calendar, or -1 if it has no rates.
+    int64_t slot(const std::string& hotel_id) const {
+        return slots_.find(hotel_id);
+    }
+
+    // Nights [in_day, out_day) as offsets into the rows; false if the stay
+    // is empty or not entirely within the calendar.
+    bool stay(int32_t in_day, int32_t out_day, uint32_t& first, uint32_t& nights) const {
+        if (out_day <= in_day || in_day < first_day_) return false;
+        const int64_t end = static_cast<int64_t>(out_day) - first_day_;
+        if (end > static_cast<int64_t>(days_)) return false;
+        first = static_cast<uint32_t>(in_day - first_day_);
+        nights = static_cast<uint32_t>(out_day - in_day);
+        return true;
+    }
+
+    // Total of a stay from stay() for one room type of one slot.
+    double total(int64_t slot, size_t room_type, uint32_t first, uint32_t nights) const {
+        const float* row = &rates_[(static_cast<size_t>(slot) * room_types_.size() + room_type) * days_];
+        return sum_nights()(row + first, nights);
+    }
+
+private:
+    std::vector<RoomType> room_types_;
+    int32_t first_day_;
+    uint32_t days_;
+    utils::SealedArray<float> rates_;
+    utils::FlatIndex slots_;
+
+    static uint64_t hash(const std::string& s) {
+        uint64_t h = 0xcbf29ce484222325ull;
+        for (unsigned char c : s) h = (h ^ c) * 0x100000001b3ull;
+        h ^= h >> 29;
+        return h * 0xbf58476d1ce4e5b9ull;
+    }
+
+    static bool parse_season(const std::string& entry, Season& season) {
+        char first[11], last[11], code[16] = "";
+        double factor = 0;
+        int fields = sscanf(entry.c_str(), "%10[0-9-]:%10[0-9-]:%lf:%15s", first, last, &factor, code);
+        if (fields < 3 || !(factor > 0)) return false;
+        if (!parse_day(first, season.first_day) || !parse_day(last, season.last_day)) return false;
+        season.factor = static_cast<float>(factor);
+        season.code = code;
+        return true;
+    }
+};
+
+} // namespace rate
+} // namespace microservice
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace microservice {
+namespace utils {
+
+// A pointer to an immutable T that readers use without locks while a
+// writer replaces it (read-copy-update with epoch-based reclamation).
+//
+// Each reading thread owns one of a fixed number of reader slots. Entering
+// a read section stores the current epoch in the slot and loads the
+// pointer; leaving clears the slot. publish() swaps in the new value,
+// advances the epoch, and frees the old value once every slot is clear or
+// shows the new epoch: a reader that entered before the swap may still
+// hold the old pointer, a reader that entered after it cannot. Readers
+// never wait; the writer waits out the read sections in progress.
+template <typename T>
+class RcuCell {
+    // padded so that readers do not share a cache line
+    struct Slot {
+        std::atomic<uint64_t> epoch{0}; // 0 outside a read section
+        char padding[56];
+    };
+
+public:
+    RcuCell(std::unique_ptr<T> initial, size_t readers)
+        : current_(initial.release()), readers_(readers), slots_(new Slot[readers]) {}
+
+    ~RcuCell() { delete current_.load(); }
+
+    RcuCell(const RcuCell&) = delete;
+    RcuCell& operator=(const RcuCell&) = delete;
+
+    // A read section: the value stays alive until the guard is destroyed.
+    // Sections on one slot must not overlap or nest.
+    class ReadGuard {
+    public:
+        ReadGuard(RcuCell& cell, size_t reader) : slot_(cell.slots_[reader]) {
+            slot_.epoch.store(cell.epoch_.load());
+            value_ = cell.current_.load();
+        }
+
+        ~ReadGuard() { slot_.epoch.store(0, std::memory_order_release); }
+
+        ReadGuard(const ReadGuard&) = delete;
+        ReadGuard& operator=(const ReadGuard&) = delete;
+
+        const T& operator*() const { return *value_; }
+        const T* operator->() const { return value_; }
+
+    private:
+        Slot& slot_;
+        const T* value_;
+    };
+
+    // Replaces the value and frees the old one after a grace period. Safe
+    // from several threads; each waits for its own grace period.
+    void publish(std::unique_ptr<T> next) {
+        std::unique_ptr<T> old;
+        uint64_t epoch;
+        {
+            std::lock_guard<std::mutex> lock(writer_mutex_);
+            old.reset(current_.exchange(next.release()));
+            epoch = epoch_.fetch_add(1) + 1;
+        }
+        for (size_t i = 0; i < readers_; ++i) {
+            for (int spins = 0;; ++spins) {
+                uint64_t seen = slots_[i].epoch.load();
+                if (seen == 0 || seen >= epoch) break;
+                if (spins < 64) {
+                    std::this_thread::yield();
+                } else {
+                    std::this_thread::sleep_for(std::chrono::microseconds(50));
+                }
+            }
+        }
+    }
+
+private:
+    std::atomic<T*> current_;
+    std::atomic<uint64_t> epoch_{1};
+    size_t readers_;
+    std::unique_ptr<Slot[]> slots_;
+    std::mutex writer_mutex_;
+};
+
+} // namespace utils
+} // namespace microservice
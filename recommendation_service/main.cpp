@@ -20,27 +20,10 @@ class RecommendationService {
 private:
     // No unused members
     
-    std::string sendProtobufOverUDS(const std::string& path, const std::string& data) {
-        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
-        if (fd < 0) return "";
-        sockaddr_un addr{};
-        addr.sun_family = AF_UNIX;
-        strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
-        if (connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
-            close(fd);
-            return "";
-        }
-        uint32_t len = data.size();
-        if (write(fd, &len, 4) != 4) { close(fd); return ""; }
-        if (write(fd, data.data(), len) != (ssize_t)len) { close(fd); return ""; }
-        char len_buf[4];
-        if (read(fd, len_buf, 4) != 4) { close(fd); return ""; }
-        uint32_t resp_len = 0;
-        memcpy(&resp_len, len_buf, 4);
-        std::vector<char> resp_buf(resp_len);
-        if (read(fd, resp_buf.data(), resp_len) != (ssize_t)resp_len) { close(fd); return ""; }
-        close(fd);
-        return std::string(resp_buf.begin(), resp_buf.end());
+    // false if the call failed (e.g. the request's deadline passed); an empty
+    // payload is a valid empty message, so failure cannot be signalled by it
+    bool sendProtobufOverUDS(const std::string& path, const std::string& data, std::string& response) {
+        return microservice::rpc::call(path, data, response) == microservice::rpc::CallStatus::kOk;
     }
 
 public:
@@ -51,19 +34,24 @@ public:
         // This class is now purely UDS+Protobuf, so no client pools are needed.
     }
 
-    hotelreservation::RecommendResponse process_request(const hotelreservation::RecommendRequest& req) {
-        
+    // False, leaving the request unanswered, if the profile or rate call
+    // fails: an empty response would read as "nothing to recommend" and be
+    // cached as such by the frontend.
+    bool process_request(const hotelreservation::RecommendRequest& req, hotelreservation::RecommendResponse& response) {
+
         // Get hotel profiles first
         hotelreservation::GetProfilesRequest profile_req;
         for (int i = 1; i <= 10; i++) {
             profile_req.add_hotel_ids(std::to_string(i));
         }
         profile_req.set_locale(req.locale());
+        profile_req.set_profile_fields(req.profile_fields());
         *profile_req.mutable_padding() = microservice::utils::generate_person_padding();
-        std::string profile_resp_str = sendProtobufOverUDS("/tmp/profile_service.sock", microservice::utils::serialize_message(ser1de, profile_req));
+        std::string profile_resp_str;
         hotelreservation::GetProfilesResponse profile_resp;
-        if (!microservice::utils::deserialize_message(ser1de, profile_resp_str, profile_resp)) {
-            return hotelreservation::RecommendResponse();
+        if (!sendProtobufOverUDS("/tmp/profile_service.sock", microservice::utils::serialize_message(ser1de, profile_req), profile_resp_str) ||
+            !microservice::utils::deserialize_message(ser1de, profile_resp_str, profile_resp)) {
+            return false;
         }
 
         // Get rates for these hotels
@@ -74,21 +62,21 @@ public:
         rate_req.set_in_date("2023-12-01");
         rate_req.set_out_date("2023-12-02");
         *rate_req.mutable_padding() = microservice::utils::generate_person_padding();
-        std::string rate_resp_str = sendProtobufOverUDS("/tmp/rate_service.sock", microservice::utils::serialize_message(ser1de, rate_req));
+        std::string rate_resp_str;
         hotelreservation::GetRatesResponse rate_resp;
-        if (!microservice::utils::deserialize_message(ser1de, rate_resp_str, rate_resp)) {
-            return hotelreservation::RecommendResponse();
+        if (!sendProtobufOverUDS("/tmp/rate_service.sock", microservice::utils::serialize_message(ser1de, rate_req), rate_resp_str) ||
+            !microservice::utils::deserialize_message(ser1de, rate_resp_str, rate_resp)) {
+            return false;
         }
 
         // Combine results
-        hotelreservation::RecommendResponse response;
         for (const auto& profile : profile_resp.profiles()) {
             *response.add_hotels() = profile;
         }
         
         *response.mutable_padding() = microservice::utils::generate_person_padding();
         
-        return response;
+        return true;
     }
 };
 
@@ -106,7 +94,15 @@ int main() {
     std::cout << "Recommendation service socket setup complete" << std::endl;
     
     // Fork worker processes
-    if (server.fork_workers()) {
+    if (!server.fork_workers()) {
+        // This is the master process. master_loop() also returns in a worker
+        // it restarted, which then serves like the others.
+        std::cout << "Recommendation service master process started with " << NUM_WORKERS << " workers" << std::endl;
+        server.master_loop();
+        if (!server.is_worker()) return 0;
+    }
+
+    {
         // This is a worker process
         RecommendationService service;
         Ser1de_re ser1de;
@@ -116,10 +112,5 @@ int main() {
             server.get_server_fd(), service, ser1de, "recommendation", "recommend");
         
         return 0;
-    } else {
-        // This is the master process
-        std::cout << "Recommendation service master process started with " << NUM_WORKERS << " workers" << std::endl;
-        server.master_loop();
-        return 0;
     }
 } 
\ No newline at end of file
@@ -22,29 +22,14 @@ private:
     };
 
     std::unordered_map<std::string, HotelReservations> hotel_reservations_;
-    std::mutex reservations_mutex_;
+    microservice::utils::ProfiledMutex reservations_mutex_{"reservations"};
 
     std::string sendProtobufOverUDS(const std::string& path, const std::string& data) {
-        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
-        if (fd < 0) return "";
-        sockaddr_un addr{};
-        addr.sun_family = AF_UNIX;
-        strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
-        if (connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
-            close(fd);
+        std::string response;
+        if (microservice::rpc::call(path, data, response) != microservice::rpc::CallStatus::kOk) {
             return "";
         }
-        uint32_t len = data.size();
-        if (write(fd, &len, 4) != 4) { close(fd); return ""; }
-        if (write(fd, data.data(), len) != (ssize_t)len) { close(fd); return ""; }
-        char len_buf[4];
-        if (read(fd, len_buf, 4) != 4) { close(fd); return ""; }
-        uint32_t resp_len = 0;
-        memcpy(&resp_len, len_buf, 4);
-        std::vector<char> resp_buf(resp_len);
-        if (read(fd, resp_buf.data(), resp_len) != (ssize_t)resp_len) { close(fd); return ""; }
-        close(fd);
-        return std::string(resp_buf.begin(), resp_buf.end());
+        return response;
     }
 
 public:
@@ -96,7 +81,7 @@ public:
             *response.mutable_padding() = microservice::utils::generate_person_padding();
             return response;
         }
-        std::lock_guard<std::mutex> lock(reservations_mutex_);
+        std::lock_guard<microservice::utils::ProfiledMutex> lock(reservations_mutex_);
         // Check if hotel exists and has availability
         auto it = hotel_reservations_.find(req.hotel_id());
         if (it == hotel_reservations_.end()) {
@@ -142,7 +127,15 @@ int main() {
     std::cout << "Reservation service socket setup complete" << std::endl;
     
     // Fork worker processes
-    if (server.fork_workers()) {
+    if (!server.fork_workers()) {
+        // This is the master process. master_loop() also returns in a worker
+        // it restarted, which then serves like the others.
+        std::cout << "Reservation service master process started with " << NUM_WORKERS << " workers" << std::endl;
+        server.master_loop();
+        if (!server.is_worker()) return 0;
+    }
+
+    {
         // This is a worker process
         ReservationService service;
         Ser1de_re ser1de;
@@ -152,10 +145,5 @@ int main() {
             server.get_server_fd(), service, ser1de, "reservation", "reservation");
         
         return 0;
-    } else {
-        // This is the master process
-        std::cout << "Reservation service master process started with " << NUM_WORKERS << " workers" << std::endl;
-        server.master_loop();
-        return 0;
     }
 } 
\ No newline at end of file
@@ -0,0 +1,273 @@
+#pragma once
+
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <vector>
+#include "trace_utils.h"
+
+namespace microservice {
+namespace rpc {
+
+// UDS framing shared by every client and server.
+//
+// A frame is a 4-byte native-endian length word followed by the payload. The
+// top four bits of the length word are frame flags, which leaves 256MB for
+// the payload. Flags add fixed-size header fields between the length word
+// and the payload, in flag-bit order:
+//
+//   kFlagSampled   8-byte trace id; the request is sampled for timing
+//   kFlagDeadline  4-byte remaining time budget in microseconds
+//   kFlagBatch     no field; the payload is a batch of requests (below)
+//
+// The deadline travels as a relative budget and is turned back into a
+// CLOCK_MONOTONIC deadline on arrival. Responses never carry flags.
+//
+// A batch payload is a 4-byte item count followed by each item as a 4-byte
+// length and its bytes. The response to a batch is a batch of the same size
+// in item order; an item the server could not answer has length
+// kBatchItemFailed and no bytes. The batch's trace fields stand for all of
+// its items.
+constexpr uint32_t kFlagMask = 0xf0000000u;
+constexpr uint32_t kLengthMask = 0x0fffffffu;
+constexpr uint32_t kFlagSampled = 0x80000000u;
+constexpr uint32_t kFlagDeadline = 0x40000000u;
+constexpr uint32_t kFlagBatch = 0x20000000u;
+constexpr uint32_t kBatchItemFailed = 0xffffffffu;
+
+enum class CallStatus {
+    kOk,
+    kSocketError,
+    kConnectError,
+    kWriteError,
+    kReadError,
+    kDeadlineExceeded, // before the call, or while waiting for the response
+};
+
+inline bool read_full(int fd, void* buf, size_t len) {
+    char* p = static_cast<char*>(buf);
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+inline bool writev_full(int fd, iovec* iov, int iovcnt) {
+    while (iovcnt > 0) {
+        ssize_t n = writev(fd, iov, iovcnt);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        while (iovcnt > 0 && static_cast<size_t>(n) >= iov->iov_len) {
+            n -= iov->iov_len;
+            ++iov;
+            --iovcnt;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = static_cast<char*>(iov->iov_base) + n;
+            iov->iov_len -= n;
+        }
+    }
+    return true;
+}
+
+// Largest header encode_request_header() produces.
+constexpr size_t kMaxRequestHeader = 4 + 8 + 4;
+
+// Encodes the length word and flag fields of a request frame carrying
+// payload_size bytes; returns the header length. flags may add the flags
+// without a header field (kFlagBatch).
+inline size_t encode_request_header(char* header, size_t payload_size, const utils::TraceContext& trace,
+                                    uint32_t flags = 0) {
+    size_t header_len = 4;
+    uint32_t word = (static_cast<uint32_t>(payload_size) & kLengthMask) | (flags & kFlagBatch);
+    if (trace.sampled) {
+        word |= kFlagSampled;
+        memcpy(header + header_len, &trace.trace_id, 8);
+        header_len += 8;
+    }
+    if (trace.deadline_ns) {
+        word |= kFlagDeadline;
+        uint64_t now = utils::monotonic_ns();
+        uint64_t remaining_us = trace.deadline_ns > now ? (trace.deadline_ns - now) / 1000 : 0;
+        uint32_t budget = remaining_us > 0xffffffffu ? 0xffffffffu : static_cast<uint32_t>(remaining_us);
+        memcpy(header + header_len, &budget, 4);
+        header_len += 4;
+    }
+    memcpy(header, &word, 4);
+    return header_len;
+}
+
+// Writes a request frame, tagging it with the current thread's trace context.
+inline bool write_request(int fd, const std::string& payload, uint32_t flags = 0) {
+    char header[kMaxRequestHeader];
+    size_t header_len = encode_request_header(header, payload.size(), utils::current_trace(), flags);
+    iovec iov[2] = {{header, header_len},
+                    {const_cast<char*>(payload.data()), payload.size()}};
+    return writev_full(fd, iov, 2);
+}
+
+// Reads a request frame and the trace context that came with it; flags, if
+// given, receives the frame's flag bits.
+inline bool read_request(int fd, std::string& payload, utils::TraceContext& trace, uint32_t* flags = nullptr) {
+    uint32_t word = 0;
+    if (!read_full(fd, &word, 4)) return false;
+    trace = utils::TraceContext();
+    if (flags) *flags = word & kFlagMask;
+    if (word & kFlagSampled) {
+        if (!read_full(fd, &trace.trace_id, 8)) return false;
+        trace.sampled = true;
+    }
+    if (word & kFlagDeadline) {
+        uint32_t budget_us = 0;
+        if (!read_full(fd, &budget_us, 4)) return false;
+        trace.deadline_ns = utils::monotonic_ns() + static_cast<uint64_t>(budget_us) * 1000;
+    }
+    payload.resize(word & kLengthMask);
+    return payload.empty() || read_full(fd, &payload[0], payload.size());
+}
+
+inline bool write_response(int fd, const std::string& payload) {
+    uint32_t word = static_cast<uint32_t>(payload.size()) & kLengthMask;
+    iovec iov[2] = {{&word, 4},
+                    {const_cast<char*>(payload.data()), payload.size()}};
+    return writev_full(fd, iov, 2);
+}
+
+inline bool read_response(int fd, std::string& payload) {
+    uint32_t word = 0;
+    if (!read_full(fd, &word, 4)) return false;
+    payload.resize(word & kLengthMask);
+    return payload.empty() || read_full(fd, &payload[0], payload.size());
+}
+
+// Appends a batch payload; a null item is encoded as failed.
+inline void encode_batch(const std::vector<const std::string*>& items, std::string& out) {
+    size_t size = 4;
+    for (const std::string* item : items) size += 4 + (item ? item->size() : 0);
+    out.reserve(out.size() + size);
+    uint32_t count = static_cast<uint32_t>(items.size());
+    out.append(reinterpret_cast<const char*>(&count), 4);
+    for (const std::string* item : items) {
+        uint32_t len = item ? static_cast<uint32_t>(item->size()) : kBatchItemFailed;
+        out.append(reinterpret_cast<const char*>(&len), 4);
+        if (item) out.append(*item);
+    }
+}
+
+// Splits a batch payload into its items. failed, if given, marks the items
+// encoded as failed; without it a failed item makes the batch malformed.
+inline bool decode_batch(const std::string& payload, std::vector<std::string>& items,
+                         std::vector<bool>* failed = nullptr) {
+    const char* p = payload.data();
+    const char* end = p + payload.size();
+    uint32_t count;
+    if (end - p < 4) return false;
+    memcpy(&count, p, 4);
+    p += 4;
+    if (count > static_cast<size_t>(end - p) / 4) return false;
+    items.assign(count, std::string());
+    if (failed) failed->assign(count, false);
+    for (uint32_t i = 0; i < count; ++i) {
+        uint32_t len;
+        if (end - p < 4) return false;
+        memcpy(&len, p, 4);
+        p += 4;
+        if (len == kBatchItemFailed) {
+            if (!failed) return false;
+            (*failed)[i] = true;
+            continue;
+        }
+        if (len > static_cast<size_t>(end - p)) return false;
+        items[i].assign(p, len);
+        p += len;
+    }
+    return p == end;
+}
+
+inline int connect_uds(const std::string& path) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    if (connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -2;
+    }
+    return fd;
+}
+
+// One request/response exchange on a fresh connection. With a deadline in
+// the current trace context, the call is not made once it has passed, and
+// socket timeouts stop the wait for the response when it passes.
+inline CallStatus call(const std::string& path, const std::string& request, std::string& response,
+                       uint32_t flags = 0) {
+    const utils::TraceContext& trace = utils::current_trace();
+    uint64_t remaining_ns = 0;
+    if (trace.deadline_ns) {
+        uint64_t now = utils::monotonic_ns();
+        if (now >= trace.deadline_ns) return CallStatus::kDeadlineExceeded;
+        remaining_ns = trace.deadline_ns - now;
+    }
+    int fd = connect_uds(path);
+    if (fd == -1) return CallStatus::kSocketError;
+    if (fd < 0) return CallStatus::kConnectError;
+    if (remaining_ns) {
+        timeval tv;
+        tv.tv_sec = static_cast<time_t>(remaining_ns / 1000000000ull);
+        tv.tv_usec = static_cast<suseconds_t>((remaining_ns % 1000000000ull) / 1000) + 1;
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    }
+    if (!write_request(fd, request, flags)) {
+        close(fd);
+        return utils::deadline_passed(trace) ? CallStatus::kDeadlineExceeded : CallStatus::kWriteError;
+    }
+    if (!read_response(fd, response)) {
+        close(fd);
+        return utils::deadline_passed(trace) ? CallStatus::kDeadlineExceeded : CallStatus::kReadError;
+    }
+    close(fd);
+    return CallStatus::kOk;
+}
+
+// Folds an item's trace context into its batch's, which starts out as the
+// first item's: the batch is sampled under the first sampled item's trace id
+// and waits as long as its most patient item (no deadline if one has none).
+inline void merge_batch_trace(utils::TraceContext& batch, const utils::TraceContext& item) {
+    if (!batch.sampled && item.sampled) {
+        batch.sampled = true;
+        batch.trace_id = item.trace_id;
+    }
+    if (batch.deadline_ns && (!item.deadline_ns || item.deadline_ns > batch.deadline_ns)) {
+        batch.deadline_ns = item.deadline_ns;
+    }
+}
+
+// Sends requests as one kFlagBatch frame. On kOk, responses[i] answers
+// requests[i] unless failed[i]; a malformed batch response is kReadError.
+inline CallStatus call_batch(const std::string& path, const std::vector<const std::string*>& requests,
+                             std::vector<std::string>& responses, std::vector<bool>& failed) {
+    std::string request;
+    encode_batch(requests, request);
+    std::string response;
+    CallStatus status = call(path, request, response, kFlagBatch);
+    if (status != CallStatus::kOk) return status;
+    if (!decode_batch(response, responses, &failed) || responses.size() != requests.size()) {
+        return CallStatus::kReadError;
+    }
+    return CallStatus::kOk;
+}
+
+} // namespace rpc
+} // namespace microservice
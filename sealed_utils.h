@@ -0,0 +1,86 @@
+#pragma once
+
+#include <sys/mman.h>
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace microservice {
+namespace utils {
+
+// An array for data that the master builds once before fork and every
+// worker only reads. It lives in its own anonymous mapping, so after fork
+// the workers, and the workers the master restarts later, share its pages
+// copy-on-write without rebuilding anything. seal() makes the pages
+// read-only: nothing can silently give one worker a private copy, and a
+// stray write faults instead. Arrays of 2MB or more ask for transparent
+// huge pages, which keeps large catalogs' lookups from missing the TLB.
+template <typename T>
+class SealedArray {
+    static_assert(std::is_trivially_copyable<T>::value, "SealedArray elements must be trivially copyable");
+
+public:
+    SealedArray() = default;
+
+    // n zeroed elements, writable until seal().
+    explicit SealedArray(size_t n) : size_(n) {
+        if (n == 0) return;
+        const size_t page = 4096;
+        bytes_ = (n * sizeof(T) + page - 1) / page * page;
+        void* p = mmap(nullptr, bytes_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) throw std::bad_alloc();
+#ifdef MADV_HUGEPAGE
+        if (bytes_ >= (2u << 20)) madvise(p, bytes_, MADV_HUGEPAGE);
+#endif
+        data_ = static_cast<T*>(p);
+    }
+
+    explicit SealedArray(const std::vector<T>& values) : SealedArray(values.size()) {
+        if (!values.empty()) memcpy(data_, values.data(), values.size() * sizeof(T));
+    }
+
+    SealedArray(SealedArray&& other) noexcept { swap(other); }
+    SealedArray& operator=(SealedArray&& other) noexcept {
+        SealedArray(std::move(other)).swap(*this);
+        return *this;
+    }
+
+    ~SealedArray() {
+        if (data_) munmap(data_, bytes_);
+    }
+
+    SealedArray(const SealedArray&) = delete;
+    SealedArray& operator=(const SealedArray&) = delete;
+
+    // Makes the array read-only; writes through mutable_data() fault after.
+    void seal() {
+        if (data_ && !sealed_) mprotect(data_, bytes_, PROT_READ);
+        sealed_ = true;
+    }
+
+    T* mutable_data() { return data_; }
+    const T* data() const { return data_; }
+    size_t size() const { return size_; }
+    bool sealed() const { return sealed_; }
+    size_t bytes() const { return bytes_; } // mapped, whole pages
+    const T& operator[](size_t i) const { return data_[i]; }
+
+private:
+    T* data_ = nullptr;
+    size_t size_ = 0;
+    size_t bytes_ = 0;
+    bool sealed_ = false;
+
+    void swap(SealedArray& other) noexcept {
+        std::swap(data_, other.data_);
+        std::swap(size_, other.size_);
+        std::swap(bytes_, other.bytes_);
+        std::swap(sealed_, other.sealed_);
+    }
+};
+
+} // namespace utils
+} // namespace microservice
@@ -15,52 +15,67 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 #include "../prefork_utils.h"
+#include "../singleflight_utils.h"
 
 class SearchService {
 private:
-    // No unused members
+    microservice::utils::SingleFlight& flights_;
+    microservice::utils::SingleFlight::Route* search_flight_;
     
-    std::string sendProtobufOverUDS(const std::string& path, const std::string& data) {
-        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
-        if (fd < 0) return "";
-        sockaddr_un addr{};
-        addr.sun_family = AF_UNIX;
-        strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
-        if (connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
-            close(fd);
-            return "";
-        }
-        uint32_t len = data.size();
-        if (write(fd, &len, 4) != 4) { close(fd); return ""; }
-        if (write(fd, data.data(), len) != (ssize_t)len) { close(fd); return ""; }
-        char len_buf[4];
-        if (read(fd, len_buf, 4) != 4) { close(fd); return ""; }
-        uint32_t resp_len = 0;
-        memcpy(&resp_len, len_buf, 4);
-        std::vector<char> resp_buf(resp_len);
-        if (read(fd, resp_buf.data(), resp_len) != (ssize_t)resp_len) { close(fd); return ""; }
-        close(fd);
-        return std::string(resp_buf.begin(), resp_buf.end());
+    // false if the call failed (e.g. the request's deadline passed); an empty
+    // payload is a valid empty message, so failure cannot be signalled by it
+    bool sendProtobufOverUDS(const std::string& path, const std::string& data, std::string& response) {
+        return microservice::rpc::call(path, data, response) == microservice::rpc::CallStatus::kOk;
     }
 
 public:
     Ser1de_re ser1de;
     
-    SearchService() {
+    explicit SearchService(microservice::utils::SingleFlight& flights)
+        : flights_(flights), search_flight_(flights.route("search")) {
         // Initialize client pools
         // This class is now purely UDS+Protobuf, so no client pools are needed.
     }
 
-    hotelreservation::SearchResponse process_request(const hotelreservation::SearchRequest& req) {
+    // Identical concurrent searches (same location, dates, locale and
+    // profile fields) share one geo/rate/profile fan-out across all
+    // workers; followers get the leader's serialized response. False, leaving
+    // the search unanswered, if a downstream call fails: an empty response
+    // would read as "no hotels" and be cached as such by the frontend.
+    bool process_request(const hotelreservation::SearchRequest& req, hotelreservation::SearchResponse& response) {
+        if (!microservice::utils::SingleFlight::enabled(search_flight_)) {
+            return fan_out(req, response);
+        }
+        std::string key = microservice::utils::FlightKey().add(req.lat()).add(req.lon()).add(req.in_date())
+            .add(req.out_date()).add(req.locale()).add(req.profile_fields()).str();
+        bool ran = false;
+        std::string shared;
+        // false only if our own fan-out (as leader, or after the leader's failed) did
+        if (!flights_.run(search_flight_, key, shared, [&](std::string& out) {
+                ran = true;
+                if (!fan_out(req, response)) return false;
+                out = microservice::utils::serialize_message(ser1de, response);
+                return true;
+            })) {
+            return false;
+        }
+        if (ran || microservice::utils::deserialize_message(ser1de, shared, response)) return true;
+        response.Clear();
+        return fan_out(req, response);
+    }
+
+    // Leaves response empty and returns false if a downstream call fails.
+    bool fan_out(const hotelreservation::SearchRequest& req, hotelreservation::SearchResponse& response) {
         // First, get nearby hotels from geo service
         hotelreservation::NearbyRequest geo_req;
         geo_req.set_lat(req.lat());
         geo_req.set_lon(req.lon());
         *geo_req.mutable_padding() = microservice::utils::generate_person_padding();
-        std::string geo_resp_str = sendProtobufOverUDS("/tmp/geo_service.sock", microservice::utils::serialize_message(ser1de, geo_req));
+        std::string geo_resp_str;
         hotelreservation::NearbyResponse geo_resp;
-        if (!microservice::utils::deserialize_message(ser1de, geo_resp_str, geo_resp)) {
-            return hotelreservation::SearchResponse();
+        if (!sendProtobufOverUDS("/tmp/geo_service.sock", microservice::utils::serialize_message(ser1de, geo_req), geo_resp_str) ||
+            !microservice::utils::deserialize_message(ser1de, geo_resp_str, geo_resp)) {
+            return false;
         }
         // Get rates for these hotels
         hotelreservation::GetRatesRequest rate_req;
@@ -70,10 +85,11 @@ public:
         rate_req.set_in_date(req.in_date());
         rate_req.set_out_date(req.out_date());
         *rate_req.mutable_padding() = microservice::utils::generate_person_padding();
-        std::string rate_resp_str = sendProtobufOverUDS("/tmp/rate_service.sock", microservice::utils::serialize_message(ser1de, rate_req));
+        std::string rate_resp_str;
         hotelreservation::GetRatesResponse rate_resp;
-        if (!microservice::utils::deserialize_message(ser1de, rate_resp_str, rate_resp)) {
-            return hotelreservation::SearchResponse();
+        if (!sendProtobufOverUDS("/tmp/rate_service.sock", microservice::utils::serialize_message(ser1de, rate_req), rate_resp_str) ||
+            !microservice::utils::deserialize_message(ser1de, rate_resp_str, rate_resp)) {
+            return false;
         }
         // Get hotel profiles
         hotelreservation::GetProfilesRequest profile_req;
@@ -81,19 +97,20 @@ public:
             profile_req.add_hotel_ids(hotel_id);
         }
         profile_req.set_locale(req.locale());
+        profile_req.set_profile_fields(req.profile_fields());
         *profile_req.mutable_padding() = microservice::utils::generate_person_padding();
-        std::string profile_resp_str = sendProtobufOverUDS("/tmp/profile_service.sock", microservice::utils::serialize_message(ser1de, profile_req));
+        std::string profile_resp_str;
         hotelreservation::GetProfilesResponse profile_resp;
-        if (!microservice::utils::deserialize_message(ser1de, profile_resp_str, profile_resp)) {
-            return hotelreservation::SearchResponse();
+        if (!sendProtobufOverUDS("/tmp/profile_service.sock", microservice::utils::serialize_message(ser1de, profile_req), profile_resp_str) ||
+            !microservice::utils::deserialize_message(ser1de, profile_resp_str, profile_resp)) {
+            return false;
         }
         // Combine results
-        hotelreservation::SearchResponse response;
         for (const auto& profile : profile_resp.profiles()) {
             *response.add_hotels() = profile;
         }
         *response.mutable_padding() = microservice::utils::generate_person_padding();
-        return response;
+        return true;
     }
 };
 
@@ -102,6 +119,7 @@ int main() {
     const int NUM_WORKERS = 16;  // Number of worker processes
     
     PreforkServer server(NUM_WORKERS);
+    microservice::utils::SingleFlight flights("search", {"search"});
     
     if (!server.setup_socket(socket_path)) {
         std::cerr << "Failed to setup socket" << std::endl;
@@ -111,9 +129,17 @@ int main() {
     std::cout << "Search service socket setup complete" << std::endl;
     
     // Fork worker processes
-    if (server.fork_workers()) {
+    if (!server.fork_workers()) {
+        // This is the master process. master_loop() also returns in a worker
+        // it restarted, which then serves like the others.
+        std::cout << "Search service master process started with " << NUM_WORKERS << " workers" << std::endl;
+        server.master_loop();
+        if (!server.is_worker()) return 0;
+    }
+
+    {
         // This is a worker process
-        SearchService service;
+        SearchService service(flights);
         Ser1de_re ser1de;
         
         // Worker process main loop
@@ -121,10 +147,5 @@ int main() {
             server.get_server_fd(), service, ser1de, "search", "search");
         
         return 0;
-    } else {
-        // This is the master process
-        std::cout << "Search service master process started with " << NUM_WORKERS << " workers" << std::endl;
-        server.master_loop();
-        return 0;
     }
 } 
\ No newline at end of file
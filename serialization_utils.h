@@ -2,14 +2,27 @@
 
 #include <string>
 #include "hotel_reservation.pb.h"
-#include <chrono>
+#include "timing_utils.h"
+#include "trace_utils.h"
+#include "lock_utils.h"
+#include "timing_log.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cxxabi.h>
+#include <fcntl.h>
 #include <fstream>
 #include <mutex>
+#include <set>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <typeinfo>
+#include <unistd.h>
 
 #define USE_SER1DE 0
-#define ENABLE_TIMING 1
+#define ENABLE_TIMING 1  // compile-time switch; trace_utils.h samples at runtime
+// 1: fixed-size records in /logs/timing_<service>_<host>_<pid>.bin (timing_log.h), read by
+//    experiments/latency_report; 0: the old one-number-per-line text files
+#define TIMING_LOG_BINARY 1
 
 #if USE_SER1DE
 #include <ser1de/ser1de_re.h>
@@ -22,7 +35,7 @@ namespace microservice {
 namespace utils {
 
 namespace detail {
-    static std::mutex log_mutex;
+    static ProfiledMutex log_mutex("log");
     static bool logs_dir_created = false;
     
 #if ENABLE_TIMING
@@ -40,16 +53,148 @@ namespace detail {
     std::string get_type_name() {
         return typeid(T).name();
     }
+
+    struct TimingType {
+        std::string name;    // demangled, e.g. "hotelreservation::NearbyRequest"
+        std::string mangled; // legacy text log file prefix
+        uint32_t id;
+    };
+
+    template<typename T>
+    const TimingType& timing_type() {
+        static const TimingType type = [] {
+            TimingType t;
+            t.mangled = get_type_name<T>();
+            int status = 0;
+            char* demangled = abi::__cxa_demangle(t.mangled.c_str(), nullptr, nullptr, &status);
+            t.name = (status == 0 && demangled) ? demangled : t.mangled;
+            free(demangled);
+            t.id = timing::type_id(t.name);
+            return t;
+        }();
+        return type;
+    }
+
+    // Appends timing records to this process's /logs/timing_<service>_<host>_<pid>.bin
+    // (process_log_name()) through a shared file mapping, growing it by
+    // remapping. Callers hold log_mutex.
+    class TimingLogWriter {
+    public:
+        static TimingLogWriter& instance() {
+            static TimingLogWriter writer;
+            return writer;
+        }
+
+        void append(uint16_t phase, uint32_t type_id, const std::string& type_name,
+                    const char* source, uint64_t end_ns, uint64_t duration_ns) {
+            if (!open()) return;
+            if (registered_.insert(type_id).second && types_) {
+                fprintf(types_, "%08x %s\n", type_id, type_name.c_str());
+                fflush(types_);
+            }
+            if (source && !header_->source[0]) {
+                strncpy(header_->source, source, sizeof(header_->source) - 1);
+            }
+            uint64_t count = header_->record_count;
+            if (count == capacity_ && !grow()) return;
+            timing::Record& r = records()[count];
+            r.timestamp_ns = end_ns;
+            r.duration_ns = duration_ns;
+            r.request_id = current_trace().trace_id;
+            r.type_id = type_id;
+            r.phase = phase;
+            r.reserved = 0;
+            __atomic_store_n(&header_->record_count, count + 1, __ATOMIC_RELEASE);
+        }
+
+    private:
+        static constexpr uint64_t kInitialCapacity = 1 << 16; // records
+
+        int fd_ = -1;
+        bool failed_ = false;
+        timing::FileHeader* header_ = nullptr;
+        uint64_t capacity_ = 0;
+        FILE* types_ = nullptr;
+        std::set<uint32_t> registered_;
+
+        timing::Record* records() {
+            return reinterpret_cast<timing::Record*>(header_ + 1);
+        }
+
+        static size_t file_size(uint64_t capacity) {
+            return sizeof(timing::FileHeader) + capacity * sizeof(timing::Record);
+        }
+
+        bool open() {
+            if (header_) return true;
+            if (failed_) return false;
+            failed_ = true; // one attempt per process
+            ensure_logs_dir();
+            // Never reuse an existing log: it may be another process's, still
+            // mapped. A leftover of an earlier run gets a numbered sibling.
+            const std::string name = "/logs/timing_" + process_log_name();
+            std::string base = name;
+            for (int n = 1; fd_ < 0 && n <= 100; ++n) {
+                fd_ = ::open((base + ".bin").c_str(), O_RDWR | O_CREAT | O_EXCL, 0666);
+                if (fd_ < 0 && errno != EEXIST) return false;
+                if (fd_ < 0) base = name + "-" + std::to_string(n);
+            }
+            if (fd_ < 0) return false;
+            if (ftruncate(fd_, file_size(kInitialCapacity)) != 0) return false;
+            void* mem = mmap(nullptr, file_size(kInitialCapacity), PROT_READ | PROT_WRITE,
+                             MAP_SHARED, fd_, 0);
+            if (mem == MAP_FAILED) return false;
+            header_ = static_cast<timing::FileHeader*>(mem);
+            capacity_ = kInitialCapacity;
+            memcpy(header_->magic, timing::kMagic, sizeof(header_->magic));
+            header_->version = timing::kVersion;
+            header_->record_size = sizeof(timing::Record);
+            header_->pid = static_cast<uint64_t>(getpid());
+            header_->record_count = 0;
+            // ours along with the .bin, so any file there is a dead process's
+            types_ = fopen((base + ".types").c_str(), "w");
+            failed_ = false;
+            return true;
+        }
+
+        bool grow() {
+            uint64_t capacity = capacity_ * 2;
+            if (ftruncate(fd_, file_size(capacity)) != 0) return false;
+            void* mem = mremap(header_, file_size(capacity_), file_size(capacity), MREMAP_MAYMOVE);
+            if (mem == MAP_FAILED) return false;
+            header_ = static_cast<timing::FileHeader*>(mem);
+            capacity_ = capacity;
+            return true;
+        }
+    };
+
+#if ENABLE_TIMING
+    inline void log_duration(uint16_t phase, uint32_t type_id, const std::string& type_name,
+                             const char* source, const std::string& legacy_file,
+                             uint64_t end, uint64_t duration) {
+        std::lock_guard<ProfiledMutex> lock(log_mutex);
+#if TIMING_LOG_BINARY
+        (void)legacy_file;
+        TimingLogWriter::instance().append(phase, type_id, type_name, source,
+                                           TscClock::instance().to_ns(end), duration);
+#else
+        (void)phase; (void)type_id; (void)type_name; (void)source; (void)end;
+        ensure_logs_dir();
+        std::ofstream ofs(legacy_file, std::ios::app);
+        ofs << duration << std::endl;
+#endif
+    }
+#endif
 }
 
 template<typename T>
 std::string serialize_message(Ser1de_re& ser1de, const T& message) {
-    using namespace std::chrono;
-    
     std::string serialized;
     
 #if ENABLE_TIMING
-    auto start = high_resolution_clock::now();
+    const bool timed = trace_active();
+    const TscClock& clock = TscClock::instance();
+    uint64_t start = timed ? clock.now() : 0;
 #endif
 
 #if USE_SER1DE
@@ -61,15 +206,12 @@ std::string serialize_message(Ser1de_re& ser1de, const T& message) {
 #endif
 
 #if ENABLE_TIMING
-    auto end = high_resolution_clock::now();
-    auto duration = duration_cast<nanoseconds>(end - start).count();
-    std::string type_name = detail::get_type_name<T>();
-    std::string log_file = "/logs/" + type_name + "Se.txt";
-    {
-        std::lock_guard<std::mutex> lock(detail::log_mutex);
-        detail::ensure_logs_dir();
-        std::ofstream ofs(log_file, std::ios::app);
-        ofs << duration << std::endl;
+    if (timed) {
+        uint64_t end = clock.now_end();
+        const detail::TimingType& type = detail::timing_type<T>();
+        detail::log_duration(timing::kSerialize, type.id, type.name, nullptr,
+                             "/logs/" + type.mangled + "Se.txt",
+                             end, clock.interval_ns(start, end));
     }
 #endif
     
@@ -78,12 +220,12 @@ std::string serialize_message(Ser1de_re& ser1de, const T& message) {
 
 template<typename T>
 bool deserialize_message(Ser1de_re& ser1de, const std::string& data, T& message) {
-    using namespace std::chrono;
-    
     bool result = false;
     
 #if ENABLE_TIMING
-    auto start = high_resolution_clock::now();
+    const bool timed = trace_active();
+    const TscClock& clock = TscClock::instance();
+    uint64_t start = timed ? clock.now() : 0;
 #endif
 
 #if USE_SER1DE
@@ -99,15 +241,12 @@ bool deserialize_message(Ser1de_re& ser1de, const std::string& data, T& message)
 #endif
 
 #if ENABLE_TIMING
-    auto end = high_resolution_clock::now();
-    auto duration = duration_cast<nanoseconds>(end - start).count();
-    std::string type_name = detail::get_type_name<T>();
-    std::string log_file = "/logs/" + type_name + "De.txt";
-    {
-        std::lock_guard<std::mutex> lock(detail::log_mutex);
-        detail::ensure_logs_dir();
-        std::ofstream ofs(log_file, std::ios::app);
-        ofs << duration << std::endl;
+    if (timed) {
+        uint64_t end = clock.now_end();
+        const detail::TimingType& type = detail::timing_type<T>();
+        detail::log_duration(timing::kDeserialize, type.id, type.name, nullptr,
+                             "/logs/" + type.mangled + "De.txt",
+                             end, clock.interval_ns(start, end));
     }
 #endif
     
@@ -115,37 +254,30 @@ bool deserialize_message(Ser1de_re& ser1de, const std::string& data, T& message)
 }
 
 // Function to log request timing data
+// (start_time/end_time are TscClock readings; callers only take them when
+// trace_active())
 inline void log_request_timing(const std::string& endpoint, 
-                              const std::chrono::steady_clock::time_point& start_time,
-                              const std::chrono::steady_clock::time_point& end_time) {
+                              uint64_t start_time,
+                              uint64_t end_time) {
 #if ENABLE_TIMING
-    using namespace std::chrono;
-    auto duration = duration_cast<nanoseconds>(end_time - start_time).count();
-    std::string log_file = "/logs/frontend_" + endpoint + "_request.txt";
-    {
-        std::lock_guard<std::mutex> lock(detail::log_mutex);
-        detail::ensure_logs_dir();
-        std::ofstream ofs(log_file, std::ios::app);
-        ofs << duration << std::endl;
-    }
+    detail::log_duration(timing::kFrontendRequest, timing::type_id(endpoint), endpoint, "frontend",
+                         "/logs/frontend_" + endpoint + "_request.txt",
+                         end_time, TscClock::instance().interval_ns(start_time, end_time));
 #endif
 }
 
 // Function to log per-service processing timing
+// (start_time/end_time are TscClock readings; callers only take them when
+// trace_active())
 inline void log_service_request_timing(const std::string& service,
                                        const std::string& endpoint,
-                                       const std::chrono::steady_clock::time_point& start_time,
-                                       const std::chrono::steady_clock::time_point& end_time) {
+                                       uint64_t start_time,
+                                       uint64_t end_time) {
 #if ENABLE_TIMING
-    using namespace std::chrono;
-    auto duration = duration_cast<nanoseconds>(end_time - start_time).count();
-    std::string log_file = "/logs/service_" + service + "_request.txt";
-    {
-        std::lock_guard<std::mutex> lock(detail::log_mutex);
-        detail::ensure_logs_dir();
-        std::ofstream ofs(log_file, std::ios::app);
-        ofs << duration << std::endl;
-    }
+    std::string name = service + "/" + endpoint;
+    detail::log_duration(timing::kServiceRequest, timing::type_id(name), name, service.c_str(),
+                         "/logs/service_" + service + "_request.txt",
+                         end_time, TscClock::instance().interval_ns(start_time, end_time));
 #endif
 }
 
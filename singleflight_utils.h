@@ -0,0 +1,362 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include <new>
+#include <pthread.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace microservice {
+namespace utils {
+
+// Normalized coalescing key built from the request fields a result depends
+// on, so parameter order and number formatting do not matter: doubles as
+// their bit pattern (-0 folded into 0), strings length-prefixed.
+class FlightKey {
+public:
+    FlightKey& add(double v) {
+        if (v == 0) v = 0;
+        char bytes[sizeof(v)];
+        memcpy(bytes, &v, sizeof(v));
+        key_.append(bytes, sizeof(v));
+        return *this;
+    }
+
+    FlightKey& add(const std::string& s) {
+        uint32_t len = static_cast<uint32_t>(s.size());
+        key_.append(reinterpret_cast<const char*>(&len), sizeof(len));
+        key_ += s;
+        return *this;
+    }
+
+    const std::string& str() const { return key_; }
+
+private:
+    std::string key_;
+};
+
+// Cross-process request coalescing ("single-flight").
+//
+// Concurrent calls with the same key share one execution: the first caller
+// (the leader) runs the call, the others (followers) block until it finishes
+// and receive a copy of its result bytes. Nothing is kept once the last
+// follower has its copy; this is not a cache.
+//
+// The table lives in an anonymous MAP_SHARED mapping, so a SingleFlight must
+// be constructed before fork() to coalesce across all workers of a service.
+// Slots are grouped into buckets, each with a robust process-shared mutex
+// and condition variable; a leader that dies mid-call leaves its slot to be
+// reclaimed once it is older than the stale limit.
+//
+// Followers wait at most SINGLEFLIGHT_WAIT_MS (default 50) and then run the
+// call themselves, as they do when the leader fails or its result exceeds
+// SINGLEFLIGHT_MAX_BYTES (default 64KB). SINGLEFLIGHT_ROUTES=a,b selects
+// the coalesced routes (default: all routes the service registers; "none"
+// for none). Per-route counters are written to /logs/singleflight_<name>.txt
+// at most once a second.
+class SingleFlight {
+public:
+    static constexpr int kMaxRoutes = 8;
+    static constexpr int kMaxNameLen = 32;
+    static constexpr uint32_t kBuckets = 16;
+    static constexpr uint32_t kSlotsPerBucket = 8;
+    static constexpr size_t kMaxKey = 256;
+
+    struct Route {
+        char name[kMaxNameLen];
+        std::atomic<uint32_t> enabled;
+        std::atomic<uint64_t> leaders;   // calls made on behalf of a group
+        std::atomic<uint64_t> followers; // requests served with a leader's result
+        std::atomic<uint64_t> timeouts;  // followers that stopped waiting
+        std::atomic<uint64_t> failures;  // followers whose leader failed or overflowed
+        std::atomic<uint64_t> bypassed;  // no free slot or key too long
+
+        // Fraction of coalescable requests that did not make their own call.
+        double coalesce_ratio() const {
+            uint64_t l = leaders.load(std::memory_order_relaxed);
+            uint64_t f = followers.load(std::memory_order_relaxed);
+            return l + f ? static_cast<double>(f) / (l + f) : 0.0;
+        }
+    };
+
+    SingleFlight(const char* name, std::initializer_list<const char*> routes) : name_(name) {
+        const char* wait_env = getenv("SINGLEFLIGHT_WAIT_MS");
+        const char* max_env = getenv("SINGLEFLIGHT_MAX_BYTES");
+        wait_ns_ = (wait_env ? strtoull(wait_env, nullptr, 10) : 50) * 1000000ull;
+        max_result_ = max_env ? strtoull(max_env, nullptr, 10) : 64 * 1024;
+        stale_ns_ = std::max<uint64_t>(wait_ns_ * 20, 1000000000ull);
+
+        size_t results = static_cast<size_t>(kBuckets) * kSlotsPerBucket * max_result_;
+        size_t size = sizeof(Control) + results;
+        void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (mem == MAP_FAILED) {
+            perror("singleflight mmap");
+            return; // every run() calls straight through
+        }
+        control_ = new (mem) Control();
+        results_ = static_cast<char*>(mem) + sizeof(Control);
+
+        const char* selected = getenv("SINGLEFLIGHT_ROUTES");
+        for (const char* route : routes) {
+            if (control_->num_routes == static_cast<uint32_t>(kMaxRoutes)) break;
+            Route& r = control_->routes[control_->num_routes++];
+            strncpy(r.name, route, kMaxNameLen - 1);
+            r.enabled.store(!selected || listed(selected, route));
+        }
+
+        pthread_mutexattr_t mattr;
+        pthread_mutexattr_init(&mattr);
+        pthread_mutexattr_setpshared(&mattr, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&mattr, PTHREAD_MUTEX_ROBUST);
+        pthread_condattr_t cattr;
+        pthread_condattr_init(&cattr);
+        pthread_condattr_setpshared(&cattr, PTHREAD_PROCESS_SHARED);
+        pthread_condattr_setclock(&cattr, CLOCK_MONOTONIC);
+        for (Bucket& b : control_->buckets) {
+            pthread_mutex_init(&b.mutex, &mattr);
+            pthread_cond_init(&b.cond, &cattr);
+        }
+        pthread_mutexattr_destroy(&mattr);
+        pthread_condattr_destroy(&cattr);
+    }
+
+    SingleFlight(const SingleFlight&) = delete;
+    SingleFlight& operator=(const SingleFlight&) = delete;
+
+    // nullptr if the route is unknown
+    Route* route(const char* name) {
+        if (!control_) return nullptr;
+        for (uint32_t i = 0; i < control_->num_routes; ++i) {
+            if (strncmp(control_->routes[i].name, name, kMaxNameLen) == 0) return &control_->routes[i];
+        }
+        return nullptr;
+    }
+
+    uint32_t num_routes() const { return control_ ? control_->num_routes : 0; }
+    Route& route_at(uint32_t i) { return control_->routes[i]; }
+
+    static bool enabled(const Route* route) {
+        return route && route->enabled.load(std::memory_order_relaxed);
+    }
+
+    // Runs call(out) -> bool for this key, or waits for a concurrent caller
+    // with the same key and copies its result into out. Returns whether out
+    // holds a successful result.
+    template <typename Call>
+    bool run(Route* route, const std::string& key, std::string& out, Call&& call) {
+        if (!enabled(route)) return call(out);
+        if (key.size() > kMaxKey) {
+            route->bypassed.fetch_add(1, std::memory_order_relaxed);
+            return call(out);
+        }
+        const uint64_t hash = fnv1a(key);
+        Bucket& b = control_->buckets[hash % kBuckets];
+        lock(b);
+        const uint64_t now = now_ns();
+
+        if (Slot* slot = find_in_flight(b, hash, key, now)) {
+            const uint32_t generation = slot->generation;
+            timespec deadline = to_timespec(now + wait_ns_);
+            slot->waiters++;
+            while (slot->generation == generation && slot->state == kInFlight) {
+                int rc = pthread_cond_timedwait(&b.cond, &b.mutex, &deadline);
+                if (rc == EOWNERDEAD) pthread_mutex_consistent(&b.mutex);
+                if (rc == ETIMEDOUT) break;
+            }
+            if (slot->generation == generation) slot->waiters--;
+            if (slot->generation == generation && slot->state == kDone && slot->ok) {
+                out.assign(result(b, slot), slot->result_len);
+                unlock(b);
+                route->followers.fetch_add(1, std::memory_order_relaxed);
+                maybe_flush(now);
+                return true;
+            }
+            const bool timed_out = slot->generation == generation && slot->state == kInFlight;
+            unlock(b);
+            (timed_out ? route->timeouts : route->failures).fetch_add(1, std::memory_order_relaxed);
+            return call(out);
+        }
+
+        Slot* slot = claim(b, now);
+        if (!slot) {
+            unlock(b);
+            route->bypassed.fetch_add(1, std::memory_order_relaxed);
+            return call(out);
+        }
+        slot->hash = hash;
+        slot->key_len = static_cast<uint32_t>(key.size());
+        memcpy(slot->key, key.data(), key.size());
+        slot->state = kInFlight;
+        slot->ok = false;
+        slot->started_ns = now;
+        slot->waiters = 0;
+        const uint32_t generation = ++slot->generation;
+        unlock(b);
+        route->leaders.fetch_add(1, std::memory_order_relaxed);
+
+        const bool ok = call(out);
+
+        lock(b);
+        if (slot->generation == generation) { // not reclaimed as abandoned
+            slot->ok = ok && out.size() <= max_result_;
+            if (slot->ok) {
+                memcpy(result(b, slot), out.data(), out.size());
+                slot->result_len = static_cast<uint32_t>(out.size());
+            }
+            slot->state = kDone;
+            pthread_cond_broadcast(&b.cond);
+        }
+        unlock(b);
+        maybe_flush(now);
+        return ok;
+    }
+
+    // Writes the per-route counters; called at most once a second from
+    // run(), and safe to call from anywhere else.
+    void flush() const {
+        if (!control_) return;
+        struct stat st = {};
+        if (stat("/logs", &st) == -1) {
+            mkdir("/logs", 0777);
+        }
+        std::string path = "/logs/singleflight_" + std::string(name_) + ".txt";
+        std::string tmp = path + "." + std::to_string(getpid()) + ".tmp";
+        FILE* f = fopen(tmp.c_str(), "w");
+        if (!f) return;
+        fprintf(f, "# route enabled leaders followers timeouts failures bypassed coalesce_ratio\n");
+        for (uint32_t i = 0; i < control_->num_routes; ++i) {
+            const Route& r = control_->routes[i];
+            fprintf(f, "%s %u %llu %llu %llu %llu %llu %.4f\n", r.name, r.enabled.load(),
+                    (unsigned long long)r.leaders.load(), (unsigned long long)r.followers.load(),
+                    (unsigned long long)r.timeouts.load(), (unsigned long long)r.failures.load(),
+                    (unsigned long long)r.bypassed.load(), r.coalesce_ratio());
+        }
+        fclose(f);
+        rename(tmp.c_str(), path.c_str());
+    }
+
+private:
+    enum : uint32_t { kIdle = 0, kInFlight = 1, kDone = 2 };
+
+    struct Slot {
+        uint64_t hash;
+        uint64_t started_ns;
+        uint32_t generation;
+        uint32_t state;
+        uint32_t result_len;
+        uint32_t key_len;
+        uint32_t waiters; // followers not yet done with this generation
+        bool ok;
+        char key[kMaxKey];
+    };
+
+    struct alignas(64) Bucket {
+        pthread_mutex_t mutex;
+        pthread_cond_t cond;
+        Slot slots[kSlotsPerBucket];
+    };
+
+    struct Control {
+        uint32_t num_routes = 0;
+        std::atomic<uint64_t> last_flush_ns{0};
+        Route routes[kMaxRoutes];
+        Bucket buckets[kBuckets];
+    };
+
+    const char* name_;
+    Control* control_ = nullptr;
+    char* results_ = nullptr;
+    uint64_t wait_ns_;
+    uint64_t max_result_;
+    uint64_t stale_ns_;
+
+    static bool listed(const char* list, const char* name) {
+        size_t len = strlen(name);
+        for (const char* p = list; *p;) {
+            const char* end = strchr(p, ',');
+            size_t n = end ? static_cast<size_t>(end - p) : strlen(p);
+            if (n == len && strncmp(p, name, len) == 0) return true;
+            if (!end) break;
+            p = end + 1;
+        }
+        return false;
+    }
+
+    static uint64_t fnv1a(const std::string& s) {
+        uint64_t h = 1469598103934665603ull;
+        for (unsigned char c : s) {
+            h = (h ^ c) * 1099511628211ull;
+        }
+        return h;
+    }
+
+    static uint64_t now_ns() {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+    }
+
+    static timespec to_timespec(uint64_t ns) {
+        timespec ts;
+        ts.tv_sec = static_cast<time_t>(ns / 1000000000ull);
+        ts.tv_nsec = static_cast<long>(ns % 1000000000ull);
+        return ts;
+    }
+
+    static void lock(Bucket& b) {
+        // a worker died holding the lock; slot state is always left consistent
+        if (pthread_mutex_lock(&b.mutex) == EOWNERDEAD) pthread_mutex_consistent(&b.mutex);
+    }
+
+    static void unlock(Bucket& b) { pthread_mutex_unlock(&b.mutex); }
+
+    char* result(Bucket& b, Slot* slot) {
+        size_t index = static_cast<size_t>(&b - control_->buckets) * kSlotsPerBucket + (slot - b.slots);
+        return results_ + index * max_result_;
+    }
+
+    Slot* find_in_flight(Bucket& b, uint64_t hash, const std::string& key, uint64_t now) {
+        for (Slot& s : b.slots) {
+            if (s.state == kInFlight && s.hash == hash && s.key_len == key.size() &&
+                now - s.started_ns < stale_ns_ && memcmp(s.key, key.data(), key.size()) == 0) {
+                return &s;
+            }
+        }
+        return nullptr;
+    }
+
+    // A finished slot all followers are done with, or one past the stale
+    // limit (its leader or a follower died). A follower that still wakes up
+    // on a reclaimed slot notices the new generation and calls itself.
+    Slot* claim(Bucket& b, uint64_t now) {
+        for (Slot& s : b.slots) {
+            if (s.state != kInFlight && s.waiters == 0) return &s;
+        }
+        for (Slot& s : b.slots) {
+            if (now - s.started_ns >= stale_ns_) return &s;
+        }
+        return nullptr;
+    }
+
+    void maybe_flush(uint64_t now) {
+        uint64_t last = control_->last_flush_ns.load(std::memory_order_relaxed);
+        if (last && now - last < 1000000000ull) return;
+        if (control_->last_flush_ns.compare_exchange_strong(last, now, std::memory_order_relaxed)) {
+            flush();
+        }
+    }
+};
+
+} // namespace utils
+} // namespace microservice
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+// On-disk format of the binary timing logs, shared by the services that
+// write them (serialization_utils.h) and experiments/latency_report.
+//
+// Every process writes /logs/timing_<service>_<host>_<pid>.bin, with a -<n>
+// suffix if a file of that name is left from an earlier run: a 64-byte
+// FileHeader followed by fixed-size Records, appended through a MAP_SHARED
+// mapping so nothing is lost when a worker is killed. Record type ids are
+// FNV-1a hashes of the type name, so they agree across processes and runs;
+// each process also writes the names it used to a .types file of the same
+// name as "<id in hex> <name>" lines.
+
+namespace microservice {
+namespace timing {
+
+enum Phase : uint16_t {
+    kSerialize = 1,       // type: demangled message type
+    kDeserialize = 2,     // type: demangled message type
+    kServiceRequest = 3,  // type: "<service>/<endpoint>"
+    kFrontendRequest = 4, // type: frontend endpoint
+};
+
+struct Record {
+    uint64_t timestamp_ns; // end of the interval, TscClock nanoseconds
+    uint64_t duration_ns;
+    uint64_t request_id;   // trace id of the request, 0 if none
+    uint32_t type_id;
+    uint16_t phase;
+    uint16_t reserved;
+};
+static_assert(sizeof(Record) == 32, "timing records are 32 bytes on disk");
+
+constexpr char kMagic[8] = {'M', 'S', 'T', 'I', 'M', 'L', 'O', 'G'};
+constexpr uint32_t kVersion = 1;
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint64_t pid;
+    uint64_t record_count; // records written so far; updated after each record
+    char source[32];       // service name of the writing process
+};
+static_assert(sizeof(FileHeader) == 64, "timing log header is 64 bytes on disk");
+
+inline uint32_t type_id(const std::string& name) {
+    uint32_t h = 2166136261u;
+    for (unsigned char c : name) {
+        h ^= c;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+inline const char* phase_name(uint16_t phase) {
+    switch (phase) {
+        case kSerialize: return "Se";
+        case kDeserialize: return "De";
+        case kServiceRequest: return "service";
+        case kFrontendRequest: return "frontend";
+    }
+    return "unknown";
+}
+
+} // namespace timing
+} // namespace microservice
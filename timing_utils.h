@@ -0,0 +1,182 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#define TIMING_HAS_TSC 1
+#else
+#define TIMING_HAS_TSC 0
+#endif
+
+namespace microservice {
+namespace utils {
+
+// Low-overhead clock for hot-path timing.
+//
+// On x86 with an invariant TSC (and a kernel that also trusts it as its
+// clocksource) readings are a bare lfence+rdtsc, converted to nanoseconds with
+// a ratio calibrated once against CLOCK_MONOTONIC. Everywhere else it falls
+// back to clock_gettime(CLOCK_MONOTONIC), which is served from the vDSO.
+// Set TIMING_CLOCK=tsc or TIMING_CLOCK=monotonic to override the choice.
+//
+// The instance is created in the master before fork() (see PreforkServer), so
+// every worker inherits the same calibration instead of redoing it.
+class TscClock {
+public:
+    static TscClock& instance() {
+        static TscClock clock;
+        return clock;
+    }
+
+    // Raw reading in ticks: TSC cycles, or nanoseconds in fallback mode.
+    inline uint64_t now() const {
+#if TIMING_HAS_TSC
+        if (use_tsc_) {
+            _mm_lfence();
+            return __rdtsc();
+        }
+#endif
+        return monotonic_ns();
+    }
+
+    // End-of-interval reading; rdtscp waits for the measured code to retire.
+    inline uint64_t now_end() const {
+#if TIMING_HAS_TSC
+        if (use_tsc_) {
+            unsigned int aux;
+            uint64_t t = __rdtscp(&aux);
+            _mm_lfence();
+            return t;
+        }
+#endif
+        return monotonic_ns();
+    }
+
+    inline uint64_t to_ns(uint64_t ticks) const {
+        return static_cast<uint64_t>(static_cast<double>(ticks) * ns_per_tick_);
+    }
+
+    // Duration of [start, end] with the cost of one clock read removed, so
+    // short intervals (0B-padding messages) are not inflated by the timer.
+    inline uint64_t interval_ns(uint64_t start, uint64_t end) const {
+        if (end <= start) return 0;
+        uint64_t ns = to_ns(end - start);
+        return ns > overhead_ns_ ? ns - overhead_ns_ : 0;
+    }
+
+    bool using_tsc() const { return use_tsc_; }
+    double ticks_per_ns() const { return 1.0 / ns_per_tick_; }
+    uint64_t overhead_ns() const { return overhead_ns_; }
+
+    void report(const char* who) const {
+        std::cout << who << " timing clock: "
+                  << (use_tsc_ ? "invariant TSC" : "CLOCK_MONOTONIC (vDSO)");
+        if (use_tsc_) {
+            std::cout << " @ " << ticks_per_ns() << " GHz";
+        }
+        std::cout << ", read overhead " << overhead_ns_ << " ns" << std::endl;
+    }
+
+    static inline uint64_t monotonic_ns() {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+    }
+
+private:
+    bool use_tsc_ = false;
+    double ns_per_tick_ = 1.0;
+    uint64_t overhead_ns_ = 0;
+
+    TscClock() {
+        use_tsc_ = tsc_usable();
+        if (use_tsc_) {
+            calibrate();
+        }
+        measure_overhead();
+    }
+
+    static bool tsc_usable() {
+#if TIMING_HAS_TSC
+        const char* forced = getenv("TIMING_CLOCK");
+        if (forced && strcmp(forced, "monotonic") == 0) return false;
+        if (forced && strcmp(forced, "tsc") == 0) return true;
+
+        unsigned int eax, ebx, ecx, edx;
+        if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) || !(edx & (1u << 8))) {
+            return false; // no invariant TSC
+        }
+        // The kernel demotes the TSC when it sees it drift across cores or
+        // sockets; follow its judgement.
+        std::ifstream ifs("/sys/devices/system/clocksource/clocksource0/current_clocksource");
+        std::string source;
+        ifs >> source;
+        return source == "tsc";
+#else
+        return false;
+#endif
+    }
+
+    void calibrate() {
+#if TIMING_HAS_TSC
+        // Bracket each CLOCK_MONOTONIC read with two TSC reads and keep the
+        // tightest bracket at either end of a ~20ms window.
+        auto sample = [](uint64_t& tsc, uint64_t& mono) {
+            uint64_t best = UINT64_MAX;
+            for (int i = 0; i < 16; ++i) {
+                uint64_t t0 = __rdtsc();
+                uint64_t m = monotonic_ns();
+                uint64_t t1 = __rdtsc();
+                if (t1 - t0 < best) {
+                    best = t1 - t0;
+                    tsc = t0 + (t1 - t0) / 2;
+                    mono = m;
+                }
+            }
+        };
+        uint64_t tsc0 = 0, mono0 = 0, tsc1 = 0, mono1 = 0;
+        sample(tsc0, mono0);
+        while (monotonic_ns() - mono0 < 20000000ull) {
+        }
+        sample(tsc1, mono1);
+        if (tsc1 <= tsc0 || mono1 <= mono0) {
+            use_tsc_ = false;
+            return;
+        }
+        ns_per_tick_ = static_cast<double>(mono1 - mono0) / static_cast<double>(tsc1 - tsc0);
+#endif
+    }
+
+    void measure_overhead() {
+        // Smallest observed start/end pair is the fixed cost every interval pays.
+        uint64_t best = UINT64_MAX;
+        for (int i = 0; i < 1000; ++i) {
+            uint64_t start = now();
+            uint64_t end = now_end();
+            if (end - start < best) best = end - start;
+        }
+        overhead_ns_ = to_ns(best);
+    }
+};
+
+// "<service>_<host>_<pid>" names this process's files in /logs. Every
+// container mounts the same /logs and numbers its processes from 1, so the
+// pid alone repeats across services; the service is the executable's name
+// and the host is the container's.
+inline std::string process_log_name() {
+    char host[65] = {};
+    if (gethostname(host, sizeof(host) - 1) != 0 || !host[0]) strcpy(host, "localhost");
+    return std::string(program_invocation_short_name) + "_" + host + "_" + std::to_string(getpid());
+}
+
+} // namespace utils
+} // namespace microservice
@@ -0,0 +1,217 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <signal.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace microservice {
+namespace utils {
+
+// Runtime control for timing instrumentation.
+//
+// ENABLE_TIMING still compiles instrumentation in or out; this decides, per
+// request, whether the compiled-in code does anything. The frontend makes a
+// head-based decision when a request arrives (1-in-N per entry point), the
+// decision travels downstream in the RPC frame header (see rpc_utils.h), and
+// every service records timings only for requests that arrived sampled. An
+// unsampled request costs one thread-local flag check per instrumentation
+// point.
+//
+// Controls, all shared by every worker of a service:
+//   TIMING_ENABLED=0|1            initial on/off state (default 1)
+//   TIMING_SAMPLE_RATE=N          default 1-in-N rate for entry points (default 1)
+//   TIMING_SAMPLE_RATES=a=N,b=M   per entry point overrides
+//   SIGUSR1 / SIGUSR2             enable / disable at runtime
+//   GET /admin/timing             frontend control endpoint
+
+struct TraceContext {
+    bool sampled = false;
+    uint64_t trace_id = 0;
+    // Absolute CLOCK_MONOTONIC time by which the request must be answered,
+    // 0 if it has none. Set by the frontend, carried in the frame header.
+    uint64_t deadline_ns = 0;
+};
+
+inline uint64_t monotonic_ns() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+inline bool deadline_passed(const TraceContext& ctx) {
+    return ctx.deadline_ns && monotonic_ns() >= ctx.deadline_ns;
+}
+
+inline TraceContext& current_trace() {
+    static thread_local TraceContext ctx;
+    return ctx;
+}
+
+// Process-shared control block. It lives in an anonymous MAP_SHARED mapping
+// created before fork(), so a signal delivered to the master or a control
+// request served by any frontend worker is seen by all workers.
+struct TraceControl {
+    static constexpr int kMaxPoints = 32;
+    static constexpr int kMaxNameLen = 48;
+
+    struct Point {
+        char name[kMaxNameLen];
+        std::atomic<uint32_t> sample_every; // 0 = use the default rate
+    };
+
+    std::atomic<uint32_t> enabled;
+    std::atomic<uint32_t> default_sample_every;
+    std::atomic<uint32_t> registry_lock;
+    std::atomic<uint32_t> num_points;
+    Point points[kMaxPoints];
+
+    // Returns the slot for a named entry point, registering it if needed.
+    Point* find_or_add(const char* name) {
+        while (registry_lock.exchange(1, std::memory_order_acquire)) {
+        }
+        Point* found = nullptr;
+        uint32_t n = num_points.load(std::memory_order_relaxed);
+        for (uint32_t i = 0; i < n; ++i) {
+            if (strncmp(points[i].name, name, kMaxNameLen) == 0) {
+                found = &points[i];
+                break;
+            }
+        }
+        if (!found && n < static_cast<uint32_t>(kMaxPoints)) {
+            found = &points[n];
+            strncpy(found->name, name, kMaxNameLen - 1);
+            found->sample_every.store(0, std::memory_order_relaxed);
+            num_points.store(n + 1, std::memory_order_release);
+        }
+        registry_lock.store(0, std::memory_order_release);
+        return found;
+    }
+
+    uint32_t rate_for(const Point* point) const {
+        uint32_t every = point ? point->sample_every.load(std::memory_order_relaxed) : 0;
+        return every ? every : default_sample_every.load(std::memory_order_relaxed);
+    }
+};
+
+namespace detail {
+    inline uint32_t parse_rate(const char* s) {
+        long v = strtol(s, nullptr, 10);
+        return v > 0 ? static_cast<uint32_t>(v) : 1;
+    }
+
+    // TIMING_SAMPLE_RATES="frontend_search=100,frontend_user=1"
+    inline void apply_rate_overrides(TraceControl* ctl, const char* spec) {
+        while (spec && *spec) {
+            const char* comma = strchr(spec, ',');
+            const char* end = comma ? comma : spec + strlen(spec);
+            const char* eq = static_cast<const char*>(memchr(spec, '=', end - spec));
+            if (eq && eq - spec < TraceControl::kMaxNameLen) {
+                char name[TraceControl::kMaxNameLen] = {};
+                memcpy(name, spec, eq - spec);
+                TraceControl::Point* p = ctl->find_or_add(name);
+                if (p) p->sample_every.store(parse_rate(eq + 1), std::memory_order_relaxed);
+            }
+            spec = comma ? comma + 1 : nullptr;
+        }
+    }
+
+    inline TraceControl* create_trace_control() {
+        void* mem = mmap(nullptr, sizeof(TraceControl), PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        TraceControl* ctl = (mem == MAP_FAILED) ? new TraceControl() : new (mem) TraceControl();
+        const char* enabled = getenv("TIMING_ENABLED");
+        ctl->enabled.store(enabled ? (strcmp(enabled, "0") != 0) : 1);
+        const char* rate = getenv("TIMING_SAMPLE_RATE");
+        ctl->default_sample_every.store(rate ? parse_rate(rate) : 1);
+        ctl->registry_lock.store(0);
+        ctl->num_points.store(0);
+        apply_rate_overrides(ctl, getenv("TIMING_SAMPLE_RATES"));
+        return ctl;
+    }
+}
+
+// First call must happen before fork() for the block to be shared; the
+// PreforkServer constructors take care of that.
+inline TraceControl& trace_control() {
+    static TraceControl* ctl = [] {
+        TraceControl* c = detail::create_trace_control();
+        signal(SIGUSR1, [](int) { trace_control().enabled.store(1, std::memory_order_relaxed); });
+        signal(SIGUSR2, [](int) { trace_control().enabled.store(0, std::memory_order_relaxed); });
+        return c;
+    }();
+    return *ctl;
+}
+
+inline bool timing_enabled() {
+    return trace_control().enabled.load(std::memory_order_relaxed) != 0;
+}
+
+// True when the request being handled on this thread should be instrumented.
+inline bool trace_active() {
+    return current_trace().sampled;
+}
+
+// A named entry point where head-based sampling decisions are made.
+class SamplePoint {
+public:
+    explicit SamplePoint(const char* name) : name_(name) {
+        slot_ = trace_control().find_or_add(name);
+    }
+
+    bool sample() {
+        TraceControl& ctl = trace_control();
+        if (!ctl.enabled.load(std::memory_order_relaxed)) return false;
+        uint32_t every = ctl.rate_for(slot_);
+        if (every <= 1) return true;
+        return counter_.fetch_add(1, std::memory_order_relaxed) % every == 0;
+    }
+
+    const char* name() const { return name_; }
+
+private:
+    const char* name_;
+    TraceControl::Point* slot_;
+    std::atomic<uint64_t> counter_{0};
+};
+
+inline uint64_t new_trace_id() {
+    static std::atomic<uint32_t> seq{0};
+    return (static_cast<uint64_t>(getpid()) << 32) | seq.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Installs a trace context for the current thread and restores the previous
+// one on scope exit. Heads construct it from a SamplePoint; services from the
+// context carried in the incoming frame.
+class ScopedTrace {
+public:
+    explicit ScopedTrace(SamplePoint& point) : saved_(current_trace()) {
+        TraceContext& ctx = current_trace();
+        ctx.sampled = point.sample();
+        ctx.trace_id = ctx.sampled ? new_trace_id() : 0;
+        ctx.deadline_ns = 0;
+    }
+
+    explicit ScopedTrace(const TraceContext& incoming) : saved_(current_trace()) {
+        TraceContext& ctx = current_trace();
+        ctx.sampled = incoming.sampled && timing_enabled();
+        ctx.trace_id = incoming.trace_id;
+        ctx.deadline_ns = incoming.deadline_ns;
+    }
+
+    ~ScopedTrace() { current_trace() = saved_; }
+
+    ScopedTrace(const ScopedTrace&) = delete;
+    ScopedTrace& operator=(const ScopedTrace&) = delete;
+
+private:
+    TraceContext saved_;
+};
+
+} // namespace utils
+} // namespace microservice
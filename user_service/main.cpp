@@ -22,7 +22,7 @@
 class UserService {
 private:
     std::unordered_map<std::string, std::string> users_; // username -> password
-    std::mutex users_mutex_;
+    microservice::utils::ProfiledMutex users_mutex_{"users"};
 
 public:
     UserService() {
@@ -46,7 +46,7 @@ public:
     }
 
     hotelreservation::UserResponse process_request(const hotelreservation::UserRequest& req) {
-        std::lock_guard<std::mutex> lock(users_mutex_);
+        std::lock_guard<microservice::utils::ProfiledMutex> lock(users_mutex_);
 
         if (users_.find(req.username()) != users_.end()) {
             hotelreservation::UserResponse response;
@@ -63,7 +63,7 @@ public:
     }
 
     hotelreservation::CheckUserResponse process_check_request(const hotelreservation::CheckUserRequest& req) {
-        std::lock_guard<std::mutex> lock(users_mutex_);
+        std::lock_guard<microservice::utils::ProfiledMutex> lock(users_mutex_);
 
         auto it = users_.find(req.username());
         hotelreservation::CheckUserResponse response;
@@ -84,6 +84,9 @@ int main() {
     const int NUM_WORKERS = 16;  // Number of worker processes
     
     PreforkServer server(NUM_WORKERS);
+    // Seeded in the master, so the workers start from its copy-on-write
+    // pages; each then registers users into its own copy
+    UserService service;
     
     if (!server.setup_socket(socket_path)) {
         std::cerr << "Failed to setup socket" << std::endl;
@@ -93,9 +96,16 @@ int main() {
     std::cout << "User service socket setup complete" << std::endl;
     
     // Fork worker processes
-    if (server.fork_workers()) {
+    if (!server.fork_workers()) {
+        // This is the master process. master_loop() also returns in a worker
+        // it restarted, which then serves like the others.
+        std::cout << "User service master process started with " << NUM_WORKERS << " workers" << std::endl;
+        server.master_loop();
+        if (!server.is_worker()) return 0;
+    }
+
+    {
         // This is a worker process
-        UserService service;
         Ser1de_re ser1de;
         
         // Worker process main loop - handle both UserRequest and CheckUserRequest
@@ -112,57 +122,91 @@ int main() {
             }
 
             // Handle the client
-            char len_buf[4];
-            ssize_t n = read(client_fd, len_buf, 4);
-            if (n != 4) { 
-                close(client_fd); 
-                continue; 
+            std::string payload;
+            microservice::utils::TraceContext incoming;
+            uint32_t flags = 0;
+            if (!microservice::rpc::read_request(client_fd, payload, incoming, &flags)) {
+                close(client_fd);
+                continue;
             }
-            
-            uint32_t msg_len = 0;
-            memcpy(&msg_len, len_buf, 4);
-            std::vector<char> buf(msg_len);
-            n = read(client_fd, buf.data(), msg_len);
-            if (n != (ssize_t)msg_len) { 
-                close(client_fd); 
-                continue; 
+            // Shed past its deadline, as worker_loop() does
+            if (microservice::utils::deadline_passed(incoming)) {
+                close(client_fd);
+                continue;
             }
-            
-            // Try to deserialize as UserRequest first
-            hotelreservation::UserRequest user_req;
-            bool ok = microservice::utils::deserialize_message(ser1de, std::string(buf.begin(), buf.end()), user_req);
-            if (ok) {
-                auto start_time = std::chrono::steady_clock::now();
-                auto response = service.process_request(user_req);
-                std::string resp_str = microservice::utils::serialize_message(ser1de, response);
-                uint32_t resp_len = resp_str.size();
-                write(client_fd, &resp_len, 4);
-                write(client_fd, resp_str.data(), resp_len);
-                auto end_time = std::chrono::steady_clock::now();
-                microservice::utils::log_service_request_timing("user", "user", start_time, end_time);
-            } else {
+            microservice::utils::ScopedTrace trace(incoming);
+            const auto& clock = microservice::utils::TscClock::instance();
+            const bool timed = microservice::utils::trace_active();
+            using Perf = microservice::utils::PerfProfiler;
+
+            // Answers one request; returns its endpoint, or nullptr if it is
+            // neither message. Timing starts once the (first) request is
+            // deserialized.
+            uint64_t start_time = 0;
+            auto handle = [&](const std::string& item, std::string& resp_str) -> const char* {
+                // Try to deserialize as UserRequest first
+                hotelreservation::UserRequest user_req;
+                bool ok;
+                {
+                    Perf::Scope phase("user", "user", Perf::kDeserialize);
+                    ok = microservice::utils::deserialize_message(ser1de, item, user_req);
+                }
+                if (ok) {
+                    if (timed && !start_time) start_time = clock.now();
+                    hotelreservation::UserResponse response;
+                    {
+                        Perf::Scope phase("user", "user", Perf::kHandler);
+                        response = service.process_request(user_req);
+                    }
+                    {
+                        Perf::Scope phase("user", "user", Perf::kSerialize);
+                        resp_str = microservice::utils::serialize_message(ser1de, response);
+                    }
+                    return "user";
+                }
                 // Try as CheckUserRequest
                 hotelreservation::CheckUserRequest check_req;
-                ok = microservice::utils::deserialize_message(ser1de, std::string(buf.begin(), buf.end()), check_req);
-                if (ok) {
-                    auto start_time = std::chrono::steady_clock::now();
-                    auto response = service.process_check_request(check_req);
-                    std::string resp_str = microservice::utils::serialize_message(ser1de, response);
-                    uint32_t resp_len = resp_str.size();
-                    write(client_fd, &resp_len, 4);
-                    write(client_fd, resp_str.data(), resp_len);
-                    auto end_time = std::chrono::steady_clock::now();
-                    microservice::utils::log_service_request_timing("user", "check_user", start_time, end_time);
+                {
+                    Perf::Scope phase("user", "check_user", Perf::kDeserialize);
+                    ok = microservice::utils::deserialize_message(ser1de, item, check_req);
+                }
+                if (!ok) return nullptr;
+                if (timed && !start_time) start_time = clock.now();
+                hotelreservation::CheckUserResponse response;
+                {
+                    Perf::Scope phase("user", "check_user", Perf::kHandler);
+                    response = service.process_check_request(check_req);
+                }
+                {
+                    Perf::Scope phase("user", "check_user", Perf::kSerialize);
+                    resp_str = microservice::utils::serialize_message(ser1de, response);
+                }
+                return "check_user";
+            };
+
+            // A batch is logged once, under its first item's endpoint
+            const char* endpoint = nullptr;
+            if (flags & microservice::rpc::kFlagBatch) {
+                serve_batch(client_fd, payload, [&](const std::string& item, std::string& resp_str) {
+                    const char* handled = handle(item, resp_str);
+                    if (!endpoint) endpoint = handled;
+                    return handled != nullptr;
+                });
+            } else {
+                std::string resp_str;
+                endpoint = handle(payload, resp_str);
+                if (endpoint) microservice::rpc::write_response(client_fd, resp_str);
+            }
+            if (timed) {
+                if (endpoint && start_time) {
+                    uint64_t end_time = clock.now_end();
+                    microservice::utils::log_service_request_timing("user", endpoint, start_time, end_time);
                 }
+                Perf::instance().maybe_flush();
             }
             close(client_fd);
         }
         
-        return 0;
-    } else {
-        // This is the master process
-        std::cout << "User service master process started with " << NUM_WORKERS << " workers" << std::endl;
-        server.master_loop();
         return 0;
     }
 }
\ No newline at end of file